@@ -4,7 +4,7 @@
 #include "proxy/http/request_pre_body.hpp"
 #include "proxy/http/response_pre_body.hpp"
 #include "proxy/http/trailer.hpp"
-#include <boost/function.hpp>
+#include "proxy/util/unique_function.hpp"
 #include <boost/noncopyable.hpp>
 #include <iostream>
 
@@ -23,9 +23,10 @@ typedef unsigned long long request_id;
 struct proxy_callbacks : private boost::noncopyable {
   virtual void on_ready(unsigned short port_number) {}
 
-  virtual void async_on_connection(connection_id connection_id,
-                                   BOOST_ASIO_MOVE_ARG(boost::function<void()>)
-                                       callback) {
+  virtual void
+  async_on_connection(connection_id connection_id,
+                      BOOST_ASIO_MOVE_ARG(util::unique_function<void()>)
+                          callback) {
     callback();
   }
 
@@ -37,7 +38,7 @@ struct proxy_callbacks : private boost::noncopyable {
     std::string &host;
     std::string &service;
     http::request_pre_body &request_pre_body;
-    BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>) callback;
+    BOOST_ASIO_MOVE_ARG(util::unique_function<void(bool)>) callback;
   };
   virtual void async_on_connect_method(on_connect_method_params &params) {
     params.callback(false);
@@ -61,6 +62,9 @@ struct proxy_callbacks : private boost::noncopyable {
     // contains.
     bool &expect_100_continue_from_upstream;
 
+    // The trailers of chunked messages. Until a chunked body is parsed (so
+    // always for messages which are not chunked) these are an empty trailer
+    // shared with other connections, which must not be changed.
     http::trailer &request_chunked_trailer;
     http::trailer &response_chunked_trailer;
 
@@ -80,7 +84,7 @@ struct proxy_callbacks : private boost::noncopyable {
 
     // Param to the callback is send_immediately - don't process body before
     // sending pre_body.
-    BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>) callback;
+    BOOST_ASIO_MOVE_ARG(util::unique_function<void(bool)>) callback;
   };
 
   // This function is called when we have read request pre_body from downstream.
@@ -166,6 +170,8 @@ struct proxy_callbacks : private boost::noncopyable {
     http::request_pre_body &request_pre_body;
     http::response_pre_body &response_pre_body;
     bool &expect_100_continue_from_upstream;
+    // Read-only until a chunked body is parsed, see
+    // on_request_pre_body_params.
     http::trailer &request_chunked_trailer;
     http::trailer &response_chunked_trailer;
     bool request_has_more_body;
@@ -186,7 +192,7 @@ struct proxy_callbacks : private boost::noncopyable {
     // after request/response finishes.
     bool &upgrade_connection_to_tunnel;
 
-    BOOST_ASIO_MOVE_ARG(boost::function<void()>) callback;
+    BOOST_ASIO_MOVE_ARG(util::unique_function<void()>) callback;
   };
 
   // This function will be called when some of the request body has been read
@@ -288,7 +294,7 @@ struct proxy_callbacks : private boost::noncopyable {
 
     // Param to the callback is send_immediately - don't process body before
     // sending pre_body.
-    BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>) callback;
+    BOOST_ASIO_MOVE_ARG(util::unique_function<void(bool)>) callback;
   };
 
   // This function is called when we have read response pre_body from upstream.
@@ -323,6 +329,8 @@ struct proxy_callbacks : private boost::noncopyable {
     std::string &host;
     http::request_pre_body &request_pre_body;
     http::response_pre_body &response_pre_body;
+    // Read-only until a chunked body is parsed, see
+    // on_request_pre_body_params.
     http::trailer &response_chunked_trailer;
 
     // True if it is HEAD etc. so even though there is content length it doesn't
@@ -344,7 +352,7 @@ struct proxy_callbacks : private boost::noncopyable {
     // after request/response finishes.
     bool &upgrade_connection_to_tunnel;
 
-    BOOST_ASIO_MOVE_ARG(boost::function<void()>) callback;
+    BOOST_ASIO_MOVE_ARG(util::unique_function<void()>) callback;
   };
 
   // This function will be called when some of the response body has been read
@@ -408,8 +416,8 @@ struct proxy_callbacks : private boost::noncopyable {
   // that proxy may have to close connection in other scenarios too.
   virtual void
   async_on_response_finished(connection_id connection_id, request_id request_id,
-                             BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>)
-                                 callback) {
+                             BOOST_ASIO_MOVE_ARG(
+                                 util::unique_function<void(bool)>) callback) {
     callback(false);
   }
 
@@ -29,7 +29,10 @@ void write_200_response_with_length(
     std::vector<boost::asio::const_buffer> &buffers,
     std::vector<std::unique_ptr<std::string>> &buffers_strings) {
   response_pre_body.code = "200";
+  response_pre_body.status_code = 200;
   response_pre_body.http_version_string = request_pre_body.http_version_string;
+  response_pre_body.http_version_major = request_pre_body.http_version_major;
+  response_pre_body.http_version_minor = request_pre_body.http_version_minor;
   response_pre_body.reason = "OK";
   response_pre_body.headers.push_back(
       {"Content-Length", std::to_string(response->length())});
@@ -0,0 +1,27 @@
+#ifndef PROXY_CERT_CERTIFICATE_HPP
+#define PROXY_CERT_CERTIFICATE_HPP
+
+#include <boost/asio/ssl.hpp>
+#include <boost/shared_ptr.hpp>
+#include <memory>
+
+namespace proxy {
+namespace cert {
+
+typedef std::unique_ptr<X509, decltype(&X509_free)> X509_ptr;
+typedef std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> EVP_PKEY_ptr;
+
+/// Parsed private key and certificate of a bumped host, with the server SSL
+/// context serving them, shared by all connections bumping the host.
+struct certificate {
+  EVP_PKEY_ptr private_key{nullptr, EVP_PKEY_free};
+  X509_ptr x509{nullptr, X509_free};
+  boost::shared_ptr<boost::asio::ssl::context> ssl_context{};
+};
+
+typedef boost::shared_ptr<const certificate> certificate_ptr;
+
+} // namespace cert
+} // namespace proxy
+
+#endif // PROXY_CERT_CERTIFICATE_HPP
@@ -0,0 +1,63 @@
+#include "certificate_cache.hpp"
+#include <functional>
+
+namespace proxy {
+namespace cert {
+
+certificate_cache::certificate_cache(std::size_t capacity, std::size_t shards)
+    : shard_capacity_((capacity + shards - 1) / shards) {
+  for (std::size_t i = 0; i < shards; i++) {
+    shards_.emplace_back(new shard());
+  }
+}
+
+certificate_ptr certificate_cache::find(const std::string &host) {
+  shard &s = shard_for(host);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::unordered_map<std::string, lru_list::iterator>::iterator it =
+      s.index.find(host);
+  if (it == s.index.end()) {
+    misses_++;
+    return certificate_ptr();
+  }
+  hits_++;
+  s.entries.splice(s.entries.begin(), s.entries, it->second);
+  return it->second->second;
+}
+
+void certificate_cache::insert(const std::string &host,
+                               certificate_ptr certificate) {
+  shard &s = shard_for(host);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::unordered_map<std::string, lru_list::iterator>::iterator it =
+      s.index.find(host);
+  if (it != s.index.end()) {
+    it->second->second = certificate;
+    s.entries.splice(s.entries.begin(), s.entries, it->second);
+    return;
+  }
+  s.entries.emplace_front(host, certificate);
+  s.index[host] = s.entries.begin();
+  size_++;
+  if (s.entries.size() > shard_capacity_) {
+    s.index.erase(s.entries.back().first);
+    s.entries.pop_back();
+    size_--;
+    evictions_++;
+  }
+}
+
+certificate_cache::statistics certificate_cache::get_statistics() const {
+  return statistics{.hits = hits_,
+                    .misses = misses_,
+                    .evictions = evictions_,
+                    .size = size_};
+}
+
+certificate_cache::shard &
+certificate_cache::shard_for(const std::string &host) {
+  return *shards_[std::hash<std::string>()(host) % shards_.size()];
+}
+
+} // namespace cert
+} // namespace proxy
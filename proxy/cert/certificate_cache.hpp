@@ -0,0 +1,67 @@
+#ifndef PROXY_CERT_CERTIFICATE_CACHE_HPP
+#define PROXY_CERT_CERTIFICATE_CACHE_HPP
+
+#include "certificate.hpp"
+#include <atomic>
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace proxy {
+namespace cert {
+
+/// Bounded cache of host certificates, safe to use from multiple threads. Hosts
+/// are spread over independently locked shards, each evicting its least
+/// recently used entries.
+class certificate_cache : private boost::noncopyable {
+public:
+  struct statistics {
+    std::uint64_t hits{};
+    std::uint64_t misses{};
+    std::uint64_t evictions{};
+    std::size_t size{};
+  };
+
+  /// Keep at most capacity certificates (rounded up to a multiple of the number
+  /// of shards). Both have to be positive.
+  explicit certificate_cache(std::size_t capacity, std::size_t shards = 16);
+
+  /// The certificate of the host or null if it is not cached.
+  certificate_ptr find(const std::string &host);
+
+  /// Add or replace the certificate of the host.
+  void insert(const std::string &host, certificate_ptr certificate);
+
+  statistics get_statistics() const;
+
+private:
+  /// Most recently used first.
+  typedef std::list<std::pair<std::string, certificate_ptr>> lru_list;
+
+  struct shard {
+    std::mutex mutex{};
+    lru_list entries{};
+    std::unordered_map<std::string, lru_list::iterator> index{};
+  };
+
+  shard &shard_for(const std::string &host);
+
+  std::size_t shard_capacity_;
+  std::vector<std::unique_ptr<shard>> shards_{};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+} // namespace cert
+} // namespace proxy
+
+#endif // PROXY_CERT_CERTIFICATE_CACHE_HPP
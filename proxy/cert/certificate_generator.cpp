@@ -1,12 +1,11 @@
 #include "certificate_generator.hpp"
 #include <boost/asio/ssl.hpp>
+#include <boost/bind/bind.hpp>
 
 namespace proxy {
 namespace cert {
 
-typedef std::unique_ptr<X509, decltype(&X509_free)> X509_ptr;
 typedef std::unique_ptr<BIO, decltype(&BIO_free)> BIO_MEM_ptr;
-typedef std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> EVP_PKEY_ptr;
 typedef std::unique_ptr<X509_EXTENSION, decltype(&X509_EXTENSION_free)>
     X509_ex_ptr;
 typedef std::unique_ptr<ASN1_IA5STRING, decltype(&ASN1_IA5STRING_free)>
@@ -16,8 +15,27 @@ typedef std::unique_ptr<GENERAL_NAME, decltype(&GENERAL_NAME_free)>
 typedef std::unique_ptr<GENERAL_NAMES, decltype(&GENERAL_NAMES_free)>
     GENERAL_NAMES_ptr;
 
-certificate_generator::certificate_generator(rsa_maker &rsa_maker)
-    : rsa_maker_(rsa_maker) {}
+certificate_generator::certificate_generator(
+    rsa_maker &rsa_maker, certificate_cache &certificate_cache,
+    ssl_context_setup setup, std::size_t threads)
+    : rsa_maker_(rsa_maker), certificate_cache_(certificate_cache),
+      ssl_context_setup_(setup),
+      work_guard_(io_context_.get_executor()) {
+  for (std::size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(
+        boost::bind(&boost::asio::io_context::run, &io_context_));
+  }
+}
+
+certificate_generator::~certificate_generator() {
+  work_guard_.reset();
+  io_context_.stop();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  // Nothing may be posted to io_context_ once it is destroyed.
+  rsa_maker_.cancel(io_context_);
+}
 
 int add_extension(X509V3_CTX &ctx, X509 *subject, int nid, const char *value) {
   X509_ex_ptr ex(X509V3_EXT_nconf_nid(nullptr, &ctx, nid, value),
@@ -126,164 +144,205 @@ certificate_generator::generate_root_certificate() {
   return boost::make_tuple(private_key_str, pem);
 }
 
-boost::tuple<std::string, std::string>
-certificate_generator::generate_certificate(std::string host,
-                                            std::string root_private_key,
-                                            std::string root_cert,
-                                            rsa_maker::reschedule reschedule) {
+bool certificate_generator::load_root_certificate(
+    const std::string &private_key, const std::string &certificate) {
   BIO_MEM_ptr bio_root(BIO_new(BIO_s_mem()), BIO_free);
   if (!bio_root) {
-    return boost::make_tuple("", "");
+    return false;
   }
-  if (BIO_write(bio_root.get(), root_private_key.data(),
-                root_private_key.length()) < 0) {
-    return boost::make_tuple("", "");
+  if (BIO_write(bio_root.get(), private_key.data(), private_key.length()) <
+      0) {
+    return false;
   }
 
   EVP_PKEY *tmp = nullptr;
   if (PEM_read_bio_PrivateKey(bio_root.get(), &tmp, 0, 0) == nullptr) {
-    return boost::make_tuple("", "");
+    return false;
   }
   EVP_PKEY_ptr evp_root_private_key(tmp, EVP_PKEY_free);
 
   BIO_MEM_ptr bio_root_cert(BIO_new(BIO_s_mem()), BIO_free);
   if (!bio_root_cert) {
-    return boost::make_tuple("", "");
+    return false;
   }
-  if (BIO_write(bio_root_cert.get(), root_cert.data(), root_cert.length()) <
-      0) {
-    return boost::make_tuple("", "");
+  if (BIO_write(bio_root_cert.get(), certificate.data(),
+                certificate.length()) < 0) {
+    return false;
   }
 
   X509 *issuer_tmp = nullptr;
   if (PEM_read_bio_X509(bio_root_cert.get(), &issuer_tmp, nullptr, nullptr) ==
       nullptr) {
-    return boost::make_tuple("", "");
+    return false;
+  }
+
+  root_private_key_ = std::move(evp_root_private_key);
+  root_certificate_.reset(issuer_tmp);
+  return true;
+}
+
+void certificate_generator::async_generate_certificate(
+    boost::asio::io_context &io_context, std::string host,
+    generate_callback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_flight_.find(host) == in_flight_.end()) {
+      // A mint may have finished since the caller missed the cache.
+      if (certificate_ptr certificate = certificate_cache_.find(host)) {
+        boost::asio::post(io_context, boost::bind(callback, certificate));
+        return;
+      }
+    }
+    std::vector<waiter> &waiters = in_flight_[host];
+    waiters.push_back(waiter{io_context, callback});
+    if (waiters.size() > 1) {
+      // Already being minted.
+      return;
+    }
+  }
+  // Both the key and the certificate are made on the worker threads.
+  rsa_maker_.async_get(io_context_,
+                       boost::bind(&certificate_generator::handle_rsa, this,
+                                   host, boost::placeholders::_1));
+}
+
+void certificate_generator::handle_rsa(std::string host, RSA_ptr &rsa) {
+  certificate_ptr certificate = generate_certificate(host, std::move(rsa));
+
+  std::vector<waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Cached before the mint stops being in flight, so that no request for the
+    // host starts another mint, and cached even if every waiter has stopped.
+    if (certificate) {
+      certificate_cache_.insert(host, certificate);
+    }
+    waiters.swap(in_flight_[host]);
+    in_flight_.erase(host);
+  }
+  for (waiter &next : waiters) {
+    boost::asio::post(next.io_context,
+                      boost::bind(next.callback, certificate));
+  }
+}
+
+certificate_ptr certificate_generator::generate_certificate(std::string host,
+                                                            RSA_ptr rsa) {
+  if (!root_private_key_ || !root_certificate_) {
+    return certificate_ptr();
   }
-  X509_ptr issuer(issuer_tmp, X509_free);
 
   EVP_PKEY_ptr private_key(EVP_PKEY_new(), EVP_PKEY_free);
   if (!private_key) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   X509_ptr x509(X509_new(), X509_free);
   if (!x509.get()) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
-  RSA_ptr rsa = rsa_maker_.get(std::forward<rsa_maker::reschedule>(reschedule));
   if (!rsa) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   if (!EVP_PKEY_assign_RSA(private_key.get(),
                            rsa.get())) { // Transfers ownership of rsa
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   (void)rsa.release();
 
   if (!X509_set_version(x509.get(), 2)) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   if (X509_gmtime_adj(X509_get_notBefore(x509.get()), 0) == nullptr) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   if (X509_gmtime_adj(X509_get_notAfter(x509.get()),
                       (long)60 * 60 * 24 * 365) == nullptr) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   if (!X509_set_pubkey(x509.get(), private_key.get())) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   X509_NAME *iss_name = X509_get_issuer_name(x509.get());
   if (iss_name == nullptr) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   if (!X509_NAME_add_entry_by_txt(iss_name, "CN", MBSTRING_ASC,
                                   (const unsigned char *)"Proxy CA", -1, -1,
                                   0)) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   if (!X509_set_issuer_name(x509.get(), iss_name)) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   ASN1_IA5STRING_ptr ia5(ASN1_IA5STRING_new(), ASN1_IA5STRING_free);
   if (!ia5) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   if (!ASN1_STRING_set(ia5.get(), host.data(), host.length())) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   GENERAL_NAME_ptr gen_dns(GENERAL_NAME_new(), GENERAL_NAME_free);
   if (!gen_dns) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   GENERAL_NAME_set0_value(gen_dns.get(), GEN_DNS, ia5.release());
 
   GENERAL_NAMES_ptr gens(sk_GENERAL_NAME_new_null(), GENERAL_NAMES_free);
   if (!gens) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
   sk_GENERAL_NAME_push(gens.get(), gen_dns.release());
   if (X509_add1_ext_i2d(x509.get(), NID_subject_alt_name, gens.get(), 1,
                         X509V3_ADD_DEFAULT) !=
       1) { // This returns -1 on error sometimes
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   X509V3_CTX ctx;
   X509V3_set_ctx_nodb(&ctx);
-  X509V3_set_ctx(&ctx, issuer.get(), x509.get(), nullptr, nullptr, 0);
+  X509V3_set_ctx(&ctx, root_certificate_.get(), x509.get(), nullptr, nullptr,
+                 0);
   if (!add_extension(ctx, x509.get(), NID_basic_constraints, "CA:FALSE") ||
       !add_extension(ctx, x509.get(), NID_subject_key_identifier, "hash") ||
       !add_extension(ctx, x509.get(), NID_authority_key_identifier,
                      "keyid:always")) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
   if (!X509_set_pubkey(x509.get(), private_key.get())) {
-    return boost::make_tuple("", "");
+    return certificate_ptr();
   }
 
-  if (!X509_sign(x509.get(), evp_root_private_key.get(), EVP_sha256())) {
-    return boost::make_tuple("", "");
+  if (!X509_sign(x509.get(), root_private_key_.get(), EVP_sha256())) {
+    return certificate_ptr();
   }
 
-  BIO_MEM_ptr bio(BIO_new(BIO_s_mem()), BIO_free);
-  if (!bio) {
-    return boost::make_tuple("", "");
+  boost::shared_ptr<boost::asio::ssl::context> ssl_context(
+      new boost::asio::ssl::context(boost::asio::ssl::context::tlsv12));
+  if (!SSL_CTX_use_certificate(ssl_context->native_handle(), x509.get()) ||
+      !SSL_CTX_use_PrivateKey(ssl_context->native_handle(),
+                              private_key.get()) ||
+      !SSL_CTX_add1_chain_cert(ssl_context->native_handle(),
+                               root_certificate_.get())) {
+    return certificate_ptr();
   }
-  if (!PEM_write_bio_X509(bio.get(), x509.get())) {
-    return boost::make_tuple("", "");
-  }
-  BUF_MEM *mem = nullptr;
-  if (!BIO_get_mem_ptr(bio.get(), &mem) || !mem || !mem->data || !mem->length) {
-    return boost::make_tuple("", "");
+  if (ssl_context_setup_ && !ssl_context_setup_(*ssl_context, host)) {
+    return certificate_ptr();
   }
-  std::string pem(mem->data, mem->length);
 
-  BIO_MEM_ptr bio_private(BIO_new(BIO_s_mem()), BIO_free);
-  if (!bio_private) {
-    return boost::make_tuple("", "");
-  }
-  if (!PEM_write_bio_PrivateKey(bio_private.get(), private_key.get(), nullptr,
-                                nullptr, 0, 0, nullptr)) {
-    return boost::make_tuple("", "");
-  }
-  BUF_MEM *mem_private_key = nullptr;
-  if (!BIO_get_mem_ptr(bio_private.get(), &mem_private_key) ||
-      !mem_private_key || !mem_private_key->data || !mem_private_key->length) {
-    return boost::make_tuple("", "");
-  }
-  std::string private_key_str(mem_private_key->data, mem_private_key->length);
-
-  return boost::make_tuple(private_key_str, pem);
+  boost::shared_ptr<certificate> result(new certificate());
+  result->private_key = std::move(private_key);
+  result->x509 = std::move(x509);
+  result->ssl_context = ssl_context;
+  return result;
 }
 
 } // namespace cert
-} // namespace proxy
\ No newline at end of file
+} // namespace proxy
@@ -1,28 +1,85 @@
 #ifndef PROXY_CERT_GENERATE_CERTIFICATE_HPP
 #define PROXY_CERT_GENERATE_CERTIFICATE_HPP
 
+#include "certificate.hpp"
+#include "certificate_cache.hpp"
 #include "rsa_maker.hpp"
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace proxy {
 namespace cert {
 
+/// Mints the root certificate and certificates of bumped hosts. Host
+/// certificates are minted on worker threads, concurrent requests for the same
+/// host share a single mint whose certificate is added to the certificate
+/// cache before the mint stops being in flight.
 struct certificate_generator : private boost::noncopyable {
-  certificate_generator(rsa_maker &rsa_maker);
+  /// Called with the certificate, null on failure.
+  typedef boost::function<void(certificate_ptr)> generate_callback;
+
+  /// Called on the server SSL context of every minted certificate with its
+  /// host, the certificate is dropped if it returns false.
+  typedef boost::function<bool(boost::asio::ssl::context &,
+                               const std::string &)>
+      ssl_context_setup;
+
+  certificate_generator(rsa_maker &rsa_maker,
+                        certificate_cache &certificate_cache,
+                        ssl_context_setup setup = ssl_context_setup(),
+                        std::size_t threads = 1);
+
+  ~certificate_generator();
 
   boost::tuple<std::string, std::string> generate_root_certificate();
 
-  boost::tuple<std::string, std::string>
-  generate_certificate(std::string host, std::string root_private_key,
-                       std::string root_cert, rsa_maker::reschedule reschedule);
+  /// Parse the root private key and certificate (PEM) used to sign the host
+  /// certificates. Has to be called before any host certificate is generated.
+  bool load_root_certificate(const std::string &private_key,
+                             const std::string &certificate);
+
+  /// Generate the certificate for the host signed by the root certificate
+  /// using a key from the RSA maker, together with its server SSL context, and
+  /// add it to the certificate cache. The callback is posted to the io_context.
+  void async_generate_certificate(boost::asio::io_context &io_context,
+                                  std::string host, generate_callback callback);
+
+  certificate_ptr generate_certificate(std::string host, RSA_ptr rsa);
 
 private:
+  struct waiter {
+    boost::asio::io_context &io_context;
+    generate_callback callback;
+  };
+
+  void handle_rsa(std::string host, RSA_ptr &rsa);
+
   rsa_maker &rsa_maker_;
+  certificate_cache &certificate_cache_;
+  ssl_context_setup ssl_context_setup_;
+
+  EVP_PKEY_ptr root_private_key_{nullptr, EVP_PKEY_free};
+  X509_ptr root_certificate_{nullptr, X509_free};
+
+  /// Runs the mints on the worker threads.
+  boost::asio::io_context io_context_{};
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard_;
+  std::vector<std::thread> workers_{};
+
+  /// Waiters of the mints in flight, by host.
+  std::mutex mutex_{};
+  std::unordered_map<std::string, std::vector<waiter>> in_flight_{};
 };
 
 } // namespace cert
 } // namespace proxy
 
-#endif // PROXY_CERT_GENERATE_CERTIFICATE_HPP
\ No newline at end of file
+#endif // PROXY_CERT_GENERATE_CERTIFICATE_HPP
@@ -1,35 +1,127 @@
-
 #include "rsa_maker.hpp"
 #include "rsa.hpp"
+#include <boost/bind/bind.hpp>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // defined(__linux__)
 
 namespace proxy {
 namespace cert {
 
-rsa_maker::rsa_maker() {
-  storage.reserve(HARD_LIMIT);
-  for (int i = 0; i < HARD_LIMIT; i++) {
-    storage.push_back(RSA_ptr(nullptr, RSA_free));
+// Invokes the callback with the key on the io_context thread, owns the key
+// until then (so that it is freed if the handler never runs).
+struct rsa_maker_handler {
+  rsa_maker::get_callback callback;
+  RSA_ptr rsa;
+
+  void operator()() { callback(rsa); }
+};
+
+rsa_maker::rsa_maker(std::size_t threads) {
+  for (std::size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(boost::bind(&rsa_maker::work, this));
   }
 }
 
-void rsa_maker::generate_callback(reschedule reschedule) {
-  if (count >= HARD_LIMIT) {
+rsa_maker::~rsa_maker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  RSA *rsa;
+  while (storage_.pop(rsa)) {
+    RSA_free(rsa);
+  }
+}
+
+void rsa_maker::async_get(boost::asio::io_context &io_context,
+                          get_callback callback) {
+  RSA *rsa = nullptr;
+  if (storage_.pop(rsa)) {
+    if (--count_ <= SOFT_LIMIT) {
+      start_refill();
+    }
+    deliver(io_context, callback, RSA_ptr(rsa, RSA_free));
     return;
   }
-  storage[count++] = generate_rsa();
-  if (count < SOFT_LIMIT) {
-    reschedule();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A worker may have pushed a key in the meantime.
+    if (storage_.pop(rsa)) {
+      --count_;
+    } else {
+      waiters_.push_back(waiter{io_context, callback});
+    }
+    refilling_ = true;
+  }
+  wake_.notify_one();
+  if (rsa) {
+    deliver(io_context, callback, RSA_ptr(rsa, RSA_free));
   }
 }
 
-RSA_ptr rsa_maker::get(reschedule reschedule) {
-  if (count <= SOFT_LIMIT) {
-    reschedule();
+void rsa_maker::cancel(boost::asio::io_context &io_context) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::deque<waiter> waiters;
+  for (waiter &next : waiters_) {
+    if (&next.io_context != &io_context) {
+      waiters.push_back(next);
+    }
   }
-  if (count == 0) {
-    return generate_rsa();
-  } else {
-    return RSA_ptr(storage[--count].release(), RSA_free);
+  waiters_.swap(waiters);
+}
+
+void rsa_maker::start_refill() {
+  if (!refilling_.exchange(true)) {
+    // Take the lock so that the notification is not lost by a worker just
+    // about to wait.
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    wake_.notify_all();
+  }
+}
+
+void rsa_maker::deliver(boost::asio::io_context &io_context,
+                        get_callback callback, RSA_ptr rsa) {
+  boost::asio::post(io_context, rsa_maker_handler{callback, std::move(rsa)});
+}
+
+void rsa_maker::work() {
+#if defined(__linux__)
+  // Keys are generated ahead of time, so connections should win the CPU.
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+#endif // defined(__linux__)
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    while (!stopping_ && waiters_.empty() && !refilling_) {
+      wake_.wait(lock);
+    }
+    if (stopping_) {
+      return;
+    }
+
+    lock.unlock();
+    RSA_ptr rsa = generate_rsa();
+    lock.lock();
+
+    if (!waiters_.empty()) {
+      waiter next = waiters_.front();
+      waiters_.pop_front();
+      deliver(next.io_context, next.callback, std::move(rsa));
+    } else if (rsa && count_ < HARD_LIMIT && storage_.push(rsa.get())) {
+      (void)rsa.release();
+      if (++count_ >= HARD_LIMIT) {
+        refilling_ = false;
+      }
+    }
   }
 }
 
@@ -2,24 +2,70 @@
 #define PROXY_CERT_RSA_MAKER_HPP
 
 #include "rsa.hpp"
+#include <atomic>
+#include <boost/asio.hpp>
 #include <boost/function.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace proxy {
 namespace cert {
 
+/// Keeps a stock of pregenerated RSA keys. The keys are generated by dedicated
+/// worker threads (with lowered priority), which refill the stock up to
+/// HARD_LIMIT whenever it drops to SOFT_LIMIT. Getting a key never generates it
+/// on the calling thread: a ready key is popped from a lock-free queue, or the
+/// caller waits asynchronously for the next key a worker generates.
 class rsa_maker : private boost::noncopyable {
   static const size_t SOFT_LIMIT = 128;
   static const size_t HARD_LIMIT = 156;
-  std::vector<RSA_ptr> storage;
-  size_t count = 0;
 
 public:
-  rsa_maker();
-  typedef boost::function<void()> reschedule;
-  void generate_callback(reschedule reschedule);
-  RSA_ptr get(reschedule reschedule);
+  /// Called with the key (take it over by moving from it).
+  typedef boost::function<void(RSA_ptr &)> get_callback;
+
+  explicit rsa_maker(std::size_t threads = 1);
+
+  ~rsa_maker();
+
+  /// Get a key, the callback is posted to the given io_context. The key is
+  /// null if the generation failed.
+  void async_get(boost::asio::io_context &io_context, get_callback callback);
+
+  /// Drop the callbacks waiting for a key to be posted to the io_context, has
+  /// to be called before the io_context is destroyed if it may have waiters.
+  void cancel(boost::asio::io_context &io_context);
+
+private:
+  struct waiter {
+    boost::asio::io_context &io_context;
+    get_callback callback;
+  };
+
+  void work();
+
+  void start_refill();
+
+  static void deliver(boost::asio::io_context &io_context,
+                      get_callback callback, RSA_ptr rsa);
+
+  boost::lockfree::queue<RSA *> storage_{HARD_LIMIT};
+  std::atomic<size_t> count_{0};
+  std::atomic<bool> refilling_{true};
+
+  /// Guards the fields below and is used with wake_ to put idle workers to
+  /// sleep.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<waiter> waiters_;
+  bool stopping_{};
+
+  std::vector<std::thread> workers_;
 };
 
 } // namespace cert
@@ -0,0 +1,130 @@
+#include "dns_cache.hpp"
+#include <boost/bind/bind.hpp>
+
+namespace proxy {
+namespace dns {
+
+dns_cache::dns_cache(std::size_t capacity, std::chrono::seconds ttl,
+                     std::chrono::seconds negative_ttl)
+    : capacity_(capacity), ttl_(ttl), negative_ttl_(negative_ttl) {}
+
+void dns_cache::async_resolve(boost::asio::ip::tcp::resolver &resolver,
+                              const std::string &host,
+                              const std::string &service,
+                              resolve_callback callback) {
+  boost::asio::ip::tcp::resolver::executor_type executor =
+      resolver.get_executor();
+  std::string key = host + ':' + service;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    std::unordered_map<std::string, lru_list::iterator>::iterator it =
+        index_.find(key);
+    if (it != index_.end() && now < it->second->second.expires) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      const entry &cached = it->second->second;
+      if (cached.error) {
+        negative_hits_++;
+      } else {
+        hits_++;
+      }
+      boost::asio::post(executor,
+                        boost::bind(callback, cached.error, cached.results));
+      if (cached.error || now < cached.refresh ||
+          !in_flight_.emplace(key, std::vector<waiter>()).second) {
+        return;
+      }
+      refreshes_++;
+    } else {
+      misses_++;
+      std::pair<std::unordered_map<std::string, std::vector<waiter>>::iterator,
+                bool>
+          in_flight = in_flight_.emplace(key, std::vector<waiter>());
+      in_flight.first->second.push_back(waiter{executor, callback});
+      if (!in_flight.second) {
+        return;
+      }
+    }
+  }
+  resolve(resolver, key, host, service);
+}
+
+dns_cache::statistics dns_cache::get_statistics() const {
+  return statistics{.hits = hits_,
+                    .negative_hits = negative_hits_,
+                    .misses = misses_,
+                    .refreshes = refreshes_,
+                    .evictions = evictions_,
+                    .size = size_};
+}
+
+void dns_cache::resolve(boost::asio::ip::tcp::resolver &resolver,
+                        const std::string &key, const std::string &host,
+                        const std::string &service) {
+  boost::asio::ip::tcp::resolver::query query(host, service);
+  resolver.async_resolve(query, boost::bind(&dns_cache::handle_resolve, this,
+                                            key, boost::placeholders::_1,
+                                            boost::placeholders::_2));
+}
+
+void dns_cache::handle_resolve(
+    const std::string &key, const boost::system::error_code &e,
+    boost::asio::ip::tcp::resolver::results_type results) {
+  std::vector<waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, std::vector<waiter>>::iterator
+        in_flight_it = in_flight_.find(key);
+    if (in_flight_it != in_flight_.end()) {
+      waiters.swap(in_flight_it->second);
+      in_flight_.erase(in_flight_it);
+    }
+
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (!e) {
+      insert(key, entry{.error = e,
+                        .results = results,
+                        .expires = now + ttl_,
+                        .refresh = now + ttl_ * 3 / 4});
+    } else if (e != boost::asio::error::operation_aborted) {
+      // A failed refresh keeps serving the previous result until it expires.
+      std::unordered_map<std::string, lru_list::iterator>::iterator it =
+          index_.find(key);
+      if (it == index_.end() || it->second->second.error ||
+          now >= it->second->second.expires) {
+        insert(key, entry{.error = e,
+                          .results = results,
+                          .expires = now + negative_ttl_,
+                          .refresh = now + negative_ttl_});
+      }
+    }
+  }
+
+  for (waiter &w : waiters) {
+    boost::asio::post(w.executor, boost::bind(w.callback, e, results));
+  }
+}
+
+void dns_cache::insert(const std::string &key, const entry &new_entry) {
+  std::unordered_map<std::string, lru_list::iterator>::iterator it =
+      index_.find(key);
+  if (it != index_.end()) {
+    it->second->second = new_entry;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  entries_.emplace_front(key, new_entry);
+  index_[key] = entries_.begin();
+  size_++;
+  if (entries_.size() > capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+    size_--;
+    evictions_++;
+  }
+}
+
+} // namespace dns
+} // namespace proxy
@@ -0,0 +1,104 @@
+#ifndef PROXY_DNS_DNS_CACHE_HPP
+#define PROXY_DNS_DNS_CACHE_HPP
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace proxy {
+namespace dns {
+
+/// Cache of host name resolutions in front of the resolvers of all threads,
+/// safe to use from multiple threads. Successful resolutions are kept for ttl,
+/// failures for negative_ttl. An entry used in the last quarter of its ttl is
+/// refreshed in the background while the cached result is still served, so
+/// popular hosts are (almost) never waited for. Concurrent lookups of the same
+/// host share a single resolution. Least recently used entries are evicted
+/// first.
+class dns_cache : private boost::noncopyable {
+public:
+  /// Called with the error or the endpoints.
+  typedef boost::function<void(const boost::system::error_code &,
+                               boost::asio::ip::tcp::resolver::results_type)>
+      resolve_callback;
+
+  struct statistics {
+    std::uint64_t hits{};
+    std::uint64_t negative_hits{};
+    std::uint64_t misses{};
+    std::uint64_t refreshes{};
+    std::uint64_t evictions{};
+    std::size_t size{};
+  };
+
+  /// Keep at most capacity (positive) entries.
+  dns_cache(std::size_t capacity, std::chrono::seconds ttl,
+            std::chrono::seconds negative_ttl);
+
+  /// Resolve the host and service, using the resolver on a cache miss. The
+  /// callback is posted to the executor of the resolver.
+  void async_resolve(boost::asio::ip::tcp::resolver &resolver,
+                     const std::string &host, const std::string &service,
+                     resolve_callback callback);
+
+  statistics get_statistics() const;
+
+private:
+  struct entry {
+    boost::system::error_code error;
+    boost::asio::ip::tcp::resolver::results_type results;
+    std::chrono::steady_clock::time_point expires;
+    std::chrono::steady_clock::time_point refresh;
+  };
+
+  struct waiter {
+    boost::asio::ip::tcp::resolver::executor_type executor;
+    resolve_callback callback;
+  };
+
+  /// Most recently used first.
+  typedef std::list<std::pair<std::string, entry>> lru_list;
+
+  void resolve(boost::asio::ip::tcp::resolver &resolver,
+               const std::string &key, const std::string &host,
+               const std::string &service);
+
+  void handle_resolve(const std::string &key,
+                      const boost::system::error_code &e,
+                      boost::asio::ip::tcp::resolver::results_type results);
+
+  /// Add or replace the entry, has to be called with mutex_ held.
+  void insert(const std::string &key, const entry &new_entry);
+
+  std::size_t capacity_;
+  std::chrono::seconds ttl_;
+  std::chrono::seconds negative_ttl_;
+
+  std::mutex mutex_{};
+  lru_list entries_{};
+  std::unordered_map<std::string, lru_list::iterator> index_{};
+
+  /// Waiters of the resolutions in flight (none for background refreshes).
+  std::unordered_map<std::string, std::vector<waiter>> in_flight_{};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> negative_hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> refreshes_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+} // namespace dns
+} // namespace proxy
+
+#endif // PROXY_DNS_DNS_CACHE_HPP
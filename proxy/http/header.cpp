@@ -1,86 +1,251 @@
 #include "header.hpp"
 #include "proxy/util/misc_strings.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <utility>
 
 namespace proxy {
 namespace http {
 
-header_container::iterator
-header_container::push_back(const value_type &value) {
-  std::string lowercase_name = util::misc_strings::to_lowercase(value.name);
-  int new_idx = storage_.size();
-  int prev_by_name_idx = -1;
-  int next_by_name_idx = -1;
-  int prev_by_seq_idx = -1;
-  int next_by_seq_idx = -1;
-  std::pair<storage_by_name::iterator, bool> header_by_name =
-      storage_by_name_.insert(
-          {lowercase_name,
-           {.first_by_name_idx = new_idx, .last_by_name_idx = new_idx}});
-  if (!header_by_name.second) {
-    prev_by_name_idx = header_by_name.first->second.last_by_name_idx;
-    header_by_name.first->second.last_by_name_idx = new_idx;
-    storage_[prev_by_name_idx].next_by_name_idx = new_idx;
-  }
-  if (first_by_seq_idx == -1) {
-    first_by_seq_idx = new_idx;
-    last_by_seq_idx = new_idx;
-  } else {
-    storage_[last_by_seq_idx].next_by_seq_idx = new_idx;
-    prev_by_seq_idx = last_by_seq_idx;
+namespace {
+
+const std::string_view name_value_separator(
+    util::misc_strings::name_value_separator, NAME_VALUE_SEPARATOR_COUNT);
+const std::string_view crlf(util::misc_strings::crlf, CLRF_COUNT);
+
+inline char *append(char *out, std::string_view value) {
+  if (!value.empty()) {
+    std::memcpy(out, value.data(), value.size());
   }
-  last_by_seq_idx = new_idx;
-  storage_.push_back({.lowercase_name = lowercase_name,
-                      .prev_by_name_idx = prev_by_name_idx,
-                      .next_by_name_idx = next_by_name_idx,
-                      .prev_by_seq_idx = prev_by_seq_idx,
-                      .next_by_seq_idx = next_by_seq_idx,
-                      .header = value});
-  return iterator(storage_, new_idx);
+  return out + value.size();
 }
 
-header_container::name_iterator
-header_container::find(std::string lowercase_name) {
-  int first_by_name_idx = -1;
-  storage_by_name::iterator it = storage_by_name_.find(lowercase_name);
-  if (it != storage_by_name_.end()) {
-    first_by_name_idx = it->second.first_by_name_idx;
-  }
-  return name_iterator(storage_, first_by_name_idx);
-}
-
-void header_container::erase_all(std::string lowercase_name) {
-  storage_by_name::iterator it = storage_by_name_.find(lowercase_name);
-  if (it != storage_by_name_.end()) {
-    int idx = it->second.first_by_name_idx;
-    storage_by_name_.erase(it);
-    while (idx != -1) {
-      // We make an abandoned element. We dont have to care about
-      // storage_by_name_ as we have cleared it already.
-      int prev_by_seq_idx = storage_[idx].prev_by_seq_idx;
-      int next_by_seq_idx = storage_[idx].next_by_seq_idx;
-      if (prev_by_seq_idx == -1) {
-        first_by_seq_idx = next_by_seq_idx;
-      } else {
-        storage_[prev_by_seq_idx].next_by_seq_idx = next_by_seq_idx;
-      }
-      if (next_by_seq_idx == -1) {
-        last_by_seq_idx = prev_by_seq_idx;
-      } else {
-        storage_[next_by_seq_idx].prev_by_seq_idx = prev_by_seq_idx;
+} // namespace
+
+std::ostream &operator<<(std::ostream &os, const header_field &field) {
+  return os << field.view();
+}
+
+header_value &header_value::operator=(std::string_view value) {
+  container_->storage_[idx_].value = container_->arena_.store(value);
+  container_->modified_ = true;
+  return *this;
+}
+
+header_container::header_container(const header_container &other)
+    : header_container() {
+  *this = other;
+}
+
+header_container::header_container(header_container &&other) noexcept {
+  *this = std::move(other);
+}
+
+header_container &
+header_container::operator=(header_container &&other) noexcept {
+  if (this != &other) {
+    // The views move along with the blocks of the arena.
+    storage_ = std::move(other.storage_);
+    first_by_id_idx_ = other.first_by_id_idx_;
+    arena_ = std::move(other.arena_);
+    modified_ = other.modified_;
+    other.clear();
+    other.modified_ = false;
+  }
+  return *this;
+}
+
+header_container &header_container::operator=(const header_container &other) {
+  if (this != &other) {
+    clear();
+    for (const stored_header &stored : other.storage_) {
+      push_back(stored.name, stored.value);
+    }
+    modified_ = other.modified_;
+  }
+  return *this;
+}
+
+std::uint32_t header_container::lowercase_hash(std::string_view name) {
+  // FNV-1a of the lowercase bytes.
+  std::uint32_t hash = 2166136261u;
+  for (char c : name) {
+    if (c >= 'A' && c <= 'Z') {
+      c = c - 'A' + 'a';
+    }
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+int header_container::next_by_hash_idx(int idx, std::uint32_t hash) const {
+  for (int size = storage_.size(); idx < size; idx++) {
+    if (storage_[idx].hash == hash) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+int header_container::next_by_name_idx(int idx, std::uint32_t hash,
+                                       std::string_view lowercase_name) const {
+  for (idx = next_by_hash_idx(idx, hash);
+       idx != -1 && storage_[idx].lowercase_name != lowercase_name;
+       idx = next_by_hash_idx(idx + 1, hash)) {
+  }
+  return idx;
+}
+
+int header_container::next_by_id_idx(int idx, well_known_header id) const {
+  for (; idx < static_cast<int>(storage_.size()); idx++) {
+    if (storage_[idx].id == id) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+template <typename Predicate> void header_container::erase_if(Predicate erase) {
+  // The bytes of the erased headers stay in the arena until the container is
+  // cleared.
+  int kept = 0;
+  for (int idx = 0; idx < static_cast<int>(storage_.size()); idx++) {
+    if (!erase(idx)) {
+      if (kept != idx) {
+        storage_[kept] = storage_[idx];
       }
-      storage_[idx].lowercase_name.clear();
-      storage_[idx].header.value.clear();
-      idx = storage_[idx].next_by_name_idx;
+      kept++;
     }
   }
+  if (kept == static_cast<int>(storage_.size())) {
+    return;
+  }
+  storage_.resize(kept);
+  modified_ = true;
+  first_by_id_idx_.fill(-1);
+  for (int idx = kept - 1; idx >= 0; idx--) {
+    if (storage_[idx].id != well_known_header::none) {
+      first_by_id_idx_[static_cast<std::size_t>(storage_[idx].id)] = idx;
+    }
+  }
+}
+
+header_container::iterator header_container::push_back(std::string_view name,
+                                                       std::string_view value) {
+  stored_header stored;
+  stored.name = arena_.store(name);
+  well_known_header id = to_well_known_header(name);
+  stored.id = id;
+  // Header names are tokens, ASCII only, and mostly sent lowercase already
+  // (always with HTTP/2 clients behind the browser), in which case the name is
+  // its own lowercase name.
+  if (id != well_known_header::none) {
+    stored.lowercase_name = well_known_header_name(id);
+    int &first_idx = first_by_id_idx_[static_cast<std::size_t>(id)];
+    if (first_idx == -1) {
+      first_idx = storage_.size();
+    }
+  } else if (std::any_of(name.begin(), name.end(),
+                         [](char c) { return c >= 'A' && c <= 'Z'; })) {
+    std::string_view lowercase_name = arena_.store(name);
+    char *it = const_cast<char *>(lowercase_name.data());
+    std::transform(it, it + lowercase_name.size(), it, [](char c) {
+      return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+    stored.lowercase_name = lowercase_name;
+  } else {
+    stored.lowercase_name = stored.name;
+  }
+  if (id == well_known_header::none) {
+    stored.hash = lowercase_hash(stored.lowercase_name);
+  }
+  stored.value = arena_.store(value);
+  storage_.push_back(stored);
+  modified_ = true;
+  return iterator(*this, storage_.size() - 1);
+}
+
+header_container::name_iterator
+header_container::find(std::string_view lowercase_name) {
+  well_known_header id = to_well_known_header(lowercase_name);
+  if (id != well_known_header::none) {
+    return find(id);
+  }
+  int idx = next_by_name_idx(0, lowercase_hash(lowercase_name), lowercase_name);
+  return name_iterator(*this, idx);
+}
+
+void header_container::erase_all(std::string_view lowercase_name) {
+  well_known_header id = to_well_known_header(lowercase_name);
+  if (id != well_known_header::none) {
+    erase_all(id);
+    return;
+  }
+  std::uint32_t hash = lowercase_hash(lowercase_name);
+  erase_if([this, hash, lowercase_name](int idx) {
+    return storage_[idx].hash == hash &&
+           storage_[idx].lowercase_name == lowercase_name;
+  });
+}
+
+void header_container::erase_all(well_known_header id) {
+  if (first_by_id_idx_[static_cast<std::size_t>(id)] != -1) {
+    erase_if([this, id](int idx) { return storage_[idx].id == id; });
+  }
 }
 
 void header_container::clear() {
   storage_.clear();
-  storage_by_name_.clear();
-  first_by_seq_idx = -1;
-  last_by_seq_idx = -1;
+  first_by_id_idx_.fill(-1);
+  arena_.clear();
+  modified_ = true;
+}
+
+void header_container::release() {
+  clear();
+  // Neither assigning nor shrinking a small_vector returns it to the inline
+  // entries.
+  std::destroy_at(&storage_);
+  std::construct_at(&storage_);
+  arena_.release();
+}
+
+void header_container::serialize(
+    std::initializer_list<std::string_view> start_line,
+    std::vector<boost::asio::const_buffer> &buffers) {
+  std::size_t size = crlf.size();
+  for (std::string_view piece : start_line) {
+    size += piece.size();
+  }
+  for (const stored_header &stored : storage_) {
+    size += stored.name.size() + name_value_separator.size() + crlf.size();
+    if (stored.value.size() < large_value_size) {
+      size += stored.value.size();
+    }
+  }
+
+  char *block = arena_.allocate(size);
+  char *out = block;
+  for (std::string_view piece : start_line) {
+    out = append(out, piece);
+  }
+  for (const stored_header &stored : storage_) {
+    out = append(out, stored.name);
+    out = append(out, name_value_separator);
+    if (stored.value.size() < large_value_size) {
+      out = append(out, stored.value);
+    } else {
+      buffers.push_back(boost::asio::buffer(block, out - block));
+      buffers.push_back(
+          boost::asio::buffer(stored.value.data(), stored.value.size()));
+      block = out;
+    }
+    out = append(out, crlf);
+  }
+  out = append(out, crlf);
+  buffers.push_back(boost::asio::buffer(block, out - block));
 }
 
 #if !defined(NDEBUG)
@@ -88,31 +253,17 @@ void header_container::clear() {
 void header_container::debug_print() {
   std::cout << "header_container:" << std::endl;
 
-  std::cout << "{first_by_seq_idx = " << first_by_seq_idx
-            << ", last_by_seq_idx = " << last_by_seq_idx << "}" << std::endl;
-
   std::cout << "storage_:" << std::endl;
-  for (int idx = 0; idx < storage_.size(); idx++) {
+  for (int idx = 0; idx < static_cast<int>(storage_.size()); idx++) {
     std::cout << idx << ": {lowercase_name = " << storage_[idx].lowercase_name
-              << ", prev_by_name_idx = " << storage_[idx].prev_by_name_idx
-              << ", next_by_name_idx = " << storage_[idx].next_by_name_idx
-              << ", prev_by_seq_idx = " << storage_[idx].prev_by_seq_idx
-              << ", next_by_seq_idx = " << storage_[idx].next_by_seq_idx
-              << ", name = " << storage_[idx].header.name
-              << ", value = " << storage_[idx].header.value << "}" << std::endl;
-  }
-
-  std::cout << "storage_by_name_:" << std::endl;
-  for (storage_by_name::iterator it = storage_by_name_.begin();
-       it != storage_by_name_.end(); it++) {
-    std::cout << it->first
-              << ": {first_by_name_idx = " << it->second.first_by_name_idx
-              << ", last_by_name_idx = " << it->second.last_by_name_idx << "}"
-              << std::endl;
+              << ", hash = " << storage_[idx].hash
+              << ", id = " << static_cast<int>(storage_[idx].id)
+              << ", name = " << storage_[idx].name
+              << ", value = " << storage_[idx].value << "}" << std::endl;
   }
 }
 
 #endif
 
 } // namespace http
-} // namespace proxy
\ No newline at end of file
+} // namespace proxy
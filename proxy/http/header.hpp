@@ -1,62 +1,189 @@
 #ifndef PROXY_HTTP_HEADER_HPP
 #define PROXY_HTTP_HEADER_HPP
 
+#include "well_known_header.hpp"
+#include "proxy/util/arena.hpp"
+#include <array>
+#include <boost/asio/buffer.hpp>
+#include <boost/container/small_vector.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iosfwd>
+#include <iterator>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 namespace proxy {
 namespace http {
 
+/// A header owning its name and value, e.g. to add to a header_container.
 struct header {
-  const std::string name{};
+  std::string name{};
   std::string value{};
 };
 
+class header_container;
+
+/// The name or the value of a header kept in a header_container, read as a
+/// view into the memory of the container. The view is valid until the header
+/// is changed or the container is cleared.
+class header_field {
+public:
+  header_field(const header_field &) = default;
+  header_field &operator=(const header_field &) = delete;
+
+  std::string_view view() const;
+  operator std::string_view() const { return view(); }
+  std::string str() const { return std::string(view()); }
+
+  const char *data() const { return view().data(); }
+  std::size_t size() const { return view().size(); }
+  std::size_t length() const { return view().size(); }
+  bool empty() const { return view().empty(); }
+  char operator[](std::size_t pos) const { return view()[pos]; }
+
+  friend bool operator==(const header_field &lhs, const header_field &rhs) {
+    return lhs.view() == rhs.view();
+  }
+  friend bool operator==(const header_field &lhs, std::string_view rhs) {
+    return lhs.view() == rhs;
+  }
+  friend std::ostream &operator<<(std::ostream &os, const header_field &field);
+
+protected:
+  header_field(header_container &container, int idx, bool value)
+      : container_(&container), idx_(idx), value_(value) {}
+
+  header_container *container_;
+  int idx_;
+
+private:
+  friend struct header_ref;
+
+  bool value_;
+};
+
+/// The value of a header kept in a header_container. Assigning copies the new
+/// value into the memory of the container, the old one is kept until the
+/// container is cleared.
+class header_value : public header_field {
+public:
+  header_value(const header_value &) = default;
+
+  header_value &operator=(std::string_view value);
+  header_value &operator=(const header_value &other) {
+    return *this = other.view();
+  }
+
+private:
+  friend struct header_ref;
+
+  header_value(header_container &container, int idx)
+      : header_field(container, idx, true) {}
+};
+
+/// A header kept in a header_container, what its iterators point to.
+struct header_ref {
+  header_ref(header_container &container, int idx)
+      : name(container, idx, false), value(container, idx) {}
+
+  header_field name;
+  header_value value;
+
+  operator header() const { return {name.str(), value.str()}; }
+};
+
+/// Headers of a message in the order they came, also iterable by name. Names
+/// and values are stored in an arena owned by the container, so adding a header
+/// copies its bytes but does not allocate for each header. The entries of the
+/// first inline_headers headers are kept in the container itself, few enough
+/// that the containers of an idle connection stay small.
+///
+/// Headers are tagged with their well_known_header as they are added, the
+/// container keeps the index of the first one of each, so finding them needs
+/// neither hashing nor comparing names. Other lookups compare the cached hashes
+/// of the lowercase names before comparing names: for the few headers of a
+/// message this beats hashing into a map.
 class header_container {
+public:
+  static constexpr std::size_t inline_headers = 4;
+
 private:
   struct stored_header {
-    std::string lowercase_name{};
-    int prev_by_name_idx{};
-    int next_by_name_idx{};
-    int prev_by_seq_idx{};
-    int next_by_seq_idx{};
-    header header{};
+    std::string_view name{};
+    std::string_view lowercase_name{};
+    std::string_view value{};
+    /// Hash of lowercase_name, 0 for well-known headers.
+    std::uint32_t hash{0};
+    well_known_header id{well_known_header::none};
   };
-  typedef std::vector<stored_header> storage;
-  storage storage_;
-  int first_by_seq_idx{-1};
-  int last_by_seq_idx{-1};
-  struct header_by_name {
-    int first_by_name_idx{};
-    int last_by_name_idx{};
-  };
-  typedef std::unordered_map<std::string, header_by_name> storage_by_name;
-  storage_by_name storage_by_name_{};
+  typedef boost::container::small_vector<stored_header, inline_headers> storage;
+  storage storage_{};
+  /// Index of the first header of each well-known header, -1 if none.
+  std::array<int, well_known_header_count> first_by_id_idx_;
+  util::arena arena_{};
+  bool modified_{false};
+
+  static std::uint32_t lowercase_hash(std::string_view name);
+
+  /// idx if there is a header at idx, -1 otherwise.
+  int next_by_seq_idx(int idx) const {
+    return idx < static_cast<int>(storage_.size()) ? idx : -1;
+  }
+  /// Index of the first header at or after idx with the given hash, -1 if
+  /// none.
+  int next_by_hash_idx(int idx, std::uint32_t hash) const;
+  /// Index of the first header at or after idx named lowercase_name, whose hash
+  /// is hash, -1 if none.
+  int next_by_name_idx(int idx, std::uint32_t hash,
+                       std::string_view lowercase_name) const;
+  /// Index of the first header at or after idx tagged id, -1 if none.
+  int next_by_id_idx(int idx, well_known_header id) const;
+  /// Erase the headers at the indexes for which erase returns true.
+  template <typename Predicate> void erase_if(Predicate erase);
+
+  friend class header_field;
+  friend class header_value;
 
 public:
   typedef header value_type;
 
+  header_container() { first_by_id_idx_.fill(-1); }
+  header_container(const header_container &other);
+  header_container(header_container &&other) noexcept;
+  header_container &operator=(const header_container &other);
+  header_container &operator=(header_container &&other) noexcept;
+
+  /// What operator-> of the iterators returns, holding the header_ref it
+  /// points to.
+  struct arrow {
+    header_ref ref;
+    header_ref *operator->() { return &ref; }
+  };
+
   struct name_iterator;
   struct iterator {
     typedef iterator self_type;
     typedef header value_type;
-    typedef header &reference;
-    typedef header *pointer;
+    typedef header_ref reference;
+    typedef arrow pointer;
     typedef std::forward_iterator_tag iterator_category;
     typedef int difference_type;
-    iterator(storage &storage, int idx) : storage_(storage), idx_(idx) {}
+    iterator(header_container &container, int idx)
+        : container_(&container), idx_(idx) {}
     self_type operator++() {
-      self_type i = *this;
-      idx_ = storage_[idx_].next_by_seq_idx;
-      return i;
+      idx_ = container_->next_by_seq_idx(idx_ + 1);
+      return *this;
     }
     self_type operator++(int) {
-      idx_ = storage_[idx_].next_by_seq_idx;
-      return *this;
+      self_type i = *this;
+      idx_ = container_->next_by_seq_idx(idx_ + 1);
+      return i;
     }
-    reference operator*() { return storage_[idx_].header; }
-    pointer operator->() { return &storage_[idx_].header; }
+    reference operator*() { return header_ref(*container_, idx_); }
+    pointer operator->() { return {header_ref(*container_, idx_)}; }
     bool operator==(const self_type &rhs) const { return idx_ == rhs.idx_; }
     bool operator!=(const self_type &rhs) const { return idx_ != rhs.idx_; }
     bool operator==(const name_iterator &rhs) const { return idx_ == rhs.idx_; }
@@ -64,55 +191,105 @@ public:
     friend struct name_iterator;
 
   private:
-    storage &storage_;
+    header_container *container_;
     int idx_;
   };
 
   struct name_iterator {
     typedef name_iterator self_type;
     typedef header value_type;
-    typedef header &reference;
-    typedef header *pointer;
+    typedef header_ref reference;
+    typedef arrow pointer;
     typedef std::forward_iterator_tag iterator_category;
     typedef int difference_type;
-    name_iterator(storage &storage, int idx) : storage_(storage), idx_(idx) {}
+    name_iterator(header_container &container, int idx)
+        : container_(&container), idx_(idx) {}
     self_type operator++() {
-      self_type i = *this;
-      idx_ = storage_[idx_].next_by_name_idx;
-      return i;
+      idx_ = next();
+      return *this;
     }
     self_type operator++(int) {
-      idx_ = storage_[idx_].next_by_name_idx;
-      return *this;
+      self_type i = *this;
+      idx_ = next();
+      return i;
     }
-    reference operator*() { return storage_[idx_].header; }
-    pointer operator->() { return &storage_[idx_].header; }
+    reference operator*() { return header_ref(*container_, idx_); }
+    pointer operator->() { return {header_ref(*container_, idx_)}; }
     bool operator==(const self_type &rhs) const { return idx_ == rhs.idx_; }
     bool operator!=(const self_type &rhs) const { return idx_ != rhs.idx_; }
     bool operator==(const iterator &rhs) const { return idx_ == rhs.idx_; }
     bool operator!=(const iterator &rhs) const { return idx_ != rhs.idx_; }
 
   private:
-    storage &storage_;
+    int next() const {
+      const stored_header &stored = container_->storage_[idx_];
+      if (stored.id != well_known_header::none) {
+        return container_->next_by_id_idx(idx_ + 1, stored.id);
+      }
+      return container_->next_by_name_idx(idx_ + 1, stored.hash,
+                                          stored.lowercase_name);
+    }
+
+    header_container *container_;
     int idx_;
     friend struct iterator;
   };
 
-  iterator push_back(const value_type &value);
+  iterator push_back(std::string_view name, std::string_view value);
+  iterator push_back(const value_type &value) {
+    return push_back(value.name, value.value);
+  }
+  iterator push_back(const header_ref &value) {
+    return push_back(value.name.view(), value.value.view());
+  }
 
-  iterator begin() { return iterator(storage_, first_by_seq_idx); }
-  iterator end() { return iterator(storage_, -1); }
+  iterator begin() { return iterator(*this, next_by_seq_idx(0)); }
+  iterator end() { return iterator(*this, -1); }
 
-  name_iterator find(std::string lowercase_name);
-  void erase_all(std::string lowercase_name);
-  bool empty() { return first_by_seq_idx == -1; }
+  name_iterator find(std::string_view lowercase_name);
+  name_iterator find(well_known_header id) {
+    int idx = first_by_id_idx_[static_cast<std::size_t>(id)];
+    return name_iterator(*this, idx);
+  }
+  /// Erase the headers named lowercase_name, moving the headers after them
+  /// into their place. Invalidates iterators.
+  void erase_all(std::string_view lowercase_name);
+  void erase_all(well_known_header id);
+  bool empty() const { return storage_.empty(); }
+  /// Remove all headers, keeping the memory of the container for the next
+  /// ones.
   void clear();
+  /// Remove all headers and free the memory of the container.
+  void release();
+
+  /// Whether headers were added, erased or changed since the last
+  /// mark_unmodified(), e.g. by a callback after the parser filled the
+  /// container. Unmodified headers can be forwarded as they were received.
+  bool modified() const { return modified_; }
+  void mark_unmodified() { modified_ = false; }
+
+  /// Values of at least this size are not copied by serialize.
+  static constexpr std::size_t large_value_size = 1024;
+
+  /// Append to buffers the start line, given in pieces, the headers and the
+  /// empty line ending them. They are rendered into one contiguous block in the
+  /// arena, so that writing them takes one syscall however many headers there
+  /// are. Only large values are referenced where they are, between blocks. The
+  /// buffers are valid until the container is cleared or destroyed.
+  void serialize(std::initializer_list<std::string_view> start_line,
+                 std::vector<boost::asio::const_buffer> &buffers);
 
 #if !defined(NDEBUG)
   void debug_print();
 #endif
 };
 
+inline std::string_view header_field::view() const {
+  const header_container::stored_header &stored =
+      container_->storage_[idx_];
+  return value_ ? stored.value : stored.name;
+}
+
 } // namespace http
 } // namespace proxy
 
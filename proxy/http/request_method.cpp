@@ -0,0 +1,46 @@
+#include "request_method.hpp"
+
+namespace proxy {
+namespace http {
+
+request_method to_request_method(std::string_view method) {
+  switch (method.size()) {
+  case 3:
+    if (method == "GET") {
+      return request_method::get;
+    } else if (method == "PUT") {
+      return request_method::put;
+    }
+    break;
+  case 4:
+    if (method == "HEAD") {
+      return request_method::head;
+    } else if (method == "POST") {
+      return request_method::post;
+    }
+    break;
+  case 5:
+    if (method == "PATCH") {
+      return request_method::patch;
+    } else if (method == "TRACE") {
+      return request_method::trace;
+    }
+    break;
+  case 6:
+    if (method == "DELETE") {
+      return request_method::delete_;
+    }
+    break;
+  case 7:
+    if (method == "CONNECT") {
+      return request_method::connect;
+    } else if (method == "OPTIONS") {
+      return request_method::options;
+    }
+    break;
+  }
+  return request_method::other;
+}
+
+} // namespace http
+} // namespace proxy
@@ -0,0 +1,30 @@
+#ifndef PROXY_HTTP_REQUEST_METHOD_HPP
+#define PROXY_HTTP_REQUEST_METHOD_HPP
+
+#include <string_view>
+
+namespace proxy {
+namespace http {
+
+/// Request methods of RFC 7231 section 4 and PATCH (RFC 5789), other for any
+/// other token.
+enum class request_method {
+  get,
+  head,
+  post,
+  put,
+  delete_,
+  connect,
+  options,
+  trace,
+  patch,
+  other,
+};
+
+/// The request_method of a method token, which is case-sensitive.
+request_method to_request_method(std::string_view method);
+
+} // namespace http
+} // namespace proxy
+
+#endif // PROXY_HTTP_REQUEST_METHOD_HPP
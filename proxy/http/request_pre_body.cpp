@@ -6,29 +6,67 @@ namespace http {
 
 std::vector<boost::asio::const_buffer> request_pre_body::to_buffers() {
   std::vector<boost::asio::const_buffer> buffers;
-  buffers.push_back(boost::asio::buffer(method));
-  buffers.push_back(
-      boost::asio::buffer(util::misc_strings::method_line_separator));
-  buffers.push_back(boost::asio::buffer(uri));
-  buffers.push_back(
-      boost::asio::buffer(util::misc_strings::method_line_separator));
-  buffers.push_back(boost::asio::buffer(http_version_string));
-  buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
-
-  for (header_container::iterator it = headers.begin(); it != headers.end();
-       it++) {
-    const header &h = *it;
-    buffers.push_back(boost::asio::buffer(h.name));
-    buffers.push_back(
-        boost::asio::buffer(util::misc_strings::name_value_separator));
-    buffers.push_back(boost::asio::buffer(h.value));
-    buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
+  if (!raw.empty() && !headers.modified()) {
+    boost::string_view separator(util::misc_strings::method_line_separator,
+                                 METHOD_LINE_SEPARATOR_COUNT);
+    boost::string_view raw_uri(raw.data(), raw.size());
+    std::size_t uri_length = boost::string_view::npos;
+    if (util::misc_strings::consume_prefix(raw_uri, method) &&
+        util::misc_strings::consume_prefix(raw_uri, separator)) {
+      uri_length = raw_uri.find(separator);
+    }
+    if (uri_length != boost::string_view::npos) {
+      // What follows the uri up to the end of the pre body stays the same as
+      // long as the version does.
+      boost::string_view rest = raw_uri.substr(uri_length);
+      raw_uri = raw_uri.substr(0, uri_length);
+      boost::string_view version_line = rest;
+      if (util::misc_strings::consume_prefix(version_line, separator) &&
+          util::misc_strings::consume_prefix(version_line,
+                                             http_version_string) &&
+          util::misc_strings::consume_prefix(
+              version_line, boost::string_view(util::misc_strings::crlf,
+                                               CLRF_COUNT))) {
+        if (raw_uri == uri) {
+          buffers.push_back(boost::asio::buffer(raw));
+        } else {
+          buffers.push_back(
+              boost::asio::buffer(raw.data(), raw_uri.data() - raw.data()));
+          buffers.push_back(boost::asio::buffer(uri));
+          buffers.push_back(boost::asio::buffer(rest.data(), rest.size()));
+        }
+        return buffers;
+      }
+    }
   }
-  buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
 
+  std::string_view separator(util::misc_strings::method_line_separator,
+                             METHOD_LINE_SEPARATOR_COUNT);
+  headers.serialize({method, separator, uri, separator, http_version_string,
+                     std::string_view(util::misc_strings::crlf, CLRF_COUNT)},
+                    buffers);
   return buffers;
 }
 
+void request_pre_body::clear() {
+  method.clear();
+  method_type = request_method::other;
+  uri.clear();
+  http_version_string.clear();
+  http_version_major = 0;
+  http_version_minor = 0;
+  headers.clear();
+  raw = {};
+}
+
+void request_pre_body::release() {
+  clear();
+  std::string().swap(method);
+  std::string().swap(uri);
+  std::string().swap(http_version_string);
+  headers.release();
+}
+
 bool request_has_body(body_length_representation representation,
                       unsigned long long length) {
   // There ARE NO infinite request bodies.
@@ -3,23 +3,44 @@
 
 #include "body_length_representation.hpp"
 #include "header.hpp"
+#include "request_method.hpp"
 #include <boost/asio.hpp>
 #include <string>
+#include <string_view>
 
 namespace proxy {
 namespace http {
 
-/// A request received from a client.
+/// A request received from a client. The parser fills both the strings, kept
+/// as they came, and the typed fields derived from them; a callback changing
+/// the strings should update the typed fields too.
 struct request_pre_body {
   std::string method{};
+  request_method method_type{request_method::other};
   std::string uri{};
   std::string http_version_string{}; // e.g. HTTP/1.1
+  int http_version_major{};
+  int http_version_minor{};
   header_container headers{};
+  /// The bytes the request was parsed from, referenced in the parser input,
+  /// e.g. the read buffer of the connection. Empty if the request was not
+  /// parsed at once from contiguous input or had folded header lines. As long
+  /// as only the uri changes, e.g. from absolute to origin form, and the
+  /// headers are not modified, the request is forwarded as these bytes rather
+  /// than from the fields.
+  std::string_view raw{};
 
   /// Convert the request into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the request object must remain valid
   /// and not be changed until the write operation has completed.
   std::vector<boost::asio::const_buffer> to_buffers();
+
+  /// Forget the request, keeping the memory of the strings and headers for the
+  /// next request of the connection.
+  void clear();
+
+  /// Forget the request and free the memory of the strings and headers.
+  void release();
 };
 
 bool request_has_body(body_length_representation representation,
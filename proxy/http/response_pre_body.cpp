@@ -6,28 +6,50 @@ namespace http {
 
 std::vector<boost::asio::const_buffer> response_pre_body::to_buffers() {
   std::vector<boost::asio::const_buffer> buffers;
-  buffers.push_back(boost::asio::buffer(http_version_string));
-  buffers.push_back(
-      boost::asio::buffer(util::misc_strings::status_line_separator));
-  buffers.push_back(boost::asio::buffer(code));
-  buffers.push_back(
-      boost::asio::buffer(util::misc_strings::status_line_separator));
-  buffers.push_back(boost::asio::buffer(reason));
-  buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
-
-  for (header_container::iterator it = headers.begin(); it != headers.end();
-       it++) {
-    const header &h = *it;
-    buffers.push_back(boost::asio::buffer(h.name));
-    buffers.push_back(
-        boost::asio::buffer(util::misc_strings::name_value_separator));
-    buffers.push_back(boost::asio::buffer(h.value));
-    buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
+  if (!raw.empty() && !headers.modified()) {
+    boost::string_view separator(util::misc_strings::status_line_separator,
+                                 STATUS_LINE_SEPARATOR_COUNT);
+    boost::string_view status_line(raw.data(), raw.size());
+    if (util::misc_strings::consume_prefix(status_line, http_version_string) &&
+        util::misc_strings::consume_prefix(status_line, separator) &&
+        util::misc_strings::consume_prefix(status_line, code) &&
+        util::misc_strings::consume_prefix(status_line, separator) &&
+        util::misc_strings::consume_prefix(status_line, reason) &&
+        util::misc_strings::consume_prefix(
+            status_line,
+            boost::string_view(util::misc_strings::crlf, CLRF_COUNT))) {
+      buffers.push_back(boost::asio::buffer(raw));
+      return buffers;
+    }
   }
-  buffers.push_back(boost::asio::buffer(util::misc_strings::crlf));
+
+  std::string_view separator(util::misc_strings::status_line_separator,
+                             STATUS_LINE_SEPARATOR_COUNT);
+  headers.serialize({http_version_string, separator, code, separator, reason,
+                     std::string_view(util::misc_strings::crlf, CLRF_COUNT)},
+                    buffers);
   return buffers;
 }
 
+void response_pre_body::clear() {
+  http_version_string.clear();
+  http_version_major = 0;
+  http_version_minor = 0;
+  code.clear();
+  status_code = 0;
+  reason.clear();
+  headers.clear();
+  raw = {};
+}
+
+void response_pre_body::release() {
+  clear();
+  std::string().swap(http_version_string);
+  std::string().swap(code);
+  std::string().swap(reason);
+  headers.release();
+}
+
 bool response_has_body(body_length_representation representation,
                        unsigned long long length) {
   // There ARE infinite response bodies.
@@ -5,21 +5,40 @@
 #include "header.hpp"
 #include <boost/asio.hpp>
 #include <string>
+#include <string_view>
 
 namespace proxy {
 namespace http {
 
-/// A response pre body received from upstream.
+/// A response pre body received from upstream. The parser fills both the
+/// strings, kept as they came, and the typed fields derived from them; a
+/// callback changing the strings should update the typed fields too.
 struct response_pre_body {
   std::string http_version_string{};
+  int http_version_major{};
+  int http_version_minor{};
   std::string code{};
+  int status_code{};
   std::string reason{};
   header_container headers{};
+  /// The bytes the response was parsed from, referenced in the parser input,
+  /// e.g. the read buffer of the connection. Empty if the response was not
+  /// parsed at once from contiguous input or had folded header lines. As long
+  /// as neither the status line nor the headers are modified, the response is
+  /// forwarded as these bytes rather than from the fields.
+  std::string_view raw{};
 
   /// Convert the response into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the response object must remain valid
   /// and not be changed until the write operation has completed.
   std::vector<boost::asio::const_buffer> to_buffers();
+
+  /// Forget the response, keeping the memory of the strings and headers for
+  /// the next response of the connection.
+  void clear();
+
+  /// Forget the response and free the memory of the strings and headers.
+  void release();
 };
 
 bool response_has_body(body_length_representation representation,
@@ -20,6 +20,9 @@ struct trailer {
   /// and not be changed until the write operation has completed.
   std::vector<boost::asio::const_buffer> to_buffers();
 
+  /// Forget the trailer, keeping the memory of the extension and headers.
+  void clear();
+
 private:
   static const std::string prefix; // 0
 };
@@ -0,0 +1,191 @@
+#ifndef PROXY_HTTP_WELL_KNOWN_HEADER_HPP
+#define PROXY_HTTP_WELL_KNOWN_HEADER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace proxy {
+namespace http {
+
+/// Headers the proxy itself looks at and other frequent ones. A
+/// header_container tags its headers with these as they are added and finds
+/// them by index, without hashing or comparing names.
+enum class well_known_header : std::uint8_t {
+  connection,
+  proxy_connection,
+  keep_alive,
+  transfer_encoding,
+  content_length,
+  expect,
+  host,
+  upgrade,
+  te,
+  trailer,
+  content_type,
+  content_encoding,
+  content_range,
+  range,
+  date,
+  server,
+  via,
+  age,
+  vary,
+  etag,
+  expires,
+  last_modified,
+  location,
+  cache_control,
+  pragma,
+  cookie,
+  set_cookie,
+  authorization,
+  proxy_authorization,
+  accept,
+  accept_encoding,
+  accept_language,
+  accept_ranges,
+  user_agent,
+  referer,
+  origin,
+  if_modified_since,
+  if_none_match,
+  none, // Not a well-known header.
+};
+
+constexpr std::size_t well_known_header_count =
+    static_cast<std::size_t>(well_known_header::none);
+
+namespace well_known_header_table {
+
+/// Lowercase names, in the order of well_known_header.
+constexpr std::array<std::string_view, well_known_header_count> names{
+    "connection",
+    "proxy-connection",
+    "keep-alive",
+    "transfer-encoding",
+    "content-length",
+    "expect",
+    "host",
+    "upgrade",
+    "te",
+    "trailer",
+    "content-type",
+    "content-encoding",
+    "content-range",
+    "range",
+    "date",
+    "server",
+    "via",
+    "age",
+    "vary",
+    "etag",
+    "expires",
+    "last-modified",
+    "location",
+    "cache-control",
+    "pragma",
+    "cookie",
+    "set-cookie",
+    "authorization",
+    "proxy-authorization",
+    "accept",
+    "accept-encoding",
+    "accept-language",
+    "accept-ranges",
+    "user-agent",
+    "referer",
+    "origin",
+    "if-modified-since",
+    "if-none-match",
+};
+
+constexpr std::size_t size = 128;
+
+constexpr char to_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/// Slot of a non-empty name, from its length and three of its bytes, in any
+/// case.
+constexpr std::size_t slot(std::uint32_t seed, std::string_view name) {
+  std::uint32_t hash = seed ^ static_cast<std::uint32_t>(name.size());
+  hash = (hash ^ static_cast<unsigned char>(to_lower(name.front()))) *
+         16777619u;
+  hash = (hash ^ static_cast<unsigned char>(to_lower(name[name.size() / 2]))) *
+         16777619u;
+  hash = (hash ^ static_cast<unsigned char>(to_lower(name.back()))) *
+         16777619u;
+  return (hash >> 8) % size;
+}
+
+constexpr bool is_perfect(std::uint32_t seed) {
+  std::array<bool, size> used{};
+  for (std::string_view name : names) {
+    std::size_t s = slot(seed, name);
+    if (used[s]) {
+      return false;
+    }
+    used[s] = true;
+  }
+  return true;
+}
+
+/// The first seed for which the names do not collide, found while compiling.
+constexpr std::uint32_t find_seed() {
+  std::uint32_t seed = 0;
+  while (!is_perfect(seed)) {
+    seed++;
+  }
+  return seed;
+}
+
+constexpr std::uint32_t seed = find_seed();
+
+constexpr std::array<well_known_header, size> make_slots() {
+  std::array<well_known_header, size> slots{};
+  for (well_known_header &id : slots) {
+    id = well_known_header::none;
+  }
+  for (std::size_t i = 0; i < names.size(); i++) {
+    slots[slot(seed, names[i])] = static_cast<well_known_header>(i);
+  }
+  return slots;
+}
+
+constexpr std::array<well_known_header, size> slots = make_slots();
+
+} // namespace well_known_header_table
+
+/// The lowercase name of a well-known header.
+constexpr std::string_view well_known_header_name(well_known_header id) {
+  return well_known_header_table::names[static_cast<std::size_t>(id)];
+}
+
+/// The well-known header named name, in any case, none if there is none.
+constexpr well_known_header to_well_known_header(std::string_view name) {
+  if (name.empty()) {
+    return well_known_header::none;
+  }
+  well_known_header id = well_known_header_table::slots
+      [well_known_header_table::slot(well_known_header_table::seed, name)];
+  if (id == well_known_header::none) {
+    return id;
+  }
+  std::string_view known_name = well_known_header_name(id);
+  if (known_name.size() != name.size()) {
+    return well_known_header::none;
+  }
+  for (std::size_t i = 0; i < name.size(); i++) {
+    if (well_known_header_table::to_lower(name[i]) != known_name[i]) {
+      return well_known_header::none;
+    }
+  }
+  return id;
+}
+
+} // namespace http
+} // namespace proxy
+
+#endif // PROXY_HTTP_WELL_KNOWN_HEADER_HPP
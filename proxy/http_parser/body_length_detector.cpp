@@ -4,6 +4,7 @@
 #include "proxy/util/utils.hpp"
 #include <boost/logic/tribool.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <string_view>
 #include <vector>
 
 namespace proxy {
@@ -16,12 +17,12 @@ const std::string CHUNKED = "chunked";
                            unsigned long long>
 detect_body_length(http::header_container &headers) {
   for (http::header_container::name_iterator transfer_encoding_it =
-           headers.find("transfer-encoding");
+           headers.find(http::well_known_header::transfer_encoding);
        transfer_encoding_it != headers.end(); transfer_encoding_it++) {
-    const http::header &h = *transfer_encoding_it;
-    if (h.value.length() >= CHUNKED.length()) {
-      if (h.value.compare(h.value.length() - CHUNKED.length(), CHUNKED.length(),
-                          CHUNKED) == 0) {
+    std::string_view value = transfer_encoding_it->value;
+    if (value.length() >= CHUNKED.length()) {
+      if (value.compare(value.length() - CHUNKED.length(), CHUNKED.length(),
+                        CHUNKED) == 0) {
         return boost::make_tuple(true,
                                  http::body_length_representation::chunked,
                                  0ULL /* ignored */);
@@ -30,13 +31,13 @@ detect_body_length(http::header_container &headers) {
   }
 
   http::header_container::name_iterator content_length_it =
-      headers.find("content-length");
+      headers.find(http::well_known_header::content_length);
   if (content_length_it != headers.end()) {
     unsigned long long length = 0ULL;
-    const http::header &h = *content_length_it;
-    for (int i = 0; i < h.value.length(); i++) {
+    std::string_view value = content_length_it->value;
+    for (int i = 0; i < value.length(); i++) {
       if (length <= MAX_LENGTH_BEFORE_LAST_DIGIT) {
-        int digit = util::misc_strings::digit_to_int_safe(h.value[i]);
+        int digit = util::misc_strings::digit_to_int_safe(value[i]);
         if (digit > -1) {
           length = length * 10 + digit;
         } else {
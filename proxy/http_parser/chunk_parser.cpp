@@ -17,7 +17,7 @@ void chunk_parser::reset() {
 
 void chunk_parser::save_header_if_non_empty(http::trailer &trailer) {
   if (!header_name_.empty()) {
-    trailer.headers.push_back({header_name_, header_value_});
+    trailer.headers.push_back(header_name_, header_value_);
     header_name_.clear();
     header_value_.clear();
     header_value_space_ = false;
@@ -1,4 +1,5 @@
 #include "request_pre_body_parser.hpp"
+#include "span_scanner.hpp"
 #include "proxy/util/misc_strings.hpp"
 #include <iostream>
 #include <regex>
@@ -11,18 +12,57 @@ void request_pre_body_parser::reset() {
   header_name_.clear();
   header_value_.clear();
   header_value_space_ = false;
+  verbatim_ = true;
+}
+
+void request_pre_body_parser::add_digit(int &number, char digit) {
+  // More digits are not meaningful, the number stops growing at 4 digits.
+  if (number < 1000) {
+    number = number * 10 + util::misc_strings::digit_to_int_safe(digit);
+  }
 }
 
 void request_pre_body_parser::save_header_if_non_empty(
     http::request_pre_body &req) {
   if (!header_name_.empty()) {
-    req.headers.push_back({header_name_, header_value_});
+    req.headers.push_back(header_name_, header_value_);
     header_name_.clear();
     header_value_.clear();
     header_value_space_ = false;
   }
 }
 
+std::size_t request_pre_body_parser::consume_span(http::request_pre_body &req,
+                                                  const char *begin,
+                                                  const char *end) {
+  const span_scanner &scanner = span_scanner::best();
+  std::size_t length;
+  switch (state_) {
+  case state::method:
+    length = scanner.token(begin, end);
+    req.method.append(begin, length);
+    return length;
+  case state::uri:
+    length = scanner.field_content(begin, end);
+    req.uri.append(begin, length);
+    return length;
+  case state::header_name:
+    length = scanner.token(begin, end);
+    header_name_.append(begin, length);
+    return length;
+  case state::header_value:
+    length = scanner.field_content(begin, end);
+    if (length && header_value_space_) {
+      header_value_.push_back(' ');
+      header_value_space_ = false;
+    }
+    header_value_.append(begin, length);
+    return length;
+  default:
+    return 0;
+  }
+}
+
 [[nodiscard]] boost::tribool
 request_pre_body_parser::consume(http::request_pre_body &req, char input) {
   switch (state_) {
@@ -38,6 +78,7 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
     }
   case state::method:
     if (input == ' ') {
+      req.method_type = http::to_request_method(req.method);
       state_ = state::uri;
       return boost::indeterminate;
     } else if (!util::misc_strings::is_char(input) ||
@@ -101,6 +142,7 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
   case state::http_version_major_start:
     if (util::misc_strings::is_digit(input)) {
       req.http_version_string.push_back(input);
+      add_digit(req.http_version_major, input);
       state_ = state::http_version_major;
       return boost::indeterminate;
     } else {
@@ -113,6 +155,7 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
       return boost::indeterminate;
     } else if (util::misc_strings::is_digit(input)) {
       req.http_version_string.push_back(input);
+      add_digit(req.http_version_major, input);
       return boost::indeterminate;
     } else {
       return false;
@@ -120,6 +163,7 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
   case state::http_version_minor_start:
     if (util::misc_strings::is_digit(input)) {
       req.http_version_string.push_back(input);
+      add_digit(req.http_version_minor, input);
       state_ = state::http_version_minor;
       return boost::indeterminate;
     } else {
@@ -131,6 +175,7 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
       return boost::indeterminate;
     } else if (util::misc_strings::is_digit(input)) {
       req.http_version_string.push_back(input);
+      add_digit(req.http_version_minor, input);
       return boost::indeterminate;
     } else {
       return false;
@@ -147,6 +192,8 @@ request_pre_body_parser::consume(http::request_pre_body &req, char input) {
       if (header_name_.empty()) {
         return false;
       }
+      // A folded line, which is not forwarded as it is (RFC 7230 3.2.4).
+      verbatim_ = false;
       state_ = state::header_value;
       header_value_space_ = !header_value_.empty();
       return boost::indeterminate;
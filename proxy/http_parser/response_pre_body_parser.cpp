@@ -1,4 +1,5 @@
 #include "response_pre_body_parser.hpp"
+#include "span_scanner.hpp"
 #include "proxy/util/misc_strings.hpp"
 
 namespace proxy {
@@ -9,18 +10,53 @@ void response_pre_body_parser::reset() {
   header_name_.clear();
   header_value_.clear();
   header_value_space_ = false;
+  verbatim_ = true;
+}
+
+void response_pre_body_parser::add_digit(int &number, char digit) {
+  // More digits are not meaningful, the number stops growing at 4 digits.
+  if (number < 1000) {
+    number = number * 10 + util::misc_strings::digit_to_int_safe(digit);
+  }
 }
 
 void response_pre_body_parser::save_header_if_non_empty(
     http::response_pre_body &res) {
   if (!header_name_.empty()) {
-    res.headers.push_back({header_name_, header_value_});
+    res.headers.push_back(header_name_, header_value_);
     header_name_.clear();
     header_value_.clear();
     header_value_space_ = false;
   }
 }
 
+std::size_t
+response_pre_body_parser::consume_span(http::response_pre_body &res,
+                                       const char *begin, const char *end) {
+  const span_scanner &scanner = span_scanner::best();
+  std::size_t length;
+  switch (state_) {
+  case state::reason:
+    length = scanner.text(begin, end);
+    res.reason.append(begin, length);
+    return length;
+  case state::header_name:
+    length = scanner.token(begin, end);
+    header_name_.append(begin, length);
+    return length;
+  case state::header_value:
+    length = scanner.field_content(begin, end);
+    if (length && header_value_space_) {
+      header_value_.push_back(' ');
+      header_value_space_ = false;
+    }
+    header_value_.append(begin, length);
+    return length;
+  default:
+    return 0;
+  }
+}
+
 [[nodiscard]] boost::tribool
 response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   switch (state_) {
@@ -67,6 +103,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   case state::http_version_major_start:
     if (util::misc_strings::is_digit(input)) {
       res.http_version_string.push_back(input);
+      add_digit(res.http_version_major, input);
       state_ = state::http_version_major;
       return boost::indeterminate;
     } else {
@@ -79,6 +116,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
       return boost::indeterminate;
     } else if (util::misc_strings::is_digit(input)) {
       res.http_version_string.push_back(input);
+      add_digit(res.http_version_major, input);
       return boost::indeterminate;
     } else {
       return false;
@@ -86,6 +124,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   case state::http_version_minor_start:
     if (util::misc_strings::is_digit(input)) {
       res.http_version_string.push_back(input);
+      add_digit(res.http_version_minor, input);
       state_ = state::http_version_minor;
       return boost::indeterminate;
     } else {
@@ -97,6 +136,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
       return boost::indeterminate;
     } else if (util::misc_strings::is_digit(input)) {
       res.http_version_string.push_back(input);
+      add_digit(res.http_version_minor, input);
       return boost::indeterminate;
     } else {
       return false;
@@ -104,6 +144,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   case state::code_1:
     if (util::misc_strings::is_digit(input)) {
       res.code.push_back(input);
+      add_digit(res.status_code, input);
       state_ = state::code_2;
       return boost::indeterminate;
     } else {
@@ -112,6 +153,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   case state::code_2:
     if (util::misc_strings::is_digit(input)) {
       res.code.push_back(input);
+      add_digit(res.status_code, input);
       state_ = state::code_3;
       return boost::indeterminate;
     } else {
@@ -120,6 +162,7 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
   case state::code_3:
     if (util::misc_strings::is_digit(input)) {
       res.code.push_back(input);
+      add_digit(res.status_code, input);
       state_ = state::space_after_code;
       return boost::indeterminate;
     } else {
@@ -154,6 +197,8 @@ response_pre_body_parser::consume(http::response_pre_body &res, char input) {
       if (header_name_.empty()) {
         return false;
       }
+      // A folded line, which is not forwarded as it is (RFC 7230 3.2.4).
+      verbatim_ = false;
       state_ = state::header_value;
       header_value_space_ = !header_value_.empty();
       return boost::indeterminate;
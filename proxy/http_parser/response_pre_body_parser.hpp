@@ -4,6 +4,9 @@
 #include "proxy/http/response_pre_body.hpp"
 #include <boost/logic/tribool.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <iterator>
+#include <memory>
+#include <string_view>
 
 namespace proxy {
 namespace http_parser {
@@ -21,12 +24,32 @@ public:
   template <typename InputIterator>
   [[nodiscard]] boost::tuple<boost::tribool, InputIterator>
   parse(http::response_pre_body &req, InputIterator begin, InputIterator end) {
+    InputIterator consumed_begin = begin;
+    // Whether the whole pre body is in this input.
+    bool from_start = state_ == state::http_version_h;
+    boost::tribool result = boost::indeterminate;
     while (begin != end) {
-      boost::tribool result = consume(req, *begin++);
+      if constexpr (std::contiguous_iterator<InputIterator>) {
+        begin += consume_span(req, std::to_address(begin),
+                              std::to_address(begin) + (end - begin));
+        if (begin == end) {
+          break;
+        }
+      }
+      result = consume(req, *begin++);
       if (result || !result)
-        return boost::make_tuple(result, begin);
+        break;
+    }
+    if (result) {
+      if constexpr (std::contiguous_iterator<InputIterator>) {
+        if (verbatim_ && from_start) {
+          req.raw = std::string_view(std::to_address(consumed_begin),
+                                     begin - consumed_begin);
+        }
+      }
+      // Changes from now on are made by the callbacks.
+      req.headers.mark_unmodified();
     }
-    boost::tribool result = boost::indeterminate;
     return boost::make_tuple(result, begin);
   }
 
@@ -35,6 +58,16 @@ private:
   [[nodiscard]] boost::tribool consume(http::response_pre_body &res,
                                        char input);
 
+  /// Append the characters which continue the current element (e.g. the
+  /// header name) at once, return how many. The character which ends it is
+  /// left to consume.
+  std::size_t consume_span(http::response_pre_body &res, const char *begin,
+                           const char *end);
+
+  /// Append a decimal digit to a number of the start line, e.g. the major
+  /// version.
+  static void add_digit(int &number, char digit);
+
   void save_header_if_non_empty(http::response_pre_body &res);
 
   /// The current state of the parser.
@@ -64,6 +97,8 @@ private:
   std::string header_name_{};
   std::string header_value_{};
   bool header_value_space_{};
+  /// Whether the input can be forwarded as it is, see raw of the pre body.
+  bool verbatim_{true};
 };
 
 } // namespace http_parser
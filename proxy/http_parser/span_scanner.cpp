@@ -0,0 +1,250 @@
+#include "span_scanner.hpp"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROXY_SPAN_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace proxy {
+namespace http_parser {
+
+namespace {
+
+/// The same characters as !is_char || is_ctl || is_tspecial rejects.
+constexpr bool is_token(unsigned char c) {
+  if (c <= 0x20 || c >= 0x7f) {
+    return false;
+  }
+  switch (c) {
+  case '(':
+  case ')':
+  case '<':
+  case '>':
+  case '@':
+  case ',':
+  case ';':
+  case ':':
+  case '\\':
+  case '"':
+  case '/':
+  case '[':
+  case ']':
+  case '?':
+  case '=':
+  case '{':
+  case '}':
+    return false;
+  default:
+    return true;
+  }
+}
+
+constexpr bool is_field_content(unsigned char c) {
+  return c > 0x20 && c != 0x7f;
+}
+
+constexpr bool is_text(unsigned char c) { return c >= 0x20 && c != 0x7f; }
+
+template <bool (*Predicate)(unsigned char)>
+constexpr std::array<bool, 256> make_table() {
+  std::array<bool, 256> table{};
+  for (int c = 0; c < 256; ++c) {
+    table[c] = Predicate(static_cast<unsigned char>(c));
+  }
+  return table;
+}
+
+constexpr std::array<bool, 256> token_table = make_table<is_token>();
+constexpr std::array<bool, 256> field_content_table =
+    make_table<is_field_content>();
+constexpr std::array<bool, 256> text_table = make_table<is_text>();
+
+template <const std::array<bool, 256> &Table>
+std::size_t scan_scalar(const char *begin, const char *end) {
+  const char *it = begin;
+  while (it != end && Table[static_cast<unsigned char>(*it)]) {
+    ++it;
+  }
+  return it - begin;
+}
+
+#if defined(PROXY_SPAN_SCANNER_X86)
+
+/// Token characters by low nibble, a bit for every high nibble (0-7, the rest
+/// are not ASCII), to classify 16 bytes at once with two shuffles.
+constexpr std::array<char, 16> make_token_nibble_table() {
+  std::array<char, 16> table{};
+  for (int low = 0; low < 16; ++low) {
+    int bits = 0;
+    for (int high = 0; high < 8; ++high) {
+      if (is_token(static_cast<unsigned char>(high << 4 | low))) {
+        bits |= 1 << high;
+      }
+    }
+    table[low] = static_cast<char>(bits);
+  }
+  return table;
+}
+
+constexpr std::array<char, 16> token_nibble_table = make_token_nibble_table();
+
+/// The next Width bytes to scan from it, null at the end. When fewer are left
+/// they are copied into the tail padded with zeros (a byte no scanner accepts),
+/// so that no byte past the end is read.
+template <std::size_t Width>
+inline const char *next_block(const char *it, const char *end,
+                              char (&tail)[Width]) {
+  std::size_t left = end - it;
+  if (left >= Width) {
+    return it;
+  }
+  if (left == 0) {
+    return nullptr;
+  }
+  std::memset(tail, 0, Width);
+  std::memcpy(tail, it, left);
+  return tail;
+}
+
+__attribute__((target("sse4.2"))) std::size_t
+scan_token_sse42(const char *begin, const char *end) {
+  const __m128i low_table = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(token_nibble_table.data()));
+  const __m128i high_table =
+      _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+  char tail[16];
+  for (const char *it = begin;; it += 16) {
+    const char *block = next_block(it, end, tail);
+    if (!block) {
+      return it - begin;
+    }
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+    __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(v, nibble_mask));
+    __m128i high = _mm_shuffle_epi8(
+        high_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask));
+    __m128i rejected =
+        _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+    int mask = _mm_movemask_epi8(rejected);
+    if (mask) {
+      return it - begin + __builtin_ctz(mask);
+    }
+  }
+}
+
+/// Index of the first byte up to Last or DEL, the ranges of _mm_cmpestri.
+template <char Last>
+__attribute__((target("sse4.2"))) std::size_t
+scan_ranges_sse42(const char *begin, const char *end) {
+  const __m128i ranges = _mm_setr_epi8(0, Last, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0,
+                                       0, 0, 0, 0, 0, 0);
+  char tail[16];
+  for (const char *it = begin;; it += 16) {
+    const char *block = next_block(it, end, tail);
+    if (!block) {
+      return it - begin;
+    }
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+    int index = _mm_cmpestri(ranges, 4, v, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                 _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16) {
+      return it - begin + index;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) std::size_t
+scan_token_avx2(const char *begin, const char *end) {
+  const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(token_nibble_table.data())));
+  const __m256i high_table = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+  const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+  char tail[32];
+  for (const char *it = begin;; it += 32) {
+    const char *block = next_block(it, end, tail);
+    if (!block) {
+      return it - begin;
+    }
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i low =
+        _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble_mask));
+    __m256i high = _mm256_shuffle_epi8(
+        high_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask));
+    __m256i rejected =
+        _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(rejected));
+    if (mask) {
+      return it - begin + __builtin_ctz(mask);
+    }
+  }
+}
+
+/// Index of the first byte up to Last or DEL.
+template <char Last>
+__attribute__((target("avx2"))) std::size_t
+scan_ranges_avx2(const char *begin, const char *end) {
+  const __m256i last = _mm256_set1_epi8(Last);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  char tail[32];
+  for (const char *it = begin;; it += 32) {
+    const char *block = next_block(it, end, tail);
+    if (!block) {
+      return it - begin;
+    }
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i rejected =
+        _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, last), last),
+                        _mm256_cmpeq_epi8(v, del));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(rejected));
+    if (mask) {
+      return it - begin + __builtin_ctz(mask);
+    }
+  }
+}
+
+const span_scanner sse42_scanner{&scan_token_sse42, &scan_ranges_sse42<0x20>,
+                                 &scan_ranges_sse42<0x1f>};
+
+const span_scanner avx2_scanner{&scan_token_avx2, &scan_ranges_avx2<0x20>,
+                                &scan_ranges_avx2<0x1f>};
+
+#endif // defined(PROXY_SPAN_SCANNER_X86)
+
+const span_scanner scalar_scanner{&scan_scalar<token_table>,
+                                  &scan_scalar<field_content_table>,
+                                  &scan_scalar<text_table>};
+
+} // namespace
+
+const span_scanner &span_scanner::scalar() { return scalar_scanner; }
+
+const span_scanner *span_scanner::sse42() {
+#if defined(PROXY_SPAN_SCANNER_X86)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return &sse42_scanner;
+  }
+#endif
+  return nullptr;
+}
+
+const span_scanner *span_scanner::avx2() {
+#if defined(PROXY_SPAN_SCANNER_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return &avx2_scanner;
+  }
+#endif
+  return nullptr;
+}
+
+const span_scanner &span_scanner::best() {
+  static const span_scanner &best =
+      avx2() ? *avx2() : sse42() ? *sse42() : scalar();
+  return best;
+}
+
+} // namespace http_parser
+} // namespace proxy
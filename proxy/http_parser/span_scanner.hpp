@@ -0,0 +1,37 @@
+#ifndef PROXY_HTTP_PARSER_SPAN_SCANNER_HPP
+#define PROXY_HTTP_PARSER_SPAN_SCANNER_HPP
+
+#include <cstddef>
+
+namespace proxy {
+namespace http_parser {
+
+/// Scanners finding how many of the next bytes belong to the same element of a
+/// pre body, so that the parsers can append them at once rather than byte by
+/// byte. Each returns the length of the longest prefix of [begin, end) made of:
+/// - token: token characters (RFC 7230 tchar), as in methods and header names,
+/// - field_content: bytes which are neither controls nor spaces, as in URIs
+/// and the words of header values,
+/// - text: bytes which are not controls, as in reason phrases.
+struct span_scanner {
+  std::size_t (*token)(const char *begin, const char *end);
+  std::size_t (*field_content)(const char *begin, const char *end);
+  std::size_t (*text)(const char *begin, const char *end);
+
+  /// Scanners using the widest vector instructions the CPU supports (AVX2,
+  /// SSE4.2), chosen on first use.
+  static const span_scanner &best();
+
+  /// Byte by byte scanners, available everywhere.
+  static const span_scanner &scalar();
+
+  /// Scanners using SSE4.2 or AVX2, null if the CPU (or the build target) does
+  /// not support them.
+  static const span_scanner *sse42();
+  static const span_scanner *avx2();
+};
+
+} // namespace http_parser
+} // namespace proxy
+
+#endif // PROXY_HTTP_PARSER_SPAN_SCANNER_HPP
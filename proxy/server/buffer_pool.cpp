@@ -0,0 +1,74 @@
+#include "buffer_pool.hpp"
+
+namespace proxy {
+namespace server {
+
+const std::size_t buffer_pool::SMALLEST_BUFFER_SIZE;
+const std::size_t buffer_pool::LARGEST_BUFFER_SIZE;
+
+/// Sizes of the classes, each 4 times the previous one.
+const std::size_t BUFFER_SIZES[] = {4 * 1024, 16 * 1024, 64 * 1024};
+
+buffer_pool::buffer_pool(std::size_t max_size) : max_size_(max_size) {}
+
+std::string buffer_pool::acquire(std::size_t size) {
+  std::size_t index = 0;
+  while (index + 1 < SIZE_CLASSES && BUFFER_SIZES[index] < size) {
+    index++;
+  }
+  std::vector<std::string> &free = free_[index];
+  if (free.empty()) {
+    misses_++;
+    return std::string(BUFFER_SIZES[index], 0);
+  }
+  hits_++;
+  std::string buffer = std::move(free.back());
+  free.pop_back();
+  size_ -= buffer.size();
+  return buffer;
+}
+
+void buffer_pool::release(std::string &buffer) {
+  std::size_t index = size_class(buffer.size());
+  if (index < SIZE_CLASSES && size_ + buffer.size() <= max_size_) {
+    size_ += buffer.size();
+    free_[index].push_back(std::move(buffer));
+  }
+  // Moved from strings are left in a valid but unspecified state.
+  std::string().swap(buffer);
+}
+
+std::size_t buffer_pool::next_read_size(std::size_t buffer_size,
+                                        std::size_t bytes_read) {
+  std::size_t index = size_class(buffer_size);
+  if (index == SIZE_CLASSES) {
+    return SMALLEST_BUFFER_SIZE;
+  }
+  if (bytes_read == buffer_size && index + 1 < SIZE_CLASSES) {
+    return BUFFER_SIZES[index + 1];
+  }
+  if (index > 0 && bytes_read <= BUFFER_SIZES[index - 1]) {
+    return BUFFER_SIZES[index - 1];
+  }
+  return buffer_size;
+}
+
+buffer_pool::statistics buffer_pool::get_statistics() const {
+  statistics result;
+  result.hits = hits_;
+  result.misses = misses_;
+  result.size = size_;
+  return result;
+}
+
+std::size_t buffer_pool::size_class(std::size_t size) {
+  for (std::size_t index = 0; index < SIZE_CLASSES; index++) {
+    if (BUFFER_SIZES[index] == size) {
+      return index;
+    }
+  }
+  return SIZE_CLASSES;
+}
+
+} // namespace server
+} // namespace proxy
@@ -0,0 +1,64 @@
+#ifndef PROXY_SERVER_BUFFER_POOL_HPP
+#define PROXY_SERVER_BUFFER_POOL_HPP
+
+#include <atomic>
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy {
+namespace server {
+
+/// Free read buffers of one shard in size classes of 4, 16 and 64 KiB, so that
+/// connections hold a buffer only while a read is posted or its bytes are
+/// processed. Not thread-safe, only the statistics may be read from other
+/// threads.
+class buffer_pool : private boost::noncopyable {
+public:
+  struct statistics {
+    std::uint64_t hits{};
+    std::uint64_t misses{};
+    /// Bytes of the free buffers.
+    std::size_t size{};
+  };
+
+  static const std::size_t SMALLEST_BUFFER_SIZE = 4 * 1024;
+  static const std::size_t LARGEST_BUFFER_SIZE = 64 * 1024;
+
+  /// Keeps at most max_size bytes of free buffers.
+  explicit buffer_pool(std::size_t max_size);
+
+  /// A buffer of the smallest size class holding size bytes (or of the largest
+  /// class).
+  std::string acquire(std::size_t size);
+
+  /// Keep the buffer for reuse, it is left empty.
+  void release(std::string &buffer);
+
+  /// The size of the next read after bytes_read were read into a buffer of
+  /// buffer_size: reads filling the buffer go to the next larger class, reads
+  /// fitting the next smaller class go to it.
+  static std::size_t next_read_size(std::size_t buffer_size,
+                                    std::size_t bytes_read);
+
+  statistics get_statistics() const;
+
+private:
+  /// Index of the size class, SIZE_CLASSES if the size is not one.
+  static std::size_t size_class(std::size_t size);
+
+  static const std::size_t SIZE_CLASSES = 3;
+
+  std::size_t max_size_;
+  std::vector<std::string> free_[SIZE_CLASSES];
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_BUFFER_POOL_HPP
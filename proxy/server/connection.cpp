@@ -7,6 +7,7 @@
 #include "proxy/util/utils.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/bind/bind.hpp>
+#include <algorithm>
 #include <ostream>
 #include <vector>
 
@@ -26,29 +27,33 @@ namespace server {
 connection::connection(
     boost::asio::io_context &io_context, connection_manager &manager,
     boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver,
-    const std::string &ca_private_key, const std::string &ca_certificate,
-    std::unordered_map<std::string, boost::tuple<std::string, std::string>>
-        &domain_certificates,
+    dns::dns_cache &dns_cache, upstream_pool &upstream_pool,
+    buffer_pool &buffer_pool, cert::certificate_cache &certificate_cache,
     boost::asio::ssl::context &upstream_ssl_context,
+    tls::client_sessions &upstream_sessions,
     const callbacks::connection_id connection_id,
     cert::certificate_generator &certificate_generator,
-    cert::rsa_maker::reschedule rsa_maker_reschedule,
-    boost::function<void()> rsa_maker_bump,
-    callbacks::proxy_callbacks &callbacks)
-    : downstream_socket_(io_context),
-      downstream_ssl_context_(boost::asio::ssl::context::tlsv12),
+    boost::function<bool()> should_hand_over,
+    boost::function<bool(boost::shared_ptr<connection>)> hand_over,
+    callbacks::proxy_callbacks &callbacks, bool splice_tunnels)
+    : io_context_(io_context), downstream_socket_(io_context),
       upstream_socket_(io_context), upstream_ssl_context_(upstream_ssl_context),
-      connection_manager_(manager), resolver_(resolver),
-      ca_private_key_(ca_private_key), ca_certificate_(ca_certificate),
-      domain_certificates_(domain_certificates), connection_id_(connection_id),
+      upstream_sessions_(upstream_sessions), upstream_pool_(upstream_pool),
+      connection_manager_(manager), buffer_pool_(buffer_pool),
+      idle_timer_(io_context), resolver_(resolver), dns_cache_(dns_cache),
+      certificate_cache_(certificate_cache),
+      connection_id_(connection_id),
       certificate_generator_(certificate_generator),
-      rsa_maker_reschedule_(rsa_maker_reschedule),
-      rsa_maker_bump_(rsa_maker_bump), callbacks_(callbacks) {}
+      should_hand_over_(should_hand_over),
+      hand_over_(hand_over), splice_tunnels_(splice_tunnels),
+      callbacks_(callbacks) {}
 
 boost::asio::ip::tcp::socket &connection::downstream_socket() {
   return downstream_socket_;
 }
 
+callbacks::connection_id connection::id() const { return connection_id_; }
+
 void connection::start() {
   DVLOG(1) << "start(" << connection_id_ << ")\n";
 
@@ -78,16 +83,317 @@ void connection::stop() {
   }
 }
 
+void move_socket(boost::asio::ip::tcp::socket &from,
+                 boost::asio::ip::tcp::socket &to) {
+  boost::system::error_code ec;
+  boost::asio::ip::tcp::endpoint endpoint = from.local_endpoint(ec);
+  if (!ec) {
+    to.assign(endpoint.protocol(), from.release());
+  }
+}
+
+void connection::hand_over(connection &target) {
+  DVLOG(1) << "hand_over(" << connection_id_ << ", " << request_id_ << ")";
+
+  stopped_ = true;
+  boost::system::error_code ignored_ec;
+  idle_timer_.cancel(ignored_ec);
+  move_socket(downstream_socket_, target.downstream_socket_);
+  move_socket(upstream_socket_, target.upstream_socket_);
+  target.request_id_ = request_id_;
+  target.request_state_ = request_state_;
+  target.response_state_ = response_state_;
+  target.upstream_requested_host_ = upstream_requested_host_;
+  target.upstream_requested_service_ = upstream_requested_service_;
+  target.upstream_connected_host_ = upstream_connected_host_;
+  target.upstream_connected_service_ = upstream_connected_service_;
+  target.upstream_idle_ = upstream_idle_;
+}
+
+void connection::resume() {
+  DVLOG(1) << "resume(" << connection_id_ << ", " << request_id_ << ")";
+
+  read_from_downstream();
+  if (request_state_ == request_state::tunnel) {
+    read_from_upstream();
+  }
+}
+
+bool connection::tunnel_should_park() {
+  // Checking the load is cheap but not free, do it every few reads only.
+  if (!handing_over_ && bump_state_ == bump_state::no_bump &&
+      ++tunnel_reads_ % 16 == 0 && should_hand_over_()) {
+    handing_over_ = true;
+  }
+  return handing_over_;
+}
+
+void connection::park_tunnel_loop(bool downstream_loop) {
+  if (stopped_) {
+    return;
+  }
+  if (++tunnel_loops_parked_ == 1) {
+    // The other loop may wait for data for a long time, wake it up. Its write
+    // is finished (this loop writes to the socket we cancel), so only the read
+    // is aborted.
+    boost::system::error_code ignored_ec;
+    if (downstream_loop && upstream_reading_) {
+      upstream_socket_.cancel(ignored_ec);
+    } else if (!downstream_loop && downstream_reading_) {
+      downstream_socket_.cancel(ignored_ec);
+    }
+    return;
+  }
+  tunnel_loops_parked_ = 0;
+  handing_over_ = false;
+  if (!hand_over_(shared_from_this())) {
+    read_from_downstream();
+    read_from_upstream();
+  }
+}
+
+/// How long a keep-alive connection waits for the next request before it frees
+/// its buffers, parser state and handler memory.
+const std::chrono::steady_clock::duration IDLE_RELEASE_DELAY =
+    std::chrono::seconds(1);
+
+/// Bytes buffered by each direction of tunnels which are not spliced.
+const std::size_t TUNNEL_HIGH_WATERMARK = 64 * 1024;
+const std::size_t TUNNEL_LOW_WATERMARK = 16 * 1024;
+
+void connection::prepare_read_buffer(std::string &buffer, std::size_t size) {
+  if (buffer.size() != size) {
+    buffer_pool_.release(buffer);
+    buffer = buffer_pool_.acquire(size);
+  }
+}
+
+void connection::release_read_buffer(std::string &buffer,
+                                     std::string::iterator &begin,
+                                     std::string::iterator &end,
+                                     bool reading) {
+  if (!reading && begin == end && !buffer.empty()) {
+    buffer_pool_.release(buffer);
+    begin = end = std::string::iterator();
+  }
+}
+
+bool connection::splice_tunnel() {
+  if (!splice_tunnels_ || bump_state_ != bump_state::no_bump) {
+    return false;
+  }
+  if (!downstream_splicer_) {
+    downstream_splicer_.reset(
+        new tunnel_splicer(downstream_socket_, upstream_socket_));
+    upstream_splicer_.reset(
+        new tunnel_splicer(upstream_socket_, downstream_socket_));
+    boost::system::error_code ec;
+    if (!downstream_splicer_->open(ec) || !upstream_splicer_->open(ec)) {
+      DVLOG(1) << "splice_tunnel(" << connection_id_ << ", " << request_id_
+               << ", " << ec << ")";
+      splice_tunnels_ = false;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool connection::begin_downstream_relay_read() {
+  if (downstream_reading_) {
+    return false;
+  }
+  if (tunnel_should_park()) {
+    // A loop with a write in progress parks when it finishes.
+    if (!upstream_writing_) {
+      park_tunnel_loop(true);
+    }
+    return false;
+  }
+  downstream_reading_ = true;
+  if (splice_tunnel()) {
+    // Reads and writes, the loop goes on in handle_downstream_splice.
+    downstream_splicer_->async_transfer(
+        boost::bind(&connection::handle_downstream_splice, shared_from_this(),
+                    boost::asio::placeholders::error));
+    return false;
+  }
+  if (!downstream_tunnel_buffers_) {
+    downstream_tunnel_buffers_.reset(new tunnel_buffers(
+        buffer_pool_, TUNNEL_HIGH_WATERMARK, TUNNEL_LOW_WATERMARK));
+  }
+  if (!downstream_tunnel_buffers_->can_read()) {
+    // Resumed by handle_upstream_relay_write.
+    downstream_reading_ = false;
+    return false;
+  }
+  return true;
+}
+
+bool connection::begin_upstream_relay_read() {
+  if (upstream_reading_) {
+    return false;
+  }
+  if (tunnel_should_park()) {
+    if (!downstream_writing_) {
+      park_tunnel_loop(false);
+    }
+    return false;
+  }
+  upstream_reading_ = true;
+  if (splice_tunnel()) {
+    upstream_splicer_->async_transfer(
+        boost::bind(&connection::handle_upstream_splice, shared_from_this(),
+                    boost::asio::placeholders::error));
+    return false;
+  }
+  if (!upstream_tunnel_buffers_) {
+    upstream_tunnel_buffers_.reset(new tunnel_buffers(
+        buffer_pool_, TUNNEL_HIGH_WATERMARK, TUNNEL_LOW_WATERMARK));
+  }
+  if (!upstream_tunnel_buffers_->can_read()) {
+    // Resumed by handle_downstream_relay_write.
+    upstream_reading_ = false;
+    return false;
+  }
+  return true;
+}
+
+void connection::relay_downstream() {
+  if (!begin_downstream_relay_read()) {
+    return;
+  }
+#if defined(PROXY_COROUTINE_TUNNELS)
+  boost::asio::co_spawn(downstream_socket_.get_executor(),
+                        relay_reads(shared_from_this(), true),
+                        boost::asio::detached);
+#else
+  downstream_read_some(
+      downstream_tunnel_buffers_->prepare(),
+      boost::bind(&connection::handle_downstream_read, shared_from_this(),
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred));
+#endif
+}
+
+void connection::relay_upstream() {
+  if (!begin_upstream_relay_read()) {
+    return;
+  }
+#if defined(PROXY_COROUTINE_TUNNELS)
+  boost::asio::co_spawn(upstream_socket_.get_executor(),
+                        relay_reads(shared_from_this(), false),
+                        boost::asio::detached);
+#else
+  upstream_read_some(
+      upstream_tunnel_buffers_->prepare(),
+      boost::bind(&connection::handle_upstream_read, shared_from_this(),
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred));
+#endif
+}
+
+void connection::relay_to_upstream() {
+  if (upstream_writing_ || !downstream_tunnel_buffers_->can_write()) {
+    return;
+  }
+  upstream_writing_ = true;
+#if defined(PROXY_COROUTINE_TUNNELS)
+  boost::asio::co_spawn(upstream_socket_.get_executor(),
+                        relay_writes(shared_from_this(), true),
+                        boost::asio::detached);
+#else
+  upstream_write(downstream_tunnel_buffers_->start_write(),
+                 boost::bind(&connection::handle_upstream_relay_write,
+                             shared_from_this(),
+                             boost::asio::placeholders::error));
+#endif
+}
+
+void connection::relay_to_downstream() {
+  if (downstream_writing_ || !upstream_tunnel_buffers_->can_write()) {
+    return;
+  }
+  downstream_writing_ = true;
+#if defined(PROXY_COROUTINE_TUNNELS)
+  boost::asio::co_spawn(downstream_socket_.get_executor(),
+                        relay_writes(shared_from_this(), false),
+                        boost::asio::detached);
+#else
+  outgoing_downstream_buffers_ = upstream_tunnel_buffers_->start_write();
+  downstream_write(boost::bind(&connection::handle_downstream_relay_write,
+                               shared_from_this(),
+                               boost::asio::placeholders::error));
+#endif
+}
+
+void connection::handle_upstream_relay_write(
+    const boost::system::error_code &e) {
+  upstream_writing_ = false;
+  if (!e) {
+    downstream_tunnel_buffers_->finish_write();
+    relay_to_upstream();
+    if (downstream_read_finished_ && !upstream_writing_) {
+      connection_manager_stop();
+      return;
+    }
+    read_from_downstream();
+  } else if (e != boost::asio::error::operation_aborted) {
+    connection_manager_stop();
+  }
+}
+
+void connection::handle_downstream_relay_write(
+    const boost::system::error_code &e) {
+  downstream_writing_ = false;
+  if (!e) {
+    upstream_tunnel_buffers_->finish_write();
+    relay_to_downstream();
+    if (upstream_read_finished_ && !downstream_writing_) {
+      connection_manager_stop();
+      return;
+    }
+    read_from_upstream();
+  } else if (e != boost::asio::error::operation_aborted) {
+    connection_manager_stop();
+  }
+}
+
+void connection::handle_downstream_splice(const boost::system::error_code &e) {
+  downstream_reading_ = false;
+  if (e == boost::asio::error::operation_aborted && handing_over_) {
+    park_tunnel_loop(true);
+  } else if (!e) {
+    read_from_downstream();
+  } else if (e != boost::asio::error::operation_aborted) {
+    connection_manager_stop();
+  }
+}
+
+void connection::handle_upstream_splice(const boost::system::error_code &e) {
+  upstream_reading_ = false;
+  if (e == boost::asio::error::operation_aborted && handing_over_) {
+    park_tunnel_loop(false);
+  } else if (!e) {
+    read_from_upstream();
+  } else if (e != boost::asio::error::operation_aborted) {
+    connection_manager_stop();
+  }
+}
+
 void connection::shutdown() {
   boost::system::error_code ignored_ec;
   // TODO async_shutdown?
   // TODO SSL socket
+  tls::keep_session_resumable(downstream_ssl_socket_);
   downstream_socket_.shutdown(boost::asio::socket_base::shutdown_both,
                               ignored_ec);
   downstream_socket_.close();
-  upstream_socket_.shutdown(boost::asio::socket_base::shutdown_both,
-                            ignored_ec);
-  upstream_socket_.close();
+  idle_timer_.cancel(ignored_ec);
+  release_upstream();
+  release_read_buffer(downstream_read_buffer_, downstream_read_buffer_begin_,
+                      downstream_read_buffer_end_, downstream_reading_);
+  release_read_buffer(upstream_read_buffer_, upstream_read_buffer_begin_,
+                      upstream_read_buffer_end_, upstream_reading_);
   callbacks_.on_connection_finished(connection_id_);
 }
 
@@ -106,14 +412,16 @@ connection::extract_host_and_fix_request() {
   request_pre_body_.uri = path;
 
   http::header_container::name_iterator proxy_connection_it =
-      request_pre_body_.headers.find("proxy-connection");
+      request_pre_body_.headers.find(
+          http::well_known_header::proxy_connection);
   if (proxy_connection_it != request_pre_body_.headers.end()) {
-    if (request_pre_body_.headers.find("connection") ==
+    if (request_pre_body_.headers.find(http::well_known_header::connection) ==
         request_pre_body_.headers.end()) {
-      request_pre_body_.headers.push_back(
-          {"Connection", proxy_connection_it->value});
+      request_pre_body_.headers.push_back("Connection",
+                                          proxy_connection_it->value);
     }
-    request_pre_body_.headers.erase_all("proxy-connection");
+    request_pre_body_.headers.erase_all(
+        http::well_known_header::proxy_connection);
   }
 
   return boost::make_tuple(true, upstream_host, upstream_port);
@@ -126,22 +434,97 @@ void connection::connect_to_upstream(std::string &upstream_host,
 
   if (!upstream_connected_host_.empty() ||
       !upstream_connected_service_.empty()) {
-    if (upstream_connected_host_ != upstream_host ||
-        upstream_connected_service_ != upstream_service) {
-      connection_manager_stop();
-    } else {
+    if (upstream_connected_host_ == upstream_host &&
+        upstream_connected_service_ == upstream_service) {
       write_to_upstream();
+      return;
     }
-    return;
+    // The connection to the previous host may serve another downstream
+    // connection.
+    release_upstream();
   }
   upstream_connected_host_ = upstream_host;
   upstream_connected_service_ = upstream_service;
-  boost::asio::ip::tcp::resolver::query query(upstream_connected_host_,
-                                              upstream_connected_service_);
-  resolver_->async_resolve(
-      query, boost::bind(&connection::handle_upstream_resolve,
-                         shared_from_this(), boost::asio::placeholders::error,
-                         boost::asio::placeholders::iterator));
+  // Tunnels need a connection of their own.
+  if (request_state_ != request_state::tunnel &&
+      (bump_state_ == bump_state::established
+           ? upstream_pool_.acquire(upstream_host, upstream_service,
+                                    upstream_ssl_socket_)
+           : upstream_pool_.acquire(upstream_host, upstream_service,
+                                    upstream_socket_))) {
+    upstream_idle_ = true;
+    write_to_upstream();
+    return;
+  }
+  resolve_upstream();
+}
+
+void connection::resolve_upstream() {
+  dns_cache_.async_resolve(
+      *resolver_, upstream_connected_host_, upstream_connected_service_,
+      boost::bind(&connection::handle_upstream_resolve, shared_from_this(),
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::iterator));
+}
+
+void connection::release_upstream() {
+  if (!upstream_idle_) {
+    close_upstream();
+    return;
+  }
+  if (upstream_ssl_socket_) {
+    upstream_pool_.release(upstream_connected_host_,
+                           upstream_connected_service_, upstream_ssl_socket_);
+    upstream_ssl_socket_.reset();
+  } else {
+    upstream_pool_.release(upstream_connected_host_,
+                           upstream_connected_service_, upstream_socket_);
+  }
+  upstream_connected_host_.clear();
+  upstream_connected_service_.clear();
+  upstream_idle_ = false;
+}
+
+void connection::close_upstream() {
+  if (upstream_connector_) {
+    upstream_connector_->cancel();
+    upstream_connector_.reset();
+  }
+  boost::system::error_code ignored_ec;
+  // The SSL stream is kept, operations in progress still refer to it.
+  if (upstream_ssl_socket_) {
+    tls::keep_session_resumable(upstream_ssl_socket_);
+    upstream_ssl_socket_->next_layer().shutdown(
+        boost::asio::socket_base::shutdown_both, ignored_ec);
+    upstream_ssl_socket_->next_layer().close(ignored_ec);
+  }
+  upstream_socket_.shutdown(boost::asio::socket_base::shutdown_both,
+                            ignored_ec);
+  upstream_socket_.close(ignored_ec);
+  upstream_connected_host_.clear();
+  upstream_connected_service_.clear();
+  upstream_idle_ = false;
+}
+
+bool connection::retry_upstream_request() {
+  if (upstream_retry_request_.empty() || stopped_) {
+    return false;
+  }
+  DVLOG(1) << "retry_upstream_request(" << connection_id_ << ", "
+           << request_id_ << ")";
+
+  close_upstream();
+  // One-shot: a second failure on the fresh connection stops the connection.
+  outgoing_upstream_buffers_strings_.emplace_back(
+      std::make_unique<std::string>(std::move(upstream_retry_request_)));
+  upstream_retry_request_.clear();
+  outgoing_upstream_buffers_.clear();
+  outgoing_upstream_buffers_.emplace_back(
+      boost::asio::buffer(*outgoing_upstream_buffers_strings_.back()));
+  upstream_connected_host_ = upstream_requested_host_;
+  upstream_connected_service_ = upstream_requested_service_;
+  resolve_upstream();
+  return true;
 }
 
 void connection::handle_upstream_resolve(
@@ -156,12 +539,22 @@ void connection::handle_upstream_resolve(
 
 void connection::upstream_connect(
     boost::asio::ip::tcp::resolver::iterator endpoint_iterator) {
-  upstream_socket_.open(boost::asio::ip::tcp::v4());
-  upstream_socket_.set_option(boost::asio::ip::tcp::no_delay(true));
-  upstream_socket_.async_connect(
-      *endpoint_iterator,
+  std::vector<boost::asio::ip::tcp::endpoint> endpoints(
+      endpoint_iterator, boost::asio::ip::tcp::resolver::iterator());
+  upstream_connector_.reset(new upstream_connector(
+      io_context_, endpoints,
       boost::bind(&connection::handle_upstream_connect, shared_from_this(),
-                  boost::asio::placeholders::error, ++endpoint_iterator));
+                  boost::asio::placeholders::error, boost::placeholders::_2)));
+  upstream_connector_->start();
+}
+
+bool is_idempotent(http::request_method method) {
+  return method == http::request_method::get ||
+         method == http::request_method::head ||
+         method == http::request_method::options ||
+         method == http::request_method::trace ||
+         method == http::request_method::put ||
+         method == http::request_method::delete_;
 }
 
 void connection::write_to_upstream() {
@@ -176,17 +569,22 @@ void connection::write_to_upstream() {
       << util::utils::vector_of_buffers_to_string(outgoing_upstream_buffers_)
       << logging::FORMAT_RESET;
 
-  if (bump_state_ == bump_state::established) {
-    boost::asio::async_write(*upstream_ssl_socket_, outgoing_upstream_buffers_,
-                             boost::bind(&connection::handle_upstream_write,
-                                         shared_from_this(),
-                                         boost::asio::placeholders::error));
-  } else {
-    boost::asio::async_write(upstream_socket_, outgoing_upstream_buffers_,
-                             boost::bind(&connection::handle_upstream_write,
-                                         shared_from_this(),
-                                         boost::asio::placeholders::error));
+  if (upstream_idle_) {
+    upstream_idle_ = false;
+    // The origin may have closed the reused connection meanwhile. Requests
+    // written at once can be resent if they are idempotent (RFC 7230 section
+    // 6.3.1).
+    if (request_state_ == request_state::finished &&
+        is_idempotent(request_pre_body_.method_type)) {
+      upstream_retry_request_ =
+          util::utils::vector_of_buffers_to_string(outgoing_upstream_buffers_);
+    }
   }
+
+  upstream_write(outgoing_upstream_buffers_,
+                 boost::bind(&connection::handle_upstream_write,
+                             shared_from_this(),
+                             boost::asio::placeholders::error));
   outgoing_upstream_buffers_.clear();
 }
 
@@ -204,11 +602,13 @@ void connection::downstream_write(BOOST_ASIO_MOVE_ARG(WriteHandler) handler) {
       << logging::FORMAT_RESET;
 
   if (bump_state_ == bump_state::established) {
-    boost::asio::async_write(*downstream_ssl_socket_,
-                             outgoing_downstream_buffers_, handler);
+    boost::asio::async_write(
+        *downstream_ssl_socket_, outgoing_downstream_buffers_,
+        make_custom_alloc_handler(downstream_write_memory_, handler));
   } else {
-    boost::asio::async_write(downstream_socket_, outgoing_downstream_buffers_,
-                             handler);
+    boost::asio::async_write(
+        downstream_socket_, outgoing_downstream_buffers_,
+        make_custom_alloc_handler(downstream_write_memory_, handler));
   }
   outgoing_downstream_buffers_.clear();
 }
@@ -218,18 +618,51 @@ void connection::downstream_read_some(const MutableBufferSequence &buffer,
                                       BOOST_ASIO_MOVE_ARG(ReadHandler)
                                           handler) {
   if (bump_state_ == bump_state::established) {
-    downstream_ssl_socket_->async_read_some(buffer, handler);
+    downstream_ssl_socket_->async_read_some(
+        buffer, make_custom_alloc_handler(downstream_read_memory_, handler));
+  } else {
+    downstream_socket_.async_read_some(
+        buffer, make_custom_alloc_handler(downstream_read_memory_, handler));
+  }
+}
+
+template <typename ConstBufferSequence, typename WriteHandler>
+void connection::upstream_write(const ConstBufferSequence &buffers,
+                                BOOST_ASIO_MOVE_ARG(WriteHandler) handler) {
+  if (bump_state_ == bump_state::established) {
+    boost::asio::async_write(
+        *upstream_ssl_socket_, buffers,
+        make_custom_alloc_handler(upstream_write_memory_, handler));
+  } else {
+    boost::asio::async_write(
+        upstream_socket_, buffers,
+        make_custom_alloc_handler(upstream_write_memory_, handler));
+  }
+}
+
+template <typename MutableBufferSequence, typename ReadHandler>
+void connection::upstream_read_some(const MutableBufferSequence &buffer,
+                                    BOOST_ASIO_MOVE_ARG(ReadHandler) handler) {
+  if (bump_state_ == bump_state::established) {
+    upstream_ssl_socket_->async_read_some(
+        buffer, make_custom_alloc_handler(upstream_read_memory_, handler));
   } else {
-    downstream_socket_.async_read_some(buffer, handler);
+    upstream_socket_.async_read_some(
+        buffer, make_custom_alloc_handler(upstream_read_memory_, handler));
   }
 }
 
 void connection::handle_upstream_connect(
-    const boost::system::error_code &e,
-    boost::asio::ip::tcp::resolver::iterator endpoint_iterator) {
+    const boost::system::error_code &e, boost::asio::ip::tcp::socket &socket) {
   DVLOG(2) << "handle_upstream_connect(" << connection_id_ << ", "
            << request_id_ << ", " << e << ")";
+  upstream_connector_.reset();
   if (!e) {
+    upstream_socket_ = std::move(socket);
+    if (stopped_) {
+      close_upstream();
+      return;
+    }
     if (request_state_ == request_state::tunnel) {
       // The connection was successful. Start tunnel.
       connect_connection_established_outgoing_line_ =
@@ -243,8 +676,10 @@ void connection::handle_upstream_connect(
       read_from_downstream();
     } else if (bump_state_ == bump_state::established) {
       upstream_ssl_socket_.reset(
-          new boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>(
-              upstream_socket_, upstream_ssl_context_));
+          new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(
+              std::move(upstream_socket_), upstream_ssl_context_));
+      SSL_set_mode(upstream_ssl_socket_->native_handle(),
+                   SSL_MODE_RELEASE_BUFFERS);
       upstream_ssl_socket_->set_verify_mode(
           boost::asio::ssl::verify_peer |
           boost::asio::ssl::verify_fail_if_no_peer_cert);
@@ -252,6 +687,9 @@ void connection::handle_upstream_connect(
           boost::asio::ssl::host_name_verification(upstream_connected_host_));
       SSL_set_tlsext_host_name(upstream_ssl_socket_->native_handle(),
                                upstream_connected_host_.c_str());
+      upstream_sessions_.attach(upstream_ssl_socket_->native_handle(),
+                                upstream_connected_host_,
+                                upstream_connected_service_);
 
       upstream_ssl_socket_->async_handshake(
           boost::asio::ssl::stream_base::client,
@@ -262,9 +700,6 @@ void connection::handle_upstream_connect(
       // The connection was successful. Send the request.
       write_to_upstream();
     }
-  } else if (endpoint_iterator != boost::asio::ip::tcp::resolver::iterator()) {
-    upstream_socket_.close();
-    upstream_connect(endpoint_iterator);
   } else if (e != boost::asio::error::operation_aborted) {
     connection_manager_stop();
   }
@@ -278,14 +713,45 @@ void connection::handle_upstream_handshake(const boost::system::error_code &e) {
   }
 }
 
+connection::rare_messages &connection::get_rare_messages() {
+  if (!rare_messages_) {
+    rare_messages_ = std::make_unique<rare_messages>();
+  }
+  return *rare_messages_;
+}
+
+/// Trailer of the messages which are not chunked, shared by the connections of
+/// the thread. Callbacks must not change it (see callbacks.hpp), it is cleared
+/// before each use so that one which does cannot leak into other messages.
+thread_local http::trailer no_chunked_trailer;
+
+http::trailer &empty_no_chunked_trailer() {
+  no_chunked_trailer.clear();
+  return no_chunked_trailer;
+}
+
+http::trailer &connection::request_chunked_trailer() {
+  return rare_messages_ ? rare_messages_->request_chunked_trailer
+                        : empty_no_chunked_trailer();
+}
+
+http::trailer &connection::response_chunked_trailer() {
+  return rare_messages_ ? rare_messages_->response_chunked_trailer
+                        : empty_no_chunked_trailer();
+}
+
 void connection::reset() {
   upgrade_connection_to_tunnel_ = false;
 
-  request_pre_body_ = {};
-  response_pre_body_ = {};
-  response_pre_body_100_continue_ = {};
-  request_chunked_trailer_ = {};
-  response_chunked_trailer_ = {};
+  // The memory of the messages is kept for the next request, it is freed by
+  // release_idle_memory.
+  request_pre_body_.clear();
+  response_pre_body_.clear();
+  if (rare_messages_) {
+    rare_messages_->response_pre_body_100_continue.clear();
+    rare_messages_->request_chunked_trailer.clear();
+    rare_messages_->response_chunked_trailer.clear();
+  }
 
   expect_100_continue_from_upstream_ = false;
   expect_body_continue_from_downstream_ = true;
@@ -299,6 +765,7 @@ void connection::reset() {
 
   request_state_ = request_state::pre_body;
   wrote_something_to_upstream_ = false;
+  upstream_retry_request_.clear();
 
   response_body_forbidden_ = false;
 
@@ -322,7 +789,8 @@ void connection::handle_upstream_write(const boost::system::error_code &e) {
     } else {
       read_from_downstream();
     }
-  } else if (e != boost::asio::error::operation_aborted) {
+  } else if (e != boost::asio::error::operation_aborted &&
+             !retry_upstream_request()) {
     connection_manager_stop();
   }
 }
@@ -347,49 +815,167 @@ void connection::finish_request_callback(bool disconnect) {
     connection_manager_stop();
   } else {
     reset();
+    if (!upgrade_connection_to_tunnel && !upstream_connected_host_.empty() &&
+        upstream_read_buffer_begin_ == upstream_read_buffer_end_) {
+      upstream_idle_ = true;
+    }
+    // Between requests is a safe point to move a plain connection to a less
+    // loaded thread.
+    if (!upgrade_connection_to_tunnel &&
+        bump_state_ == bump_state::no_bump &&
+        downstream_read_buffer_begin_ == downstream_read_buffer_end_ &&
+        upstream_read_buffer_begin_ == upstream_read_buffer_end_ &&
+        should_hand_over_() && hand_over_(shared_from_this())) {
+      return;
+    }
     if (upgrade_connection_to_tunnel) {
       request_state_ = request_state::tunnel;
       response_state_ = response_state::tunnel;
       read_from_downstream();
       read_from_upstream();
     } else {
-      read_from_downstream();
+      wait_for_next_request();
     }
   }
 }
 
+void connection::wait_for_next_request() {
+  // Pipelined requests are processed right away.
+  if (downstream_read_buffer_begin_ != downstream_read_buffer_end_) {
+    read_from_downstream();
+    return;
+  }
+  DVLOG(2) << "wait_for_next_request(" << connection_id_ << ", "
+           << request_id_ << ")";
+
+  idle_ = true;
+  idle_since_ = std::chrono::steady_clock::now();
+  if (!idle_timer_running_) {
+    idle_timer_running_ = true;
+    idle_timer_.expires_after(IDLE_RELEASE_DELAY);
+    idle_timer_.async_wait(make_custom_alloc_handler(
+        idle_timer_memory_,
+        boost::bind(&connection::handle_idle_timer, shared_from_this(),
+                    boost::asio::placeholders::error)));
+  }
+
+  downstream_reading_ = true;
+  if (bump_state_ == bump_state::established) {
+    // The SSL stream may have read the next records from the socket already,
+    // along with the last ones of this request, so waiting for the socket
+    // could wait forever. Reading one byte takes the buffered records first
+    // and leaves the rest of the record decrypted in the SSL object.
+    downstream_read_some(
+        boost::asio::buffer(&downstream_idle_byte_, 1),
+        boost::bind(&connection::handle_wait_for_next_request,
+                    shared_from_this(), boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
+    return;
+  }
+  // Zero-byte read, the read buffer is used once the request arrives.
+  downstream_socket_.async_wait(
+      boost::asio::ip::tcp::socket::wait_read,
+      make_custom_alloc_handler(
+          downstream_read_memory_,
+          boost::bind(&connection::handle_wait_for_next_request,
+                      shared_from_this(), boost::asio::placeholders::error,
+                      0)));
+}
+
+void connection::handle_wait_for_next_request(
+    const boost::system::error_code &e, std::size_t bytes_transferred) {
+  downstream_reading_ = false;
+  idle_ = false;
+  if (e) {
+    if (e != boost::asio::error::operation_aborted) {
+      connection_manager_stop();
+    }
+    return;
+  }
+  if (bytes_transferred == 0) {
+    read_from_downstream();
+    return;
+  }
+  prepare_read_buffer(downstream_read_buffer_, downstream_read_size_);
+  downstream_read_buffer_[0] = downstream_idle_byte_;
+  // The rest of the record is decrypted already, SSL_read returns it without
+  // reading from the socket.
+  SSL *ssl = downstream_ssl_socket_->native_handle();
+  int pending = std::min<std::size_t>(SSL_pending(ssl),
+                                      downstream_read_buffer_.size() - 1);
+  int read = pending > 0 ? SSL_read(ssl, &downstream_read_buffer_[1], pending)
+                         : 0;
+  downstream_read_buffer_begin_ = downstream_read_buffer_.begin();
+  downstream_read_buffer_end_ =
+      downstream_read_buffer_begin_ + 1 + std::max(read, 0);
+  process_downstream_read_step_1_pre_body();
+}
+
+void connection::handle_idle_timer(const boost::system::error_code &e) {
+  idle_timer_running_ = false;
+  if (e || stopped_ || !idle_) {
+    return;
+  }
+  std::chrono::steady_clock::duration idle_for =
+      std::chrono::steady_clock::now() - idle_since_;
+  if (idle_for < IDLE_RELEASE_DELAY) {
+    // Served requests since the timer was armed, wait for the rest.
+    idle_timer_running_ = true;
+    idle_timer_.expires_after(IDLE_RELEASE_DELAY - idle_for);
+    idle_timer_.async_wait(make_custom_alloc_handler(
+        idle_timer_memory_,
+        boost::bind(&connection::handle_idle_timer, shared_from_this(),
+                    boost::asio::placeholders::error)));
+    return;
+  }
+  release_idle_memory();
+}
+
+void connection::release_idle_memory() {
+  DVLOG(2) << "release_idle_memory(" << connection_id_ << ", " << request_id_
+           << ")";
+
+  // The wait reads nothing into the downstream read buffer.
+  request_pre_body_.release();
+  response_pre_body_.release();
+  release_read_buffer(downstream_read_buffer_, downstream_read_buffer_begin_,
+                      downstream_read_buffer_end_, false);
+  release_read_buffer(upstream_read_buffer_, upstream_read_buffer_begin_,
+                      upstream_read_buffer_end_, upstream_reading_);
+  request_pre_body_parser_ = {};
+  request_body_without_length_parser_ = {};
+  response_pre_body_parser_ = {};
+  response_body_without_length_parser_ = {};
+  std::vector<boost::asio::const_buffer>().swap(outgoing_upstream_buffers_);
+  std::vector<boost::asio::const_buffer>().swap(outgoing_downstream_buffers_);
+  std::vector<std::unique_ptr<std::string>>().swap(
+      outgoing_upstream_buffers_strings_);
+  std::vector<std::unique_ptr<std::string>>().swap(
+      outgoing_downstream_buffers_strings_);
+  std::string().swap(upstream_retry_request_);
+  rare_messages_.reset();
+  // The block of the wait is kept, it is in use.
+  downstream_read_memory_.release();
+  downstream_write_memory_.release();
+  upstream_read_memory_.release();
+  upstream_write_memory_.release();
+}
+
 void connection::handle_downstream_write(const boost::system::error_code &e) {
   if (!e) {
     outgoing_downstream_buffers_strings_.clear();
     if (bump_state_ == bump_state::handshake) {
-      boost::tie(private_key_, certificate_) =
-          domain_certificates_[upstream_requested_host_];
-      if (private_key_ == "" || certificate_ == "") {
-        boost::tie(private_key_, certificate_) =
-            certificate_generator_.generate_certificate(
-                upstream_requested_host_, ca_private_key_, ca_certificate_,
-                std::forward<cert::rsa_maker::reschedule>(
-                    rsa_maker_reschedule_));
-        // Create chain
-        certificate_ += ca_certificate_;
-        domain_certificates_[upstream_requested_host_] =
-            boost::make_tuple(private_key_, certificate_);
+      certificate_ = certificate_cache_.find(upstream_requested_host_);
+      if (!certificate_) {
+        // Minted on the certificate generator's threads, concurrent requests
+        // for the same host share one mint.
+        certificate_generator_.async_generate_certificate(
+            io_context_, upstream_requested_host_,
+            boost::bind(&connection::handle_generate_certificate,
+                        shared_from_this(), boost::placeholders::_1));
+      } else {
+        downstream_handshake();
       }
-
-      // TODO: context max length
-      std::string session_id_context =
-          upstream_requested_service_ + ':' + upstream_requested_host_;
-      downstream_ssl_context_.use_certificate_chain(
-          boost::asio::buffer(certificate_));
-      downstream_ssl_context_.use_private_key(boost::asio::buffer(private_key_),
-                                              boost::asio::ssl::context::pem);
-      downstream_ssl_socket_.reset(
-          new boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>(
-              downstream_socket_, downstream_ssl_context_));
-      downstream_ssl_socket_->async_handshake(
-          boost::asio::ssl::stream_base::server,
-          boost::bind(&connection::handle_downstream_handshake,
-                      shared_from_this(), boost::asio::placeholders::error));
     } else if (request_state_ == request_state::finished &&
                (!wrote_something_to_upstream_ ||
                 response_state_ == response_state::finished)) {
@@ -409,10 +995,38 @@ void connection::handle_downstream_write(const boost::system::error_code &e) {
   }
 }
 
+void connection::handle_generate_certificate(
+    cert::certificate_ptr certificate) {
+  if (stopped_) {
+    return;
+  }
+  if (!certificate) {
+    connection_manager_stop();
+    return;
+  }
+  // Already cached by the certificate generator.
+  certificate_ = certificate;
+  downstream_handshake();
+}
+
+void connection::downstream_handshake() {
+  downstream_ssl_socket_.reset(
+      new boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>(
+          downstream_socket_, *certificate_->ssl_context));
+  // OpenSSL frees its own record buffers while the connection is idle, those of
+  // the asio stream and its BIO pair stay allocated (see release_idle_memory).
+  SSL_set_mode(downstream_ssl_socket_->native_handle(),
+               SSL_MODE_RELEASE_BUFFERS);
+  downstream_ssl_socket_->async_handshake(
+      boost::asio::ssl::stream_base::server,
+      boost::bind(&connection::handle_downstream_handshake, shared_from_this(),
+                  boost::asio::placeholders::error));
+}
+
 void connection::handle_downstream_handshake(
     const boost::system::error_code &e) {
   bump_state_ = bump_state::established;
-  request_pre_body_ = {};
+  request_pre_body_.clear();
   request_pre_body_parser_.reset();
   read_from_downstream();
 }
@@ -425,6 +1039,21 @@ void connection::read_from_downstream() {
       << logging::FORMAT_FG_CYAN << "read_from_downstream(" << connection_id_
       << ", " << request_id_ << ")" << logging::FORMAT_RESET;
   if (downstream_read_buffer_begin_ == downstream_read_buffer_end_) {
+    // The pre bodies reference the read buffers, which are written by the next
+    // read or released.
+    request_pre_body_.raw = {};
+    response_pre_body_.raw = {};
+    release_read_buffer(upstream_read_buffer_, upstream_read_buffer_begin_,
+                        upstream_read_buffer_end_, upstream_reading_);
+    if (request_state_ == request_state::tunnel) {
+      release_read_buffer(downstream_read_buffer_,
+                          downstream_read_buffer_begin_,
+                          downstream_read_buffer_end_, downstream_reading_);
+      relay_downstream();
+      return;
+    }
+    downstream_reading_ = true;
+    prepare_read_buffer(downstream_read_buffer_, downstream_read_size_);
     downstream_read_some(
         boost::asio::buffer(downstream_read_buffer_),
         boost::bind(&connection::handle_downstream_read, shared_from_this(),
@@ -443,19 +1072,23 @@ void connection::read_from_upstream() {
       << logging::FORMAT_FG_BLUE << "read_from_upstream(" << connection_id_
       << ", " << request_id_ << ")" << logging::FORMAT_RESET;
   if (upstream_read_buffer_begin_ == upstream_read_buffer_end_) {
-    if (bump_state_ == bump_state::established) {
-      upstream_ssl_socket_->async_read_some(
-          boost::asio::buffer(upstream_read_buffer_),
-          boost::bind(&connection::handle_upstream_read, shared_from_this(),
-                      boost::asio::placeholders::error,
-                      boost::asio::placeholders::bytes_transferred));
-    } else {
-      upstream_socket_.async_read_some(
-          boost::asio::buffer(upstream_read_buffer_),
-          boost::bind(&connection::handle_upstream_read, shared_from_this(),
-                      boost::asio::placeholders::error,
-                      boost::asio::placeholders::bytes_transferred));
+    request_pre_body_.raw = {};
+    response_pre_body_.raw = {};
+    release_read_buffer(downstream_read_buffer_, downstream_read_buffer_begin_,
+                        downstream_read_buffer_end_, downstream_reading_);
+    if (response_state_ == response_state::tunnel) {
+      release_read_buffer(upstream_read_buffer_, upstream_read_buffer_begin_,
+                          upstream_read_buffer_end_, upstream_reading_);
+      relay_upstream();
+      return;
     }
+    upstream_reading_ = true;
+    prepare_read_buffer(upstream_read_buffer_, upstream_read_size_);
+    upstream_read_some(
+        boost::asio::buffer(upstream_read_buffer_),
+        boost::bind(&connection::handle_upstream_read, shared_from_this(),
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
   } else {
     process_upstream_read_step_1_pre_body();
   }
@@ -469,14 +1102,14 @@ bool connection::should_response_have_body() {
   // unless its field-value equals the decimal number of octets that would
   // have been sent in the payload body of a 200 (OK) response to the same
   // request."
-  if (request_pre_body_.method == "HEAD") {
+  if (request_pre_body_.method_type == http::request_method::head) {
     return false;
   }
-  if (response_pre_body_.code.length() > 1 &&
-      response_pre_body_.code[0] == '1') {
+  if (response_pre_body_.status_code / 100 == 1) {
     return false;
   }
-  if (response_pre_body_.code == "204" || response_pre_body_.code == "304") {
+  if (response_pre_body_.status_code == 204 ||
+      response_pre_body_.status_code == 304) {
     return false;
   }
   return true;
@@ -484,20 +1117,34 @@ bool connection::should_response_have_body() {
 
 void connection::handle_upstream_read(const boost::system::error_code &e,
                                       std::size_t bytes_transferred) {
-  if (!e) {
+  upstream_reading_ = false;
+  if (e == boost::asio::error::operation_aborted && handing_over_) {
+    if (!downstream_writing_) {
+      park_tunnel_loop(false);
+    }
+  } else if (!e) {
     if (response_state_ == response_state::tunnel) {
-      outgoing_downstream_buffers_.emplace_back(&*upstream_read_buffer_.begin(),
-                                                bytes_transferred);
-      downstream_write(boost::bind(&connection::handle_downstream_write,
-                                   shared_from_this(),
-                                   boost::asio::placeholders::error));
+      upstream_tunnel_buffers_->commit(bytes_transferred);
+      relay_to_downstream();
+      read_from_upstream();
     } else {
+      upstream_retry_request_.clear();
+      upstream_read_size_ = buffer_pool::next_read_size(
+          upstream_read_buffer_.size(), bytes_transferred);
       upstream_read_buffer_begin_ = upstream_read_buffer_.begin();
       upstream_read_buffer_end_ =
           upstream_read_buffer_.begin() + bytes_transferred;
       process_upstream_read_step_1_pre_body();
     }
   } else if (e != boost::asio::error::operation_aborted) {
+    if (response_state_ == response_state::tunnel && downstream_writing_) {
+      // Stop once the bytes read so far are written.
+      upstream_read_finished_ = true;
+      return;
+    }
+    if (retry_upstream_request()) {
+      return;
+    }
     if (response_state_ == response_state::pre_body ||
         response_state_ == response_state::body) {
       // We were reading response and finished early (possible infinite
@@ -512,7 +1159,7 @@ void connection::handle_upstream_read(const boost::system::error_code &e,
               .host = upstream_requested_host_,
               .request_pre_body = request_pre_body_,
               .response_pre_body = response_pre_body_,
-              .response_chunked_trailer = response_chunked_trailer_,
+              .response_chunked_trailer = response_chunked_trailer(),
               .response_body_forbidden = response_body_forbidden_,
               .response_has_more_body = false,
               .body_begin = upstream_read_buffer_begin_,
@@ -538,11 +1185,12 @@ void connection::connection_manager_stop() {
   connection_manager_.stop(shared_from_this());
 }
 
-bool connection::is_connection_close(std::string &http_version_string,
+bool connection::is_connection_close(int http_version_major,
+                                     int http_version_minor,
                                      http::header_container &headers) {
   http::header_container::name_iterator connection_it =
-      headers.find("connection");
-  return http_version_string != "HTTP/1.1" ||
+      headers.find(http::well_known_header::connection);
+  return http_version_major != 1 || http_version_minor != 1 ||
          (connection_it != headers.end() && connection_it->value == "close");
 }
 
@@ -562,22 +1210,30 @@ void connection::process_upstream_read_step_1_pre_body() {
                                         upstream_read_buffer_begin_,
                                         upstream_read_buffer_end_);
     if (result) {
-      if (response_pre_body_.code == "101") {
+      if (response_pre_body_.status_code == 101) {
         upgrade_connection_to_tunnel_ = true;
       }
-      if (response_pre_body_.code == "100") {
+      if (response_pre_body_.status_code == 100) {
         expect_100_continue_from_upstream_ = false;
-        response_pre_body_100_continue_.code = response_pre_body_.code;
-        response_pre_body_100_continue_.http_version_string =
+        http::response_pre_body &response_pre_body_100_continue =
+            get_rare_messages().response_pre_body_100_continue;
+        response_pre_body_100_continue.code = response_pre_body_.code;
+        response_pre_body_100_continue.status_code =
+            response_pre_body_.status_code;
+        response_pre_body_100_continue.http_version_string =
             response_pre_body_.http_version_string;
-        response_pre_body_100_continue_.reason = response_pre_body_.reason;
+        response_pre_body_100_continue.http_version_major =
+            response_pre_body_.http_version_major;
+        response_pre_body_100_continue.http_version_minor =
+            response_pre_body_.http_version_minor;
+        response_pre_body_100_continue.reason = response_pre_body_.reason;
         expect_body_continue_from_downstream_what_upstream_sent_ = true;
         for (http::header_container::iterator it =
                  response_pre_body_.headers.begin();
              it != response_pre_body_.headers.end(); it++) {
-          response_pre_body_100_continue_.headers.push_back(*it);
+          response_pre_body_100_continue.headers.push_back(*it);
         }
-        response_pre_body_ = {};
+        response_pre_body_.clear();
         response_pre_body_parser_.reset();
         wrote_something_to_upstream_ = false;
         callbacks::proxy_callbacks::on_response_pre_body_params
@@ -587,7 +1243,7 @@ void connection::process_upstream_read_step_1_pre_body() {
                 .ssl = bump_state_ == bump_state::established,
                 .host = upstream_requested_host_,
                 .request_pre_body = request_pre_body_,
-                .response_pre_body = response_pre_body_100_continue_,
+                .response_pre_body = response_pre_body_100_continue,
                 .expect_body_continue_from_downstream =
                     expect_body_continue_from_downstream_,
                 .response_body_forbidden = true,
@@ -609,7 +1265,8 @@ void connection::process_upstream_read_step_1_pre_body() {
           expect_body_continue_from_downstream_what_upstream_sent_ = false;
           expect_100_continue_from_upstream_ = false;
         }
-        if (is_connection_close(response_pre_body_.http_version_string,
+        if (is_connection_close(response_pre_body_.http_version_major,
+                                response_pre_body_.http_version_minor,
                                 response_pre_body_.headers)) {
           connection_close_ = true;
         }
@@ -693,7 +1350,7 @@ void connection::process_upstream_read_step_2_no_body(bool send_immediately) {
           .host = upstream_requested_host_,
           .request_pre_body = request_pre_body_,
           .response_pre_body = response_pre_body_,
-          .response_chunked_trailer = response_chunked_trailer_,
+          .response_chunked_trailer = response_chunked_trailer(),
           .response_body_forbidden = response_body_forbidden_,
           .response_has_more_body = false,
           .body_begin = upstream_read_buffer_begin_,
@@ -722,8 +1379,8 @@ void connection::process_upstream_read_step_2_body(bool send_immediately) {
       boost::logic::tribool result;
       boost::tie(result, upstream_read_buffer_begin_, body_end) =
           response_body_without_length_parser_.parse(
-              response_chunked_trailer_, upstream_read_buffer_begin_,
-              upstream_read_buffer_end_);
+              get_rare_messages().response_chunked_trailer,
+              upstream_read_buffer_begin_, upstream_read_buffer_end_);
       if (result) {
         response_state_ = response_state::finished;
         response_has_more_body = false;
@@ -754,7 +1411,7 @@ void connection::process_upstream_read_step_2_body(bool send_immediately) {
             .host = upstream_requested_host_,
             .request_pre_body = request_pre_body_,
             .response_pre_body = response_pre_body_,
-            .response_chunked_trailer = response_chunked_trailer_,
+            .response_chunked_trailer = response_chunked_trailer(),
             .response_body_forbidden = response_body_forbidden_,
             .response_has_more_body = response_has_more_body,
             .body_begin = body_begin,
@@ -797,31 +1454,30 @@ void connection::process_upstream_read_step_3_action() {
 
 void connection::handle_downstream_read(const boost::system::error_code &e,
                                         std::size_t bytes_transferred) {
-  if (!e) {
-    rsa_maker_bump_();
+  downstream_reading_ = false;
+  if (e == boost::asio::error::operation_aborted && handing_over_) {
+    if (!upstream_writing_) {
+      park_tunnel_loop(true);
+    }
+  } else if (!e) {
     if (request_state_ == request_state::tunnel) {
-      if (bump_state_ == bump_state::established) {
-        boost::asio::async_write(
-            *upstream_ssl_socket_,
-            boost::asio::const_buffer(&*downstream_read_buffer_.begin(),
-                                      bytes_transferred),
-            boost::bind(&connection::handle_upstream_write, shared_from_this(),
-                        boost::asio::placeholders::error));
-      } else {
-        boost::asio::async_write(
-            upstream_socket_,
-            boost::asio::const_buffer(&*downstream_read_buffer_.begin(),
-                                      bytes_transferred),
-            boost::bind(&connection::handle_upstream_write, shared_from_this(),
-                        boost::asio::placeholders::error));
-      }
+      downstream_tunnel_buffers_->commit(bytes_transferred);
+      relay_to_upstream();
+      read_from_downstream();
     } else {
+      downstream_read_size_ = buffer_pool::next_read_size(
+          downstream_read_buffer_.size(), bytes_transferred);
       downstream_read_buffer_begin_ = downstream_read_buffer_.begin();
       downstream_read_buffer_end_ =
           downstream_read_buffer_.begin() + bytes_transferred;
       process_downstream_read_step_1_pre_body();
     }
   } else if (e != boost::asio::error::operation_aborted) {
+    if (request_state_ == request_state::tunnel && upstream_writing_) {
+      // Stop once the bytes read so far are written.
+      downstream_read_finished_ = true;
+      return;
+    }
     connection_manager_stop();
   }
 }
@@ -842,7 +1498,7 @@ void connection::process_downstream_read_step_1_pre_body() {
                                        downstream_read_buffer_begin_,
                                        downstream_read_buffer_end_);
     if (result) {
-      if (request_pre_body_.method == "CONNECT") {
+      if (request_pre_body_.method_type == http::request_method::connect) {
         std::vector<std::string> url_parts;
         boost::split(url_parts, request_pre_body_.uri, boost::is_any_of(":"));
 
@@ -924,12 +1580,13 @@ void connection::process_downstream_read_step_1_pre_body() {
             return;
           }
         }
-        if (is_connection_close(request_pre_body_.http_version_string,
+        if (is_connection_close(request_pre_body_.http_version_major,
+                                request_pre_body_.http_version_minor,
                                 request_pre_body_.headers)) {
           connection_close_ = true;
         }
         http::header_container::name_iterator expect_it =
-            request_pre_body_.headers.find("expect");
+            request_pre_body_.headers.find(http::well_known_header::expect);
         expect_100_continue_from_upstream_ =
             expect_it != request_pre_body_.headers.end() &&
             expect_it->value == "100-continue";
@@ -946,8 +1603,8 @@ void connection::process_downstream_read_step_1_pre_body() {
                     expect_body_continue_from_downstream_,
                 .expect_100_continue_from_upstream =
                     expect_100_continue_from_upstream_,
-                .request_chunked_trailer = request_chunked_trailer_,
-                .response_chunked_trailer = response_chunked_trailer_,
+                .request_chunked_trailer = request_chunked_trailer(),
+                .response_chunked_trailer = response_chunked_trailer(),
                 .request_body_length_representation =
                     request_body_length_representation_,
                 .request_body_length = request_body_length_,
@@ -1010,8 +1667,8 @@ void connection::process_downstream_read_step_2_no_body(bool send_immediately) {
           .response_pre_body = response_pre_body_,
           .expect_100_continue_from_upstream =
               expect_100_continue_from_upstream_,
-          .request_chunked_trailer = request_chunked_trailer_,
-          .response_chunked_trailer = response_chunked_trailer_,
+          .request_chunked_trailer = request_chunked_trailer(),
+          .response_chunked_trailer = response_chunked_trailer(),
           .request_has_more_body = false,
           .body_begin = downstream_read_buffer_begin_,
           .body_end = downstream_read_buffer_end_,
@@ -1042,8 +1699,8 @@ void connection::process_downstream_read_step_2_body(bool send_immediately) {
       boost::logic::tribool result;
       boost::tie(result, downstream_read_buffer_begin_, body_end) =
           request_body_without_length_parser_.parse(
-              request_chunked_trailer_, downstream_read_buffer_begin_,
-              downstream_read_buffer_end_);
+              get_rare_messages().request_chunked_trailer,
+              downstream_read_buffer_begin_, downstream_read_buffer_end_);
       if (result) {
         request_state_ = request_state::finished;
         request_has_more_body = false;
@@ -1075,8 +1732,8 @@ void connection::process_downstream_read_step_2_body(bool send_immediately) {
             .response_pre_body = response_pre_body_,
             .expect_100_continue_from_upstream =
                 expect_100_continue_from_upstream_,
-            .request_chunked_trailer = request_chunked_trailer_,
-            .response_chunked_trailer = response_chunked_trailer_,
+            .request_chunked_trailer = request_chunked_trailer(),
+            .response_chunked_trailer = response_chunked_trailer(),
             .request_has_more_body = request_has_more_body,
             .body_begin = body_begin,
             .body_end = body_end,
@@ -2,7 +2,9 @@
 #define PROXY_SERVER_CONNECTION_HPP
 
 #include "proxy/callbacks/callbacks.hpp"
+#include "proxy/cert/certificate_cache.hpp"
 #include "proxy/cert/certificate_generator.hpp"
+#include "proxy/dns/dns_cache.hpp"
 #include "proxy/http/body_length_representation.hpp"
 #include "proxy/http/chunk.hpp"
 #include "proxy/http/request_pre_body.hpp"
@@ -12,17 +14,30 @@
 #include "proxy/http_parser/body_without_length_parser.hpp"
 #include "proxy/http_parser/request_pre_body_parser.hpp"
 #include "proxy/http_parser/response_pre_body_parser.hpp"
+#include "proxy/tls/client_sessions.hpp"
+#include "buffer_pool.hpp"
+#include "handler_allocator.hpp"
 #include "reply.hpp"
+#include "tunnel_buffers.hpp"
+#include "tunnel_splicer.hpp"
+#include "upstream_connector.hpp"
+#include "upstream_pool.hpp"
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/intrusive/list_hook.hpp>
 #include <boost/logic/tribool.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <chrono>
 #include <unordered_map>
 
+#if defined(PROXY_COROUTINE_TUNNELS) && !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "Coroutine tunnel loops need C++20 coroutines"
+#endif
+
 namespace proxy {
 namespace server {
 
@@ -40,11 +55,11 @@ class connection_manager;
 /// pre body was read, may jump to (****) if we are writing body already, here
 /// it is decided that it is not tunnel and not bump
 /// - connect_to_upstream - may jump to (****) if we are already connected to
-/// coorect upstream host
+/// coorect upstream host or there is an idle connection to it in the pool
 /// - handle_upstream_resolve
-/// - upstream_connect (*****)
-/// - handle_upstream_connect - may jump to (*****) if we have to iterate over
-/// endpoints
+/// - upstream_connect - races the endpoints of the host (see
+/// upstream_connector)
+/// - handle_upstream_connect
 /// - write_to_upstream (****)
 /// - handle_upstream_write - may jump to (*) if not whole request body was sent
 /// so far
@@ -53,8 +68,9 @@ class connection_manager;
 /// - process_upstream_read - may jump to (***) if not whole response pre body
 /// was read
 /// - downstream_write
-/// - handle_downstream_write - will jump to (*) if whole body was written or
-/// there was no body, will jump to (***) if there is more body
+/// - handle_downstream_write - will jump to (*) through wait_for_next_request
+/// if whole body was written or there was no body, will jump to (***) if there
+/// is more body
 ///
 /// Flow for tunnel connections (it starts like above until tunnel is detected):
 /// - start
@@ -65,9 +81,8 @@ class connection_manager;
 /// pre body was read, here it is decided that it is tunnel
 /// - connect_to_upstream
 /// - handle_upstream_resolve
-/// - upstream_connect (*****)
-/// - handle_upstream_connect - may jump to (*****) if we have to iterate over
-/// endpoints, if not this starts two simultaneous loops:
+/// - upstream_connect
+/// - handle_upstream_connect - this starts two simultaneous loops:
 /// Loop 1:
 /// - read_from_downstream
 /// - downstream_read_some
@@ -97,38 +112,53 @@ class connection_manager;
 /// - process_downstream_read
 /// - connect_to_upstream
 /// - handle_upstream_resolve
-/// - upstream_connect (***)
-/// - handle_upstream_connect - may jump to (***) if we have to iterate over
-/// endpoints
+/// - upstream_connect
+/// - handle_upstream_connect
 /// - the rest is the same as in the case of non-tunnel case with the upstream
 /// already connected
 
 class connection : public boost::enable_shared_from_this<connection>,
                    private boost::noncopyable {
 public:
+  typedef boost::intrusive::list_member_hook<
+      boost::intrusive::link_mode<boost::intrusive::auto_unlink>>
+      manager_hook;
+
   /// Construct a connection with the given io_context.
   explicit connection(
       boost::asio::io_context &io_context, connection_manager &manager,
       boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver,
-      const std::string &ca_private_key, const std::string &ca_certificate,
-      std::unordered_map<std::string, boost::tuple<std::string, std::string>>
-          &domain_certificates,
+      dns::dns_cache &dns_cache, upstream_pool &upstream_pool,
+      buffer_pool &buffer_pool, cert::certificate_cache &certificate_cache,
       boost::asio::ssl::context &upstream_ssl_context,
+      tls::client_sessions &upstream_sessions,
       const callbacks::connection_id connection_id,
       cert::certificate_generator &certificate_generator,
-      cert::rsa_maker::reschedule rsa_maker_reschedule,
-      boost::function<void()> rsa_maker_bump,
-      callbacks::proxy_callbacks &callbacks);
+      boost::function<bool()> should_hand_over,
+      boost::function<bool(boost::shared_ptr<connection>)> hand_over,
+      callbacks::proxy_callbacks &callbacks, bool splice_tunnels);
 
   /// Get the socket associated with the connection.
   boost::asio::ip::tcp::socket &downstream_socket();
 
+  callbacks::connection_id id() const;
+
   /// Start the first asynchronous operation for the connection.
   void start();
 
   /// Stop all asynchronous operations associated with the connection.
   void stop();
 
+  /// Move the sockets and the state of this connection to the given one,
+  /// created for the io_context of another thread. Only called at safe points
+  /// (between requests or with both tunnel loops parked), when there are no
+  /// outstanding asynchronous operations. Connections with SSL streams are
+  /// never handed over.
+  void hand_over(connection &target);
+
+  /// Continue a connection after hand_over, on the thread of its io_context.
+  void resume();
+
 private:
   /// Handle completion of a dowstream read operation.
   void handle_downstream_read(const boost::system::error_code &e,
@@ -142,13 +172,26 @@ private:
   void connect_to_upstream(std::string &upstream_host,
                            std::string &upstream_service);
 
+  /// Resolve upstream_connected_host_ and open a new connection to it.
+  void resolve_upstream();
+
+  /// Return the upstream connection to the pool if it is idle, close it
+  /// otherwise.
+  void release_upstream();
+
+  void close_upstream();
+
+  /// Resend upstream_retry_request_ on a new upstream connection, returns false
+  /// if there is nothing to retry.
+  bool retry_upstream_request();
+
   void handle_upstream_resolve(
       const boost::system::error_code &e,
       boost::asio::ip::tcp::resolver::iterator endpoint_iterator);
 
-  void handle_upstream_connect(
-      const boost::system::error_code &e,
-      boost::asio::ip::tcp::resolver::iterator endpoint_iterator);
+  /// Takes over the connected socket.
+  void handle_upstream_connect(const boost::system::error_code &e,
+                               boost::asio::ip::tcp::socket &socket);
 
   void
   upstream_connect(boost::asio::ip::tcp::resolver::iterator endpoint_iterator);
@@ -157,6 +200,12 @@ private:
 
   void handle_downstream_write(const boost::system::error_code &e);
 
+  /// Handle completion of the certificate generation for a bumped host.
+  void handle_generate_certificate(cert::certificate_ptr certificate);
+
+  /// Start the SSL handshake with downstream using certificate_.
+  void downstream_handshake();
+
   void handle_downstream_handshake(const boost::system::error_code &e);
 
   void handle_upstream_handshake(const boost::system::error_code &e);
@@ -199,16 +248,97 @@ private:
 
   void connection_manager_stop();
 
+  /// Whether the tunnel loops should stop to hand the connection over to
+  /// another thread.
+  bool tunnel_should_park();
+
+  /// Park one of the tunnel loops, once both are parked hand the connection
+  /// over (or resume both loops if that is not possible anymore).
+  void park_tunnel_loop(bool downstream_loop);
+
+  /// Whether the tunnel moves the bytes with splice() rather than through the
+  /// read buffers, opens the splicers on first use.
+  bool splice_tunnel();
+
+  void handle_downstream_splice(const boost::system::error_code &e);
+
+  /// Replace the consumed read buffer with one of the given size.
+  void prepare_read_buffer(std::string &buffer, std::size_t size);
+
+  /// Return the read buffer to the pool if its bytes are consumed and no read
+  /// is posted into it.
+  void release_read_buffer(std::string &buffer, std::string::iterator &begin,
+                           std::string::iterator &end, bool reading);
+
+  /// The read-write loops of tunnels: read_from_downstream and
+  /// read_from_upstream go here once the tunnel is established. Each direction
+  /// reads into its tunnel_buffers while the bytes read before are written.
+  void relay_downstream();
+
+  void relay_upstream();
+
+  /// Whether the loop should read into its tunnel_buffers next, false if it
+  /// parks, is spliced, waits for its buffers to be written or is reading
+  /// already.
+  bool begin_downstream_relay_read();
+
+  bool begin_upstream_relay_read();
+
+#if defined(PROXY_COROUTINE_TUNNELS)
+  /// The loops of buffered tunnels as coroutines (connection_coroutines.cpp),
+  /// spliced tunnels and requests keep their handlers: relay_reads reads from
+  /// one side for as long as begin_*_relay_read allows, and relay_writes writes
+  /// what it read to the other side until the buffers are drained. Both run
+  /// the same steps as the handlers they replace.
+  boost::asio::awaitable<void> relay_reads(boost::shared_ptr<connection> self,
+                                           bool downstream);
+
+  boost::asio::awaitable<void> relay_writes(boost::shared_ptr<connection> self,
+                                            bool to_upstream);
+#endif
+
+  /// Write what the downstream loop read unless a write is in progress.
+  void relay_to_upstream();
+
+  void relay_to_downstream();
+
+  void handle_upstream_relay_write(const boost::system::error_code &e);
+
+  void handle_downstream_relay_write(const boost::system::error_code &e);
+
+  void handle_upstream_splice(const boost::system::error_code &e);
+
   void shutdown();
 
-  bool is_connection_close(std::string &http_version_string,
+  /// Park the keep-alive connection until the next request arrives, the wait
+  /// is a zero-byte read (a one-byte read with TLS). The buffers, parser state
+  /// and handler memory are kept for the next request unless the connection
+  /// stays idle.
+  void wait_for_next_request();
+
+  void handle_wait_for_next_request(const boost::system::error_code &e,
+                                    std::size_t bytes_transferred);
+
+  /// Release the idle memory once the connection has waited
+  /// IDLE_RELEASE_DELAY for the next request.
+  void handle_idle_timer(const boost::system::error_code &e);
+
+  /// Free everything the next request does not need. A released plain
+  /// connection keeps about 3.4 KiB of heap, mostly the connection object
+  /// itself (2.9 KiB). A bumped one keeps about 88 KiB: the SSL stream of asio
+  /// holds two 17 KiB record buffers and a BIO pair with two more, and the SSL
+  /// object and its session state take about 13 KiB, so parking cannot get
+  /// bumped connections anywhere near the size of plain ones.
+  void release_idle_memory();
+
+  bool is_connection_close(int http_version_major, int http_version_minor,
                            http::header_container &headers);
 
+  boost::asio::io_context &io_context_;
+
   /// Socket for the downstream connection.
   boost::asio::ip::tcp::socket downstream_socket_;
 
-  boost::asio::ssl::context downstream_ssl_context_;
-
   boost::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>>
       downstream_ssl_socket_;
 
@@ -217,21 +347,45 @@ private:
 
   boost::asio::ssl::context &upstream_ssl_context_;
 
-  boost::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>>
-      upstream_ssl_socket_;
+  /// Sessions to resume upstream connections with.
+  tls::client_sessions &upstream_sessions_;
+
+  /// Owns the upstream socket once the TLS handshake starts.
+  upstream_pool::ssl_socket_ptr upstream_ssl_socket_;
+
+  /// Idle upstream connections of the thread, shared by its connections.
+  upstream_pool &upstream_pool_;
+
+  /// Connection attempts in progress, if any.
+  boost::shared_ptr<upstream_connector> upstream_connector_{};
+
+  /// The upstream connection finished a request and has none in flight, so it
+  /// may be returned to the pool (or reused for the next request).
+  bool upstream_idle_{};
+
+  /// Copy of an idempotent request sent on a reused upstream connection,
+  /// resent on a new connection if the origin closed the reused one meanwhile.
+  /// Cleared once the response starts arriving.
+  std::string upstream_retry_request_{};
 
   /// The manager for this connection.
   connection_manager &connection_manager_;
 
-  /// Buffer for incoming downstream data.
-  std::string downstream_read_buffer_ = std::string(8192, 0);
+  /// Read buffers of the thread, shared by its connections.
+  buffer_pool &buffer_pool_;
+
+  /// Buffer for incoming downstream data, taken from buffer_pool_ when a read
+  /// is posted and returned once its bytes are consumed.
+  std::string downstream_read_buffer_{};
+  std::size_t downstream_read_size_{buffer_pool::SMALLEST_BUFFER_SIZE};
 
   // First unconsumed byte in the downstream read buffer.
   std::string::iterator downstream_read_buffer_begin_{};
   std::string::iterator downstream_read_buffer_end_{};
 
-  /// Buffer for incoming downstream data.
-  std::string upstream_read_buffer_ = std::string(8192, 0);
+  /// Buffer for incoming upstream data.
+  std::string upstream_read_buffer_{};
+  std::size_t upstream_read_size_{buffer_pool::SMALLEST_BUFFER_SIZE};
 
   // First unconsumed byte in the upstream read buffer.
   std::string::iterator upstream_read_buffer_begin_{};
@@ -245,10 +399,22 @@ private:
 
   /// The incoming response.
   http::response_pre_body response_pre_body_{};
-  http::response_pre_body response_pre_body_100_continue_{};
 
-  http::trailer request_chunked_trailer_{};
-  http::trailer response_chunked_trailer_{};
+  /// Messages most requests never have, kept out of line so that they do not
+  /// weigh on every connection. Allocated once a chunked body or a 100
+  /// Continue response is parsed, freed when the connection stays idle.
+  struct rare_messages {
+    http::response_pre_body response_pre_body_100_continue{};
+    http::trailer request_chunked_trailer{};
+    http::trailer response_chunked_trailer{};
+  };
+  std::unique_ptr<rare_messages> rare_messages_{};
+  rare_messages &get_rare_messages();
+
+  /// The trailers handed to the callbacks: an empty one shared by the
+  /// connections of the thread until a chunked body is parsed.
+  http::trailer &request_chunked_trailer();
+  http::trailer &response_chunked_trailer();
 
   /// The parser for the incoming response pre body.
   http_parser::response_pre_body_parser response_pre_body_parser_{};
@@ -260,8 +426,9 @@ private:
   http_parser::body_without_length_parser
       response_body_without_length_parser_{};
 
-  std::string private_key_;
-  std::string certificate_;
+  /// Certificate of the bumped host, owns the SSL context of
+  /// downstream_ssl_socket_.
+  cert::certificate_ptr certificate_{};
 
   // Both request and response statuses represent how far along we are reading a
   // request from downstream or reading response from upstream, they have
@@ -307,6 +474,34 @@ private:
   void downstream_read_some(const MutableBufferSequence &buffer,
                             BOOST_ASIO_MOVE_ARG(ReadHandler) handler);
 
+  template <typename ConstBufferSequence, typename WriteHandler>
+  void upstream_write(const ConstBufferSequence &buffers,
+                      BOOST_ASIO_MOVE_ARG(WriteHandler) handler);
+
+  template <typename MutableBufferSequence, typename ReadHandler>
+  void upstream_read_some(const MutableBufferSequence &buffer,
+                          BOOST_ASIO_MOVE_ARG(ReadHandler) handler);
+
+  // Memory of the operations of the read and write chains of both sides, so
+  // that serving requests does not allocate for the handlers. Released when
+  // the connection stays idle.
+  handler_memory downstream_read_memory_{};
+  handler_memory downstream_write_memory_{};
+  handler_memory upstream_read_memory_{};
+  handler_memory upstream_write_memory_{};
+
+  /// Fires at most once per IDLE_RELEASE_DELAY while the connection serves
+  /// requests, so that keep-alive requests neither arm nor cancel it.
+  boost::asio::steady_timer idle_timer_;
+  handler_memory idle_timer_memory_{};
+  bool idle_timer_running_{};
+
+  /// Waiting for the next request since idle_since_.
+  bool idle_{};
+  /// The first byte of the next request on a TLS connection.
+  char downstream_idle_byte_{};
+  std::chrono::steady_clock::time_point idle_since_{};
+
   std::string upstream_requested_host_{};
   std::string upstream_requested_service_{};
 
@@ -329,15 +524,34 @@ private:
   bool upstream_died_while_reading_from_it_{};
   bool stopped_{};
 
+  // Tunnel loops waiting for a read, see park_tunnel_loop.
+  bool downstream_reading_{};
+  bool upstream_reading_{};
+
+  // Tunnel loops writing what they read, a loop parks once its write is done.
+  bool upstream_writing_{};
+  bool downstream_writing_{};
+
+  // The source of a tunnel loop is closed, the connection stops when the loop
+  // has written everything.
+  bool downstream_read_finished_{};
+  bool upstream_read_finished_{};
+
+  std::unique_ptr<tunnel_buffers> downstream_tunnel_buffers_{};
+  std::unique_ptr<tunnel_buffers> upstream_tunnel_buffers_{};
+  bool handing_over_{};
+  int tunnel_loops_parked_{};
+  unsigned tunnel_reads_{};
+
   /// The stock reply to be sent back to the client.
   reply reply_{};
 
   boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver_;
 
-  const std::string &ca_private_key_;
-  const std::string &ca_certificate_;
-  std::unordered_map<std::string, boost::tuple<std::string, std::string>>
-      &domain_certificates_;
+  /// Resolutions shared by all threads, resolved with resolver_ on a miss.
+  dns::dns_cache &dns_cache_;
+
+  cert::certificate_cache &certificate_cache_;
 
   // Unique identifier for connection.
   const callbacks::connection_id connection_id_;
@@ -347,11 +561,20 @@ private:
 
   cert::certificate_generator &certificate_generator_;
 
-  cert::rsa_maker::reschedule rsa_maker_reschedule_;
+  boost::function<bool()> should_hand_over_;
+
+  boost::function<bool(boost::shared_ptr<connection>)> hand_over_;
 
-  boost::function<void()> rsa_maker_bump_;
+  /// Splice the tunnels which are not bumped, cleared if it is not possible.
+  bool splice_tunnels_;
+  std::unique_ptr<tunnel_splicer> downstream_splicer_{};
+  std::unique_ptr<tunnel_splicer> upstream_splicer_{};
 
   callbacks::proxy_callbacks &callbacks_;
+
+  /// Links the connection into the list of its connection_manager.
+  manager_hook manager_hook_{};
+  friend class connection_manager;
 };
 
 typedef boost::shared_ptr<connection> connection_ptr;
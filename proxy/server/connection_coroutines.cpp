@@ -0,0 +1,120 @@
+#include "connection.hpp"
+
+#if defined(PROXY_COROUTINE_TUNNELS)
+
+namespace proxy {
+namespace server {
+
+boost::asio::awaitable<void>
+connection::relay_reads(boost::shared_ptr<connection> self, bool downstream) {
+  tunnel_buffers &buffers =
+      downstream ? *downstream_tunnel_buffers_ : *upstream_tunnel_buffers_;
+  bool &reading = downstream ? downstream_reading_ : upstream_reading_;
+  bool &writing = downstream ? upstream_writing_ : downstream_writing_;
+  bool &read_finished =
+      downstream ? downstream_read_finished_ : upstream_read_finished_;
+
+  do {
+    boost::system::error_code ec = boost::asio::error::operation_aborted;
+    std::size_t bytes_transferred = 0;
+    // The coroutine starts after a post, the other loop may have parked and
+    // tried to cancel this read meanwhile.
+    if (!handing_over_) {
+      auto token = boost::asio::redirect_error(boost::asio::use_awaitable, ec);
+      if (bump_state_ == bump_state::established) {
+        bytes_transferred =
+            downstream ? co_await downstream_ssl_socket_->async_read_some(
+                             buffers.prepare(), token)
+                       : co_await upstream_ssl_socket_->async_read_some(
+                             buffers.prepare(), token);
+      } else {
+        bytes_transferred =
+            downstream
+                ? co_await downstream_socket_.async_read_some(buffers.prepare(),
+                                                              token)
+                : co_await upstream_socket_.async_read_some(buffers.prepare(),
+                                                            token);
+      }
+    }
+    reading = false;
+    if (ec == boost::asio::error::operation_aborted && handing_over_) {
+      if (!writing) {
+        park_tunnel_loop(downstream);
+      }
+      co_return;
+    }
+    if (ec) {
+      if (ec != boost::asio::error::operation_aborted) {
+        if (writing) {
+          // Stop once the bytes read so far are written.
+          read_finished = true;
+        } else {
+          connection_manager_stop();
+        }
+      }
+      co_return;
+    }
+    buffers.commit(bytes_transferred);
+    if (downstream) {
+      relay_to_upstream();
+    } else {
+      relay_to_downstream();
+    }
+  } while (downstream ? begin_downstream_relay_read()
+                      : begin_upstream_relay_read());
+}
+
+boost::asio::awaitable<void>
+connection::relay_writes(boost::shared_ptr<connection> self, bool to_upstream) {
+  tunnel_buffers &buffers =
+      to_upstream ? *downstream_tunnel_buffers_ : *upstream_tunnel_buffers_;
+  bool &writing = to_upstream ? upstream_writing_ : downstream_writing_;
+  bool &read_finished =
+      to_upstream ? downstream_read_finished_ : upstream_read_finished_;
+
+  for (;;) {
+    boost::system::error_code ec;
+    auto token = boost::asio::redirect_error(boost::asio::use_awaitable, ec);
+    if (bump_state_ == bump_state::established) {
+      if (to_upstream) {
+        co_await boost::asio::async_write(*upstream_ssl_socket_,
+                                          buffers.start_write(), token);
+      } else {
+        co_await boost::asio::async_write(*downstream_ssl_socket_,
+                                          buffers.start_write(), token);
+      }
+    } else {
+      co_await boost::asio::async_write(
+          to_upstream ? upstream_socket_ : downstream_socket_,
+          buffers.start_write(), token);
+    }
+    writing = false;
+    if (ec) {
+      if (ec != boost::asio::error::operation_aborted) {
+        connection_manager_stop();
+      }
+      co_return;
+    }
+    buffers.finish_write();
+    // Set before resuming the reads so that the loop does not park while the
+    // rest is written.
+    writing = buffers.can_write();
+    if (!writing && read_finished) {
+      connection_manager_stop();
+      co_return;
+    }
+    if (to_upstream) {
+      read_from_downstream();
+    } else {
+      read_from_upstream();
+    }
+    if (!writing) {
+      co_return;
+    }
+  }
+}
+
+} // namespace server
+} // namespace proxy
+
+#endif // defined(PROXY_COROUTINE_TUNNELS)
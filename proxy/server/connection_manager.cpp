@@ -1,24 +1,33 @@
 #include "connection_manager.hpp"
-#include <algorithm>
-#include <boost/bind/bind.hpp>
 
 namespace proxy {
 namespace server {
 
 void connection_manager::start(connection_ptr c) {
-  connections_.insert(c);
+  connections_.push_back(*c);
   c->start();
 }
 
 void connection_manager::stop(connection_ptr c) {
-  connections_.erase(c);
+  c->manager_hook_.unlink();
   c->stop();
 }
 
 void connection_manager::stop_all() {
-  std::for_each(connections_.begin(), connections_.end(),
-                boost::bind(&connection::stop, boost::placeholders::_1));
-  connections_.clear();
+  while (!connections_.empty()) {
+    connection_ptr c = connections_.front().shared_from_this();
+    connections_.pop_front();
+    c->stop();
+  }
+}
+
+void connection_manager::release(connection_ptr c) {
+  c->manager_hook_.unlink();
+}
+
+void connection_manager::resume(connection_ptr c) {
+  connections_.push_back(*c);
+  c->resume();
 }
 
 } // namespace server
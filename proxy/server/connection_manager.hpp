@@ -2,15 +2,16 @@
 #define PROXY_SERVER_CONNECTION_MANAGER_HPP
 
 #include "connection.hpp"
+#include <boost/intrusive/list.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/unordered_set.hpp>
-#include <set>
 
 namespace proxy {
 namespace server {
 
 /// Manages open connections so that they may be cleanly stopped when the server
-/// needs to shut down.
+/// needs to shut down. The connections are linked through their
+/// manager_hook_, a connection unlinks itself when destroyed; they are kept
+/// alive by their pending operations, not by the manager.
 class connection_manager : private boost::noncopyable {
 public:
   /// Add the specified connection to the manager and start it.
@@ -22,9 +23,24 @@ public:
   /// Stop all connections.
   void stop_all();
 
+  /// Remove the specified connection without stopping it, it is being handed
+  /// over to the manager of another thread.
+  void release(connection_ptr c);
+
+  /// Add the specified connection handed over from another manager and resume
+  /// it.
+  void resume(connection_ptr c);
+
 private:
+  typedef boost::intrusive::list<
+      connection,
+      boost::intrusive::member_hook<connection, connection::manager_hook,
+                                    &connection::manager_hook_>,
+      boost::intrusive::constant_time_size<false>>
+      connection_list;
+
   /// The managed connections.
-  boost::unordered_set<connection_ptr> connections_{};
+  connection_list connections_{};
 };
 
 } // namespace server
@@ -0,0 +1,52 @@
+#include "connection_pool.hpp"
+#include <new>
+#include <vector>
+
+namespace proxy {
+namespace server {
+
+/// Free blocks kept per thread.
+const std::size_t MAX_FREE_CONNECTION_BLOCKS = 1024;
+
+namespace {
+
+/// Blocks of the one size allocated through connection_pool_allocator.
+struct free_connection_blocks {
+  ~free_connection_blocks() {
+    for (void *block : blocks) {
+      ::operator delete(block);
+    }
+  }
+
+  std::size_t size{};
+  std::vector<void *> blocks{};
+};
+
+thread_local free_connection_blocks free_blocks;
+
+} // namespace
+
+void *allocate_connection_block(std::size_t size) {
+  if (free_blocks.size == size && !free_blocks.blocks.empty()) {
+    void *block = free_blocks.blocks.back();
+    free_blocks.blocks.pop_back();
+    return block;
+  }
+  return ::operator new(size);
+}
+
+void deallocate_connection_block(void *block, std::size_t size) {
+  if (free_blocks.blocks.empty()) {
+    free_blocks.size = size;
+  }
+  // Connections handed over to another thread end up on its free list.
+  if (free_blocks.size == size &&
+      free_blocks.blocks.size() < MAX_FREE_CONNECTION_BLOCKS) {
+    free_blocks.blocks.push_back(block);
+  } else {
+    ::operator delete(block);
+  }
+}
+
+} // namespace server
+} // namespace proxy
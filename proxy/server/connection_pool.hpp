@@ -0,0 +1,51 @@
+#ifndef PROXY_SERVER_CONNECTION_POOL_HPP
+#define PROXY_SERVER_CONNECTION_POOL_HPP
+
+#include <cstddef>
+
+namespace proxy {
+namespace server {
+
+/// Memory of a destroyed connection (object and reference count, see
+/// boost::allocate_shared) taken from the free list of the calling thread, or
+/// allocated if it is empty.
+void *allocate_connection_block(std::size_t size);
+
+/// Keep the memory of a destroyed connection on the free list of the calling
+/// thread, up to a limit.
+void deallocate_connection_block(void *block, std::size_t size);
+
+/// Allocator of connections recycling their memory through per-thread free
+/// lists, so that accepting under connection churn does not go to malloc.
+template <typename T> class connection_pool_allocator {
+public:
+  typedef T value_type;
+
+  connection_pool_allocator() = default;
+
+  template <typename U>
+  connection_pool_allocator(const connection_pool_allocator<U> &) {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(allocate_connection_block(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    deallocate_connection_block(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const connection_pool_allocator<U> &) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const connection_pool_allocator<U> &) const {
+    return false;
+  }
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_CONNECTION_POOL_HPP
@@ -2,6 +2,7 @@
 #include "proxy/logging/logging.hpp"
 #include "server.hpp"
 #include <clocale>
+#include <string>
 
 int main(int argc, char *argv[]) {
   // For lowercase.
@@ -10,8 +11,9 @@ int main(int argc, char *argv[]) {
   proxy::logging::init(argv[0]);
 
   // Check command line arguments.
-  if (argc != 3) {
-    std::cerr << "Usage: bazel run proxy/server:demo <address> <port>\n";
+  if (argc != 3 && argc != 4) {
+    std::cerr
+        << "Usage: bazel run proxy/server:demo <address> <port> [<threads>]\n";
     std::cerr << "  For IPv4, try:\n";
     std::cerr << "    bazel run proxy/server:demo 0.0.0.0 80\n";
     std::cerr << "  For IPv6, try:\n";
@@ -22,7 +24,11 @@ int main(int argc, char *argv[]) {
   proxy::callbacks::proxy_callbacks callbacks;
 
   // Initialize the server.
-  proxy::server::server s(argv[1], argv[2], callbacks);
+  proxy::server::server_options options;
+  if (argc == 4) {
+    options.threads = std::stoul(argv[3]);
+  }
+  proxy::server::server s(argv[1], argv[2], callbacks, options);
 
   // Run the server until stopped.
   s.run();
@@ -0,0 +1,131 @@
+#ifndef PROXY_SERVER_HANDLER_ALLOCATOR_HPP
+#define PROXY_SERVER_HANDLER_ALLOCATOR_HPP
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace proxy {
+namespace server {
+
+/// Memory for the operation of one asynchronous chain (e.g. the reads of one
+/// socket). Asio frees the memory of an operation before calling its handler,
+/// so a chain which starts the next operation from the handler keeps reusing
+/// the same block. The block is allocated on first use and sized to the
+/// biggest operation seen so far (a bound read is a couple of hundred bytes,
+/// a TLS write several hundred), so chains which never run cost nothing.
+/// Should the block be in use, the memory is allocated.
+class handler_memory : private boost::noncopyable {
+public:
+  handler_memory() = default;
+
+  ~handler_memory() { ::operator delete(block_); }
+
+  void *allocate(std::size_t size) {
+    if (in_use_) {
+      return ::operator new(size);
+    }
+    if (size > capacity_) {
+      ::operator delete(block_);
+      block_ = nullptr;
+      capacity_ = 0;
+      block_ = ::operator new(size);
+      capacity_ = size;
+    }
+    in_use_ = true;
+    return block_;
+  }
+
+  void deallocate(void *pointer) {
+    if (pointer == block_) {
+      in_use_ = false;
+    } else {
+      ::operator delete(pointer);
+    }
+  }
+
+  /// Frees the block unless an operation holds it, e.g. while a connection
+  /// waits idle.
+  void release() {
+    if (!in_use_) {
+      ::operator delete(block_);
+      block_ = nullptr;
+      capacity_ = 0;
+    }
+  }
+
+private:
+  void *block_{nullptr};
+  std::size_t capacity_{0};
+  bool in_use_{false};
+};
+
+/// The allocator associated with the handlers of a chain, see
+/// boost::asio::associated_allocator.
+template <typename T> class handler_allocator {
+public:
+  typedef T value_type;
+
+  explicit handler_allocator(handler_memory &memory) : memory_(memory) {}
+
+  template <typename U>
+  handler_allocator(const handler_allocator<U> &other)
+      : memory_(other.memory_) {}
+
+  T *allocate(std::size_t n) const {
+    return static_cast<T *>(memory_.allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T *p, std::size_t /*n*/) const { memory_.deallocate(p); }
+
+  template <typename U>
+  bool operator==(const handler_allocator<U> &other) const {
+    return &memory_ == &other.memory_;
+  }
+
+  template <typename U>
+  bool operator!=(const handler_allocator<U> &other) const {
+    return &memory_ != &other.memory_;
+  }
+
+private:
+  template <typename> friend class handler_allocator;
+
+  handler_memory &memory_;
+};
+
+/// Handler wrapper making Asio allocate the operations it completes from a
+/// handler_memory.
+template <typename Handler> class custom_alloc_handler {
+public:
+  typedef handler_allocator<Handler> allocator_type;
+
+  custom_alloc_handler(handler_memory &memory, Handler handler)
+      : memory_(memory), handler_(std::move(handler)) {}
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(memory_);
+  }
+
+  template <typename... Args> void operator()(Args &&... args) {
+    handler_(std::forward<Args>(args)...);
+  }
+
+private:
+  handler_memory &memory_;
+  Handler handler_;
+};
+
+template <typename Handler>
+inline custom_alloc_handler<typename std::decay<Handler>::type>
+make_custom_alloc_handler(handler_memory &memory, Handler &&handler) {
+  return custom_alloc_handler<typename std::decay<Handler>::type>(
+      memory, std::forward<Handler>(handler));
+}
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_HANDLER_ALLOCATOR_HPP
@@ -1,15 +1,25 @@
 #include "server.hpp"
+#include "connection_pool.hpp"
 #include "proxy/cert/certificate_generator.hpp"
 #include "proxy/logging/logging.hpp"
 #include <boost/bind/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <cstdint>
 #include <fstream>
 #include <signal.h>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif // defined(__linux__)
 
 namespace proxy {
 namespace server {
 
-const boost::asio::deadline_timer::duration_type RSA_MAKER_DELAY =
-    boost::posix_time::milliseconds(2000);
+// Shards with smaller queue delay (in microseconds) never hand connections
+// over.
+const std::int64_t HANDOVER_MIN_QUEUE_DELAY = 1000;
 
 void write_file_to_disk(std::string file_name, std::string content) {
   std::ofstream out(file_name);
@@ -29,20 +39,41 @@ std::string read_file_from_disk(std::string file_name) {
 }
 
 server::server(const std::string &address, const std::string &port,
-               callbacks::proxy_callbacks &callbacks)
-    : io_context_(), signals_(io_context_), acceptor_(io_context_),
-      connection_manager_(), new_connection_(),
-      upstream_ssl_context_(boost::asio::ssl::context::tlsv12),
-      callbacks_(callbacks), rsa_maker_timer_(io_context_) {
+               callbacks::proxy_callbacks &callbacks,
+               const server_options &options)
+    : options_(options), certificate_cache_(options.certificate_cache_size),
+      dns_cache_(options.dns_cache_size, options.dns_ttl,
+                 options.dns_negative_ttl),
+      upstream_sessions_(options.upstream_tls_session_cache_size,
+                         options.upstream_tls_session_lifetime),
+      upstream_ssl_context_(boost::asio::ssl::context::tls_client),
+      callbacks_(callbacks), rsa_maker_(options.rsa_maker_threads),
+      server_sessions_(options.tls_ticket_key_lifetime,
+                       options.tls_session_cache_size),
+      certificate_generator_(
+          rsa_maker_, certificate_cache_,
+          boost::bind(&tls::server_sessions::setup, &server_sessions_,
+                      boost::placeholders::_1, boost::placeholders::_2),
+          options.certificate_generator_threads) {
+  if (options_.threads == 0) {
+    options_.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < options_.threads; ++i) {
+    shards_.emplace_back(
+        new shard(boost::bind(&server::new_connection, this, i),
+                  options_.upstream_pool, options_.buffer_pool_size));
+  }
+
   // Register to handle the signals that indicate when the server should exit.
   // It is safe to register for the same signal multiple times in a program,
   // provided all registration for the specified signal is made through Asio.
-  signals_.add(SIGINT);
-  signals_.add(SIGTERM);
+  signals_.reset(new boost::asio::signal_set(shards_[0]->io_context()));
+  signals_->add(SIGINT);
+  signals_->add(SIGTERM);
 #if defined(SIGQUIT)
-  signals_.add(SIGQUIT);
+  signals_->add(SIGQUIT);
 #endif // defined(SIGQUIT)
-  signals_.async_wait(boost::bind(&server::handle_stop, this));
+  signals_->async_wait(boost::bind(&server::handle_stop, this));
 
   ca_private_key_ = read_file_from_disk("ca.key");
   ca_certificate_ = read_file_from_disk("ca.pem");
@@ -53,109 +84,185 @@ server::server(const std::string &address, const std::string &port,
     write_file_to_disk("ca.key", ca_private_key_);
     write_file_to_disk("ca.pem", ca_certificate_);
   }
+  if (!certificate_generator_.load_root_certificate(ca_private_key_,
+                                                    ca_certificate_)) {
+    DLOG(ERROR) << "Failed to load the root certificate.";
+  }
 
   upstream_ssl_context_.set_default_verify_paths();
+  // Allow TLS 1.3 upstream, but nothing older than TLS 1.2.
+  SSL_CTX_set_min_proto_version(upstream_ssl_context_.native_handle(),
+                                TLS1_2_VERSION);
+  if (!upstream_sessions_.setup(upstream_ssl_context_)) {
+    DLOG(ERROR) << "Failed to set up upstream TLS session resumption.";
+  }
 
-  // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-  resolver_.reset(new boost::asio::ip::tcp::resolver(io_context_));
   boost::asio::ip::tcp::endpoint endpoint =
-      *resolver_->resolve(address, port).begin();
-  acceptor_.open(endpoint.protocol());
-  acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-  acceptor_.set_option(boost::asio::ip::tcp::no_delay(true));
-  acceptor_.bind(endpoint);
-  acceptor_.listen();
+      *shards_[0]->resolver()->resolve(address, port).begin();
+  // All shards listen on the same endpoint, with SO_REUSEPORT the kernel
+  // spreads incoming connections over their acceptors. The other shards bind
+  // to the address of the first one, in case an ephemeral port was requested.
+  bool reuse_port = shards_.size() > 1;
+  shards_[0]->listen(endpoint, reuse_port);
+  endpoint = shards_[0]->local_endpoint();
+  for (std::size_t i = 1; i < shards_.size(); ++i) {
+    shards_[i]->listen(endpoint, reuse_port);
+  }
 
-  start_accept();
+  for (auto &shard : shards_) {
+    shard->start_accept();
+    if (shards_.size() > 1) {
+      shard->start_load_probe();
+    }
+  }
 }
 
 void server::run() {
-  callbacks_.on_ready(acceptor_.local_endpoint().port());
-  rsa_maker_reschedule();
-  // The io_context::run() call will block until all asynchronous operations
-  // have finished. While the server is running, there is always at least one
-  // asynchronous operation outstanding: the asynchronous accept call waiting
-  // for new incoming connections.
-  for (;;) {
-    try {
-      io_context_.run();
-      break; // run() exited normally
-    } catch (...) {
-      DLOG(ERROR) << "Restarting io_context.run() due to exception.";
-    }
+  callbacks_.on_ready(shards_[0]->local_endpoint().port());
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < shards_.size(); ++i) {
+    threads.emplace_back(boost::bind(&server::run_shard, this, i));
+  }
+  run_shard(0);
+  for (auto &thread : threads) {
+    thread.join();
   }
 }
 
-void server::rsa_maker_reschedule() {
-  if (!stopped_) {
-    boost::asio::deadline_timer::duration_type new_delay =
-        RSA_MAKER_DELAY / (rsa_maker_counter_ * rsa_maker_counter_);
-    boost::asio::deadline_timer::duration_type current_delay =
-        rsa_maker_timer_.expires_from_now();
-    if (current_delay.is_negative() || current_delay.is_not_a_date_time() ||
-        current_delay > new_delay) {
-      rsa_maker_timer_.expires_from_now(new_delay);
-      rsa_maker_timer_.async_wait(
-          boost::bind(&server::handle_rsa_maker_timer, this,
-                      boost::asio::placeholders::error));
+void server::run_shard(std::size_t index) {
+#if defined(__linux__)
+  if (options_.pin_threads) {
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(index % cpus, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) !=
+        0) {
+      DLOG(ERROR) << "Failed to pin thread of shard " << index << " to CPU "
+                  << index % cpus << ".";
     }
   }
+#endif // defined(__linux__)
+  shards_[index]->run();
 }
 
-void server::handle_rsa_maker_timer(const boost::system::error_code &e) {
-  if (!e) {
-    if (rsa_maker_counter_ < 5) {
-      rsa_maker_counter_++;
-    }
-    rsa_maker_.generate_callback(
-        boost::bind(&server::rsa_maker_reschedule, this));
+cert::certificate_cache::statistics
+server::certificate_cache_statistics() const {
+  return certificate_cache_.get_statistics();
+}
+
+tls::server_sessions::statistics server::tls_session_statistics() const {
+  return server_sessions_.get_statistics();
+}
+
+tls::client_sessions::statistics
+server::upstream_tls_session_statistics() const {
+  return upstream_sessions_.get_statistics();
+}
+
+dns::dns_cache::statistics server::dns_cache_statistics() const {
+  return dns_cache_.get_statistics();
+}
+
+upstream_pool::statistics server::upstream_pool_statistics() const {
+  upstream_pool::statistics result;
+  for (const std::unique_ptr<shard> &shard : shards_) {
+    upstream_pool::statistics s = shard->upstream_pool().get_statistics();
+    result.hits += s.hits;
+    result.misses += s.misses;
+    result.stale += s.stale;
+    result.expired += s.expired;
+    result.evictions += s.evictions;
+    result.size += s.size;
   }
+  return result;
 }
 
-void server::rsa_maker_bump() {
-  rsa_maker_counter_ = 1;
-  if (!stopped_ && rsa_maker_timer_.expires_from_now() < RSA_MAKER_DELAY / 2 &&
-      rsa_maker_timer_.expires_from_now(RSA_MAKER_DELAY) > 0) {
-    rsa_maker_timer_.async_wait(boost::bind(&server::handle_rsa_maker_timer,
-                                            this,
-                                            boost::asio::placeholders::error));
+buffer_pool::statistics server::buffer_pool_statistics() const {
+  buffer_pool::statistics result;
+  for (const std::unique_ptr<shard> &shard : shards_) {
+    buffer_pool::statistics s = shard->buffer_pool().get_statistics();
+    result.hits += s.hits;
+    result.misses += s.misses;
+    result.size += s.size;
   }
+  return result;
 }
 
-void server::start_accept() {
-  new_connection_.reset(new connection(
-      io_context_, connection_manager_, resolver_, ca_private_key_,
-      ca_certificate_, domain_certificates_, upstream_ssl_context_,
-      connection_id_++, certificate_generator_,
-      boost::bind(&server::rsa_maker_reschedule, this),
-      boost::bind(&server::rsa_maker_bump, this), callbacks_));
-  acceptor_.async_accept(new_connection_->downstream_socket(),
-                         boost::bind(&server::handle_accept, this,
-                                     boost::asio::placeholders::error));
+connection_ptr server::new_connection(std::size_t shard_index) {
+  return make_connection(shard_index, connection_id_++);
 }
 
-void server::handle_accept(const boost::system::error_code &e) {
-  // Check whether the server was stopped by a signal before this completion
-  // handler had a chance to run.
-  if (!acceptor_.is_open()) {
-    return;
-  }
+connection_ptr server::make_connection(std::size_t shard_index,
+                                       callbacks::connection_id connection_id) {
+  shard &shard = *shards_[shard_index];
+  return boost::allocate_shared<connection>(
+      connection_pool_allocator<connection>(), shard.io_context(),
+      shard.manager(), shard.resolver(), dns_cache_, shard.upstream_pool(),
+      shard.buffer_pool(), certificate_cache_, upstream_ssl_context_,
+      upstream_sessions_, connection_id, certificate_generator_,
+      boost::bind(&server::should_hand_over, this, shard_index),
+      boost::bind(&server::hand_over, this, shard_index,
+                  boost::placeholders::_1),
+      callbacks_, options_.splice_tunnels);
+}
 
-  if (!e) {
-    connection_manager_.start(new_connection_);
+std::size_t server::handover_target(std::size_t shard_index) {
+  if (shards_.size() < 2 || stopped_) {
+    return shards_.size();
+  }
+  if (options_.force_handover_for_testing) {
+    return (shard_index + 1) % shards_.size();
+  }
+  std::int64_t queue_delay = shards_[shard_index]->queue_delay();
+  if (queue_delay < HANDOVER_MIN_QUEUE_DELAY) {
+    return shards_.size();
   }
+  std::size_t target = shards_.size();
+  std::int64_t target_queue_delay = queue_delay;
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    std::int64_t delay = shards_[i]->queue_delay();
+    if (i != shard_index && delay < target_queue_delay) {
+      target = i;
+      target_queue_delay = delay;
+    }
+  }
+  // Move only if it pays off, otherwise connections would bounce between
+  // shards with similar load.
+  if (target_queue_delay * 2 > queue_delay) {
+    return shards_.size();
+  }
+  return target;
+}
 
-  start_accept();
+bool server::should_hand_over(std::size_t shard_index) {
+  return handover_target(shard_index) != shards_.size();
+}
+
+bool server::hand_over(std::size_t shard_index, connection_ptr c) {
+  std::size_t target = handover_target(shard_index);
+  if (target == shards_.size() ||
+      !shards_[shard_index]->take_handover_token()) {
+    return false;
+  }
+  DVLOG(1) << "Handing connection " << c->id() << " over from shard "
+           << shard_index << " to shard " << target << ".";
+  connection_ptr target_connection = make_connection(target, c->id());
+  c->hand_over(*target_connection);
+  shards_[shard_index]->manager().release(c);
+  shards_[target]->adopt(target_connection);
+  return true;
 }
 
 void server::handle_stop() {
   stopped_ = true;
   // The server is stopped by cancelling all outstanding asynchronous
-  // operations. Once all operations have finished the io_context::run() call
+  // operations. Once all operations have finished the io_context::run() calls
   // will exit.
-  acceptor_.close();
-  connection_manager_.stop_all();
-  rsa_maker_timer_.cancel();
+  for (auto &shard : shards_) {
+    shard->stop();
+  }
 }
 
 } // namespace server
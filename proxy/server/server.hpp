@@ -2,78 +2,169 @@
 #define PROXY_SERVER_SERVER_HPP
 
 #include "connection.hpp"
+#include "buffer_pool.hpp"
 #include "connection_manager.hpp"
 #include "proxy/callbacks/callbacks.hpp"
+#include "proxy/cert/certificate_cache.hpp"
 #include "proxy/cert/certificate_generator.hpp"
 #include "proxy/cert/rsa_maker.hpp"
+#include "proxy/dns/dns_cache.hpp"
+#include "proxy/tls/client_sessions.hpp"
+#include "proxy/tls/server_sessions.hpp"
+#include "shard.hpp"
+#include "upstream_pool.hpp"
+#include <atomic>
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
+#include <chrono>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 namespace proxy {
 namespace server {
 
+/// Options controlling how the server is run.
+struct server_options {
+  /// Number of threads, each running its own shard (io_context, acceptor bound
+  /// with SO_REUSEPORT, connection manager and resolver). 0 means one thread
+  /// per hardware thread.
+  std::size_t threads{1};
+
+  /// Pin the thread of the N-th shard to the N-th CPU (Linux only).
+  bool pin_threads{false};
+
+  /// Number of threads generating RSA keys for the certificates of bumped
+  /// hosts.
+  std::size_t rsa_maker_threads{1};
+
+  /// Number of threads minting the certificates of bumped hosts.
+  std::size_t certificate_generator_threads{1};
+
+  /// Number of certificates of bumped hosts kept in memory.
+  std::size_t certificate_cache_size{10000};
+
+  /// How long a session ticket key is used to encrypt new tickets of bumped
+  /// downstream connections. Tickets of the previous key are still accepted.
+  std::chrono::seconds tls_ticket_key_lifetime{std::chrono::hours(1)};
+
+  /// Number of sessions cached per server SSL context of a bumped host.
+  long tls_session_cache_size{256};
+
+  /// Number of origins whose upstream TLS sessions are kept for resumption.
+  std::size_t upstream_tls_session_cache_size{1000};
+
+  /// Upstream TLS sessions are not resumed after this long, or after the
+  /// lifetime set by the origin if shorter.
+  std::chrono::seconds upstream_tls_session_lifetime{std::chrono::hours(1)};
+
+  /// Limits of the idle upstream connections kept by every thread.
+  upstream_pool_options upstream_pool{};
+
+  /// Bytes of free read buffers kept by every thread.
+  std::size_t buffer_pool_size{16 * 1024 * 1024};
+
+  /// Number of host name resolutions kept in memory.
+  std::size_t dns_cache_size{10000};
+
+  /// How long a host name resolution is used. The system resolver does not
+  /// tell the TTLs of the records, so one is set for all.
+  std::chrono::seconds dns_ttl{std::chrono::seconds(60)};
+
+  /// How long a failed host name resolution is remembered.
+  std::chrono::seconds dns_negative_ttl{std::chrono::seconds(5)};
+
+  /// Move the bytes of tunnels which are not bumped from socket to socket with
+  /// splice() (Linux only, ignored elsewhere).
+  bool splice_tunnels{true};
+
+  /// For tests only: hand each connection over to the next shard whenever it
+  /// can be moved, whatever the load of the shards.
+  bool force_handover_for_testing{false};
+};
+
 /// The top-level class of the proxy server.
+///
+/// Note that with more than one thread the callbacks are called concurrently
+/// (for different connections) from all the threads.
 class server : private boost::noncopyable {
 public:
   /// Construct the server to listen on the specified TCP address and port, and
   /// serve up files from the given directory.
   explicit server(const std::string &address, const std::string &port,
-                  callbacks::proxy_callbacks &callbacks);
+                  callbacks::proxy_callbacks &callbacks,
+                  const server_options &options = server_options());
 
-  /// Run the server's io_context loop.
+  /// Run the server's io_context loops, one per thread. Blocks until the server
+  /// is stopped.
   void run();
 
-private:
-  /// Initiate an asynchronous accept operation.
-  void start_accept();
+  /// Hit, miss and eviction counters of the certificate cache.
+  cert::certificate_cache::statistics certificate_cache_statistics() const;
 
-  /// Handle completion of an asynchronous accept operation.
-  void handle_accept(const boost::system::error_code &e);
+  /// Full and resumed handshakes of bumped downstream connections.
+  tls::server_sessions::statistics tls_session_statistics() const;
 
-  /// Handle a request to stop the server.
-  void handle_stop();
+  /// Hit, miss and eviction counters of the upstream TLS session cache.
+  tls::client_sessions::statistics upstream_tls_session_statistics() const;
 
-  void rsa_maker_reschedule();
+  /// Counters of the upstream connection pools of all threads.
+  upstream_pool::statistics upstream_pool_statistics() const;
 
-  void handle_rsa_maker_timer(const boost::system::error_code &e);
+  /// Counters of the read buffer pools of all threads.
+  buffer_pool::statistics buffer_pool_statistics() const;
 
-  void rsa_maker_bump();
+  /// Hit, miss and refresh counters of the DNS cache.
+  dns::dns_cache::statistics dns_cache_statistics() const;
 
-  /// The io_context used to perform asynchronous operations.
-  boost::asio::io_context io_context_;
+private:
+  /// Create a connection to be accepted by the given shard.
+  connection_ptr new_connection(std::size_t shard_index);
 
-  /// The signal_set is used to register for process termination notifications.
-  boost::asio::signal_set signals_;
+  connection_ptr make_connection(std::size_t shard_index,
+                                 callbacks::connection_id connection_id);
 
-  /// Acceptor used to listen for incoming connections.
-  boost::asio::ip::tcp::acceptor acceptor_;
+  /// The shard a connection of the given shard should be handed over to, or
+  /// shards_.size() if the load is balanced well enough.
+  std::size_t handover_target(std::size_t shard_index);
 
-  /// The connection manager which owns all live connections.
-  connection_manager connection_manager_;
+  bool should_hand_over(std::size_t shard_index);
 
-  /// The next connection to be accepted.
-  connection_ptr new_connection_;
+  /// Hand the connection over to the least loaded shard, returns false if it
+  /// should stay where it is.
+  bool hand_over(std::size_t shard_index, connection_ptr c);
 
-  callbacks::connection_id connection_id_ = 0;
+  /// Run the given shard on the calling thread.
+  void run_shard(std::size_t index);
+
+  /// Handle a request to stop the server.
+  void handle_stop();
+
+  server_options options_;
+
+  /// The shards, the first one (main shard) also handles signals.
+  std::vector<std::unique_ptr<shard>> shards_{};
+
+  /// The signal_set is used to register for process termination notifications.
+  boost::shared_ptr<boost::asio::signal_set> signals_;
 
-  boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver_;
+  std::atomic<callbacks::connection_id> connection_id_{0};
 
   std::string ca_private_key_;
   std::string ca_certificate_;
-  std::unordered_map<std::string, boost::tuple<std::string, std::string>>
-      domain_certificates_{};
+  cert::certificate_cache certificate_cache_;
+  dns::dns_cache dns_cache_;
 
+  /// Used by the upstream SSL context, has to outlive it.
+  tls::client_sessions upstream_sessions_;
   boost::asio::ssl::context upstream_ssl_context_;
 
   callbacks::proxy_callbacks &callbacks_;
 
-  cert::rsa_maker rsa_maker_{};
-  cert::certificate_generator certificate_generator_{rsa_maker_};
-  int rsa_maker_counter_{1};
-  bool stopped_{};
-  boost::asio::deadline_timer rsa_maker_timer_;
+  cert::rsa_maker rsa_maker_;
+  tls::server_sessions server_sessions_;
+  cert::certificate_generator certificate_generator_;
+  std::atomic<bool> stopped_{};
 };
 
 } // namespace server
@@ -0,0 +1,168 @@
+#include "shard.hpp"
+#include "proxy/logging/logging.hpp"
+#include <boost/bind/bind.hpp>
+
+namespace proxy {
+namespace server {
+
+#if defined(SO_REUSEPORT)
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    reuse_port;
+#endif // defined(SO_REUSEPORT)
+
+const boost::asio::deadline_timer::duration_type LOAD_PROBE_INTERVAL =
+    boost::posix_time::milliseconds(50);
+
+const int HANDOVERS_PER_LOAD_PROBE = 4;
+
+shard::shard(connection_factory connection_factory,
+             const upstream_pool_options &upstream_pool_options,
+             std::size_t buffer_pool_size)
+    : connection_factory_(connection_factory), io_context_(),
+      acceptor_(io_context_), connection_manager_(), new_connection_(),
+      resolver_(new boost::asio::ip::tcp::resolver(io_context_)),
+      upstream_pool_(io_context_, upstream_pool_options),
+      buffer_pool_(buffer_pool_size),
+      load_probe_timer_(io_context_) {}
+
+boost::asio::io_context &shard::io_context() { return io_context_; }
+
+connection_manager &shard::manager() { return connection_manager_; }
+
+boost::shared_ptr<boost::asio::ip::tcp::resolver> shard::resolver() {
+  return resolver_;
+}
+
+upstream_pool &shard::upstream_pool() { return upstream_pool_; }
+
+buffer_pool &shard::buffer_pool() { return buffer_pool_; }
+
+void shard::listen(const boost::asio::ip::tcp::endpoint &endpoint,
+                   bool reuse_port) {
+  // Open the acceptor with the option to reuse the address (i.e.
+  // SO_REUSEADDR).
+  acceptor_.open(endpoint.protocol());
+  acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#if defined(SO_REUSEPORT)
+  if (reuse_port) {
+    acceptor_.set_option(server::reuse_port(true));
+  }
+#endif // defined(SO_REUSEPORT)
+  acceptor_.set_option(boost::asio::ip::tcp::no_delay(true));
+  acceptor_.bind(endpoint);
+  acceptor_.listen();
+}
+
+boost::asio::ip::tcp::endpoint shard::local_endpoint() {
+  return acceptor_.local_endpoint();
+}
+
+void shard::start_accept() {
+  new_connection_ = connection_factory_();
+  acceptor_.async_accept(new_connection_->downstream_socket(),
+                         boost::bind(&shard::handle_accept, this,
+                                     boost::asio::placeholders::error));
+}
+
+void shard::start_load_probe() { schedule_load_probe(); }
+
+std::int64_t shard::queue_delay() const { return queue_delay_; }
+
+bool shard::take_handover_token() {
+  int tokens = handover_tokens_;
+  while (tokens > 0) {
+    if (handover_tokens_.compare_exchange_weak(tokens, tokens - 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void shard::adopt(connection_ptr c) {
+  boost::asio::post(io_context_, boost::bind(&shard::handle_adopt, this, c));
+}
+
+void shard::run() {
+  // The io_context::run() call will block until all asynchronous operations
+  // have finished. While the shard is running, there is always at least one
+  // asynchronous operation outstanding: the asynchronous accept call waiting
+  // for new incoming connections.
+  for (;;) {
+    try {
+      io_context_.run();
+      break; // run() exited normally
+    } catch (...) {
+      DLOG(ERROR) << "Restarting io_context.run() due to exception.";
+    }
+  }
+}
+
+void shard::stop() {
+  boost::asio::post(io_context_, boost::bind(&shard::handle_stop, this));
+}
+
+void shard::handle_accept(const boost::system::error_code &e) {
+  // Check whether the shard was stopped before this completion handler had a
+  // chance to run.
+  if (!acceptor_.is_open()) {
+    return;
+  }
+
+  if (!e) {
+    connection_manager_.start(new_connection_);
+  }
+
+  start_accept();
+}
+
+void shard::handle_adopt(connection_ptr c) {
+  if (stopped_) {
+    c->stop();
+    return;
+  }
+  connection_manager_.resume(c);
+}
+
+void shard::schedule_load_probe() {
+  load_probe_timer_.expires_from_now(LOAD_PROBE_INTERVAL);
+  load_probe_timer_.async_wait(boost::bind(&shard::handle_load_probe_timer,
+                                           this,
+                                           boost::asio::placeholders::error));
+}
+
+void shard::handle_load_probe_timer(const boost::system::error_code &e) {
+  if (!e && !stopped_) {
+    // The probe waits behind everything already queued, so its delay tells how
+    // deep the queue is.
+    boost::asio::post(io_context_,
+                      boost::bind(&shard::handle_load_probe, this,
+                                  std::chrono::steady_clock::now()));
+  }
+}
+
+void shard::handle_load_probe(std::chrono::steady_clock::time_point posted) {
+  std::int64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - posted)
+                           .count();
+  // Exponential moving average, so that a single slow handler does not trigger
+  // handovers.
+  queue_delay_ = (queue_delay_ * 7 + delay) / 8;
+  handover_tokens_ = HANDOVERS_PER_LOAD_PROBE;
+  if (!stopped_) {
+    schedule_load_probe();
+  }
+}
+
+void shard::handle_stop() {
+  // The shard is stopped by cancelling all outstanding asynchronous
+  // operations. Once all operations have finished the io_context::run() call
+  // will exit.
+  stopped_ = true;
+  acceptor_.close();
+  load_probe_timer_.cancel();
+  connection_manager_.stop_all();
+  upstream_pool_.stop();
+}
+
+} // namespace server
+} // namespace proxy
@@ -0,0 +1,122 @@
+#ifndef PROXY_SERVER_SHARD_HPP
+#define PROXY_SERVER_SHARD_HPP
+
+#include "buffer_pool.hpp"
+#include "connection.hpp"
+#include "connection_manager.hpp"
+#include "upstream_pool.hpp"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <chrono>
+#include <cstdint>
+
+namespace proxy {
+namespace server {
+
+/// One event loop of the proxy server. Every shard owns its io_context,
+/// acceptor, connection manager, resolver, pool of idle upstream connections
+/// and pool of read buffers, and is run by a single thread. A
+/// connection is served by the shard whose acceptor accepted it, unless it is
+/// handed over to a less loaded shard (see connection::hand_over).
+class shard : private boost::noncopyable {
+public:
+  /// Creates connections bound to the io_context, connection manager,
+  /// resolver, upstream pool and buffer pool of the calling shard.
+  typedef boost::function<connection_ptr()> connection_factory;
+
+  shard(connection_factory connection_factory,
+        const upstream_pool_options &upstream_pool_options,
+        std::size_t buffer_pool_size);
+
+  boost::asio::io_context &io_context();
+
+  connection_manager &manager();
+
+  boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver();
+
+  server::upstream_pool &upstream_pool();
+
+  server::buffer_pool &buffer_pool();
+
+  /// Open the acceptor and bind it to the given endpoint. With reuse_port set
+  /// the socket is bound with SO_REUSEPORT, so that acceptors of all shards can
+  /// share the same endpoint and the kernel balances connections between them.
+  void listen(const boost::asio::ip::tcp::endpoint &endpoint, bool reuse_port);
+
+  /// The endpoint the acceptor is bound to.
+  boost::asio::ip::tcp::endpoint local_endpoint();
+
+  /// Initiate an asynchronous accept operation.
+  void start_accept();
+
+  /// Start measuring how long handlers wait in the queue of the io_context.
+  void start_load_probe();
+
+  /// Smoothed time (in microseconds) a handler posted to the shard waits before
+  /// it runs. May be called from any thread.
+  std::int64_t queue_delay() const;
+
+  /// Take one of the few connection handovers allowed per load probe period,
+  /// so that a busy shard does not dump all its connections at once on a shard
+  /// that looked idle a moment ago. May be called from any thread.
+  bool take_handover_token();
+
+  /// Take over a connection handed over by another shard and resume it. May be
+  /// called from any thread.
+  void adopt(connection_ptr c);
+
+  /// Run the shard's io_context loop. Blocks until the shard is stopped.
+  void run();
+
+  /// Stop accepting and stop all connections of the shard. May be called from
+  /// any thread.
+  void stop();
+
+private:
+  /// Handle completion of an asynchronous accept operation.
+  void handle_accept(const boost::system::error_code &e);
+
+  void handle_adopt(connection_ptr c);
+
+  void schedule_load_probe();
+
+  void handle_load_probe_timer(const boost::system::error_code &e);
+
+  void handle_load_probe(std::chrono::steady_clock::time_point posted);
+
+  /// Stop the shard, has to run on the shard's thread.
+  void handle_stop();
+
+  connection_factory connection_factory_;
+
+  /// The io_context used to perform asynchronous operations.
+  boost::asio::io_context io_context_;
+
+  /// Acceptor used to listen for incoming connections.
+  boost::asio::ip::tcp::acceptor acceptor_;
+
+  /// The connection manager which owns all live connections of the shard.
+  connection_manager connection_manager_;
+
+  /// The next connection to be accepted.
+  connection_ptr new_connection_;
+
+  boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver_;
+
+  server::upstream_pool upstream_pool_;
+
+  server::buffer_pool buffer_pool_;
+
+  boost::asio::deadline_timer load_probe_timer_;
+  std::atomic<std::int64_t> queue_delay_{0};
+  std::atomic<int> handover_tokens_{0};
+  bool stopped_{};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_SHARD_HPP
@@ -0,0 +1,70 @@
+#include "tunnel_buffers.hpp"
+#include <algorithm>
+
+namespace proxy {
+namespace server {
+
+tunnel_buffers::tunnel_buffers(buffer_pool &pool, std::size_t high_watermark,
+                               std::size_t low_watermark)
+    : pool_(pool), high_watermark_(high_watermark),
+      low_watermark_(low_watermark),
+      // At least two, otherwise reads would wait for writes again.
+      buffers_(std::max<std::size_t>(
+          2, (high_watermark + buffer_pool::SMALLEST_BUFFER_SIZE - 1) /
+                 buffer_pool::SMALLEST_BUFFER_SIZE)),
+      lengths_(buffers_.size()) {}
+
+bool tunnel_buffers::can_read() const {
+  return !paused_ && filled_ < buffers_.size();
+}
+
+boost::asio::mutable_buffer tunnel_buffers::prepare() {
+  std::string &buffer = buffers_[(first_ + filled_) % buffers_.size()];
+  if (buffer.size() != read_size_) {
+    pool_.release(buffer);
+    buffer = pool_.acquire(read_size_);
+  }
+  return boost::asio::buffer(buffer);
+}
+
+void tunnel_buffers::commit(std::size_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+  std::size_t index = (first_ + filled_) % buffers_.size();
+  lengths_[index] = bytes;
+  read_size_ = buffer_pool::next_read_size(buffers_[index].size(), bytes);
+  filled_++;
+  size_ += bytes;
+  if (size_ >= high_watermark_) {
+    paused_ = true;
+  }
+}
+
+bool tunnel_buffers::can_write() const { return writing_ == 0 && filled_ > 0; }
+
+std::vector<boost::asio::const_buffer> tunnel_buffers::start_write() {
+  std::vector<boost::asio::const_buffer> buffers;
+  for (writing_ = 0; writing_ < filled_; writing_++) {
+    std::size_t index = (first_ + writing_) % buffers_.size();
+    buffers.emplace_back(buffers_[index].data(), lengths_[index]);
+  }
+  return buffers;
+}
+
+void tunnel_buffers::finish_write() {
+  for (; writing_ > 0; writing_--) {
+    size_ -= lengths_[first_];
+    pool_.release(buffers_[first_]);
+    first_ = (first_ + 1) % buffers_.size();
+    filled_--;
+  }
+  if (paused_ && size_ <= low_watermark_) {
+    paused_ = false;
+  }
+}
+
+std::size_t tunnel_buffers::size() const { return size_; }
+
+} // namespace server
+} // namespace proxy
@@ -0,0 +1,69 @@
+#ifndef PROXY_SERVER_TUNNEL_BUFFERS_HPP
+#define PROXY_SERVER_TUNNEL_BUFFERS_HPP
+
+#include "buffer_pool.hpp"
+#include <boost/asio/buffer.hpp>
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace proxy {
+namespace server {
+
+/// Rotating buffers of one direction of a tunnel, so the next read can proceed
+/// while the previous ones are written. The buffers are taken from the pool
+/// when read into and returned once written, their size follows the size of
+/// the reads (see buffer_pool::next_read_size).
+class tunnel_buffers : private boost::noncopyable {
+public:
+  /// Reading stops once high_watermark bytes wait to be written (or all
+  /// buffers are used) and resumes when they drop to low_watermark.
+  tunnel_buffers(buffer_pool &pool, std::size_t high_watermark,
+                 std::size_t low_watermark);
+
+  /// Whether a read may be started.
+  bool can_read() const;
+
+  /// The buffer to read into, requires can_read().
+  boost::asio::mutable_buffer prepare();
+
+  /// Make the bytes read into the prepared buffer available for writing.
+  void commit(std::size_t bytes);
+
+  /// Whether there are bytes to write and no write in progress.
+  bool can_write() const;
+
+  /// All the bytes read so far, to be written at once.
+  std::vector<boost::asio::const_buffer> start_write();
+
+  /// Free the buffers of the finished write.
+  void finish_write();
+
+  /// Bytes waiting to be written (or being written).
+  std::size_t size() const;
+
+private:
+  buffer_pool &pool_;
+  std::size_t read_size_{buffer_pool::SMALLEST_BUFFER_SIZE};
+  std::size_t high_watermark_;
+  std::size_t low_watermark_;
+
+  std::vector<std::string> buffers_;
+
+  /// Bytes read into each buffer.
+  std::vector<std::size_t> lengths_;
+
+  /// The oldest buffer with bytes to write, and how many buffers from it have
+  /// bytes (some of them being written).
+  std::size_t first_{};
+  std::size_t filled_{};
+  std::size_t writing_{};
+
+  std::size_t size_{};
+  bool paused_{};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_TUNNEL_BUFFERS_HPP
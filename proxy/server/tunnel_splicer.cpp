@@ -0,0 +1,114 @@
+#include "tunnel_splicer.hpp"
+#include <boost/bind/bind.hpp>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace proxy {
+namespace server {
+
+/// The default capacity of a pipe.
+const std::size_t SPLICE_CHUNK_SIZE = 64 * 1024;
+
+tunnel_splicer::tunnel_splicer(boost::asio::ip::tcp::socket &source,
+                               boost::asio::ip::tcp::socket &destination)
+    : source_(source), destination_(destination) {}
+
+tunnel_splicer::~tunnel_splicer() {
+#if defined(__linux__)
+  if (pipe_[0] != -1) {
+    ::close(pipe_[0]);
+    ::close(pipe_[1]);
+  }
+#endif
+}
+
+bool tunnel_splicer::open(boost::system::error_code &ec) {
+#if defined(__linux__)
+  if (::pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    ec = boost::system::error_code(errno,
+                                   boost::asio::error::get_system_category());
+    pipe_[0] = pipe_[1] = -1;
+    return false;
+  }
+  // splice() must not block on the sockets either.
+  source_.native_non_blocking(true, ec);
+  if (!ec) {
+    destination_.native_non_blocking(true, ec);
+  }
+  return !ec;
+#else
+  ec = boost::asio::error::operation_not_supported;
+  return false;
+#endif
+}
+
+void tunnel_splicer::async_transfer(transfer_handler handler) {
+  source_.async_wait(boost::asio::ip::tcp::socket::wait_read,
+                     boost::bind(&tunnel_splicer::handle_source_ready, this,
+                                 boost::asio::placeholders::error, handler));
+}
+
+void tunnel_splicer::handle_source_ready(const boost::system::error_code &e,
+                                         transfer_handler handler) {
+  if (e) {
+    handler(e);
+    return;
+  }
+#if defined(__linux__)
+  ssize_t spliced =
+      ::splice(source_.native_handle(), nullptr, pipe_[1], nullptr,
+               SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (spliced == 0) {
+    handler(boost::asio::error::eof);
+  } else if (spliced > 0) {
+    in_pipe_ = spliced;
+    drain_pipe(handler);
+  } else if (errno == EAGAIN || errno == EINTR) {
+    async_transfer(handler);
+  } else {
+    handler(boost::system::error_code(
+        errno, boost::asio::error::get_system_category()));
+  }
+#endif
+}
+
+void tunnel_splicer::drain_pipe(transfer_handler handler) {
+#if defined(__linux__)
+  while (in_pipe_ > 0) {
+    ssize_t spliced =
+        ::splice(pipe_[0], nullptr, destination_.native_handle(), nullptr,
+                 in_pipe_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (spliced > 0) {
+      in_pipe_ -= spliced;
+    } else if (spliced < 0 && (errno == EAGAIN || errno == EINTR)) {
+      destination_.async_wait(
+          boost::asio::ip::tcp::socket::wait_write,
+          boost::bind(&tunnel_splicer::handle_destination_ready, this,
+                      boost::asio::placeholders::error, handler));
+      return;
+    } else {
+      handler(spliced < 0
+                  ? boost::system::error_code(
+                        errno, boost::asio::error::get_system_category())
+                  : boost::asio::error::broken_pipe);
+      return;
+    }
+  }
+#endif
+  handler(boost::system::error_code());
+}
+
+void tunnel_splicer::handle_destination_ready(
+    const boost::system::error_code &e, transfer_handler handler) {
+  if (e) {
+    handler(e);
+    return;
+  }
+  drain_pipe(handler);
+}
+
+} // namespace server
+} // namespace proxy
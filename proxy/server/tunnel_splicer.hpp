@@ -0,0 +1,55 @@
+#ifndef PROXY_SERVER_TUNNEL_SPLICER_HPP
+#define PROXY_SERVER_TUNNEL_SPLICER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace proxy {
+namespace server {
+
+/// Moves the bytes of one direction of a tunnel from a socket to another
+/// through a pipe with splice(2), without copying them to user space. Only
+/// supported on Linux, open() fails elsewhere.
+class tunnel_splicer : private boost::noncopyable {
+public:
+  typedef boost::function<void(const boost::system::error_code &)>
+      transfer_handler;
+
+  /// The sockets have to outlive the splicer.
+  tunnel_splicer(boost::asio::ip::tcp::socket &source,
+                 boost::asio::ip::tcp::socket &destination);
+
+  ~tunnel_splicer();
+
+  /// Create the pipe.
+  bool open(boost::system::error_code &ec);
+
+  /// Wait until the source is readable and move what it has to the
+  /// destination. The handler gets eof once the source is shut down.
+  void async_transfer(transfer_handler handler);
+
+private:
+  void handle_source_ready(const boost::system::error_code &e,
+                           transfer_handler handler);
+
+  /// Write the pipe to the destination, waits if the destination is full.
+  void drain_pipe(transfer_handler handler);
+
+  void handle_destination_ready(const boost::system::error_code &e,
+                                transfer_handler handler);
+
+  boost::asio::ip::tcp::socket &source_;
+  boost::asio::ip::tcp::socket &destination_;
+
+  /// Read and write ends of the pipe.
+  int pipe_[2]{-1, -1};
+
+  /// Bytes moved to the pipe but not to the destination yet.
+  std::size_t in_pipe_{};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_TUNNEL_SPLICER_HPP
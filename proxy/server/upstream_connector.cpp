@@ -0,0 +1,138 @@
+#include "upstream_connector.hpp"
+#include <boost/bind/bind.hpp>
+
+namespace proxy {
+namespace server {
+
+/// RFC 8305 recommends 250 ms.
+const boost::asio::deadline_timer::duration_type CONNECTION_ATTEMPT_DELAY =
+    boost::posix_time::milliseconds(250);
+
+upstream_connector::upstream_connector(
+    boost::asio::io_context &io_context,
+    const std::vector<boost::asio::ip::tcp::endpoint> &endpoints,
+    connect_callback callback)
+    : io_context_(io_context), endpoints_(interleave(endpoints)),
+      callback_(callback), attempt_timer_(io_context) {
+  sockets_.resize(endpoints_.size());
+}
+
+void upstream_connector::start() {
+  if (endpoints_.empty()) {
+    finished_ = true;
+    boost::asio::ip::tcp::socket socket(io_context_);
+    callback_(boost::asio::error::host_not_found, socket);
+    return;
+  }
+  start_attempt();
+}
+
+void upstream_connector::cancel() {
+  finished_ = true;
+  close_attempts();
+}
+
+std::vector<boost::asio::ip::tcp::endpoint> upstream_connector::interleave(
+    const std::vector<boost::asio::ip::tcp::endpoint> &endpoints) {
+  if (endpoints.empty()) {
+    return endpoints;
+  }
+  bool first_v6 = endpoints.front().address().is_v6();
+  std::vector<boost::asio::ip::tcp::endpoint> preferred;
+  std::vector<boost::asio::ip::tcp::endpoint> other;
+  for (const boost::asio::ip::tcp::endpoint &endpoint : endpoints) {
+    if (endpoint.address().is_v6() == first_v6) {
+      preferred.push_back(endpoint);
+    } else {
+      other.push_back(endpoint);
+    }
+  }
+  std::vector<boost::asio::ip::tcp::endpoint> result;
+  for (std::size_t i = 0; i < preferred.size() || i < other.size(); i++) {
+    if (i < preferred.size()) {
+      result.push_back(preferred[i]);
+    }
+    if (i < other.size()) {
+      result.push_back(other[i]);
+    }
+  }
+  return result;
+}
+
+void upstream_connector::start_attempt() {
+  std::size_t attempt = next_endpoint_++;
+  const boost::asio::ip::tcp::endpoint &endpoint = endpoints_[attempt];
+  sockets_[attempt].reset(new boost::asio::ip::tcp::socket(io_context_));
+  boost::asio::ip::tcp::socket &socket = *sockets_[attempt];
+  boost::system::error_code ec;
+  socket.open(endpoint.protocol(), ec);
+  if (!ec) {
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+  }
+  attempts_in_progress_++;
+  if (ec) {
+    boost::asio::post(io_context_,
+                      boost::bind(&upstream_connector::handle_connect,
+                                  shared_from_this(), attempt, ec));
+  } else {
+    socket.async_connect(endpoint,
+                         boost::bind(&upstream_connector::handle_connect,
+                                     shared_from_this(), attempt,
+                                     boost::asio::placeholders::error));
+  }
+
+  if (next_endpoint_ < endpoints_.size()) {
+    // Start the next attempt if this one takes too long.
+    attempt_timer_.expires_from_now(CONNECTION_ATTEMPT_DELAY);
+    attempt_timer_.async_wait(
+        boost::bind(&upstream_connector::handle_attempt_timer,
+                    shared_from_this(), boost::asio::placeholders::error));
+  }
+}
+
+void upstream_connector::handle_attempt_timer(
+    const boost::system::error_code &e) {
+  if (!e && !finished_ && next_endpoint_ < endpoints_.size()) {
+    start_attempt();
+  }
+}
+
+void upstream_connector::handle_connect(std::size_t attempt,
+                                        const boost::system::error_code &e) {
+  attempts_in_progress_--;
+  if (finished_) {
+    return;
+  }
+  if (!e) {
+    finished_ = true;
+    boost::asio::ip::tcp::socket socket(std::move(*sockets_[attempt]));
+    close_attempts();
+    callback_(e, socket);
+    return;
+  }
+  last_error_ = e;
+  boost::system::error_code ignored_ec;
+  sockets_[attempt]->close(ignored_ec);
+  if (next_endpoint_ < endpoints_.size()) {
+    // Do not wait for the timer, a new attempt replaces the failed one.
+    attempt_timer_.cancel();
+    start_attempt();
+  } else if (attempts_in_progress_ == 0) {
+    finished_ = true;
+    boost::asio::ip::tcp::socket socket(io_context_);
+    callback_(last_error_, socket);
+  }
+}
+
+void upstream_connector::close_attempts() {
+  attempt_timer_.cancel();
+  boost::system::error_code ignored_ec;
+  for (std::unique_ptr<boost::asio::ip::tcp::socket> &socket : sockets_) {
+    if (socket) {
+      socket->close(ignored_ec);
+    }
+  }
+}
+
+} // namespace server
+} // namespace proxy
@@ -0,0 +1,71 @@
+#ifndef PROXY_SERVER_UPSTREAM_CONNECTOR_HPP
+#define PROXY_SERVER_UPSTREAM_CONNECTOR_HPP
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <memory>
+#include <vector>
+
+namespace proxy {
+namespace server {
+
+/// Connects to the first reachable endpoint of an upstream host, racing the
+/// endpoints as in RFC 8305 (Happy Eyeballs): the endpoints are interleaved by
+/// address family, a new attempt starts whenever the previous one fails or
+/// takes longer than the attempt delay, the first established connection wins
+/// and the other attempts are cancelled.
+class upstream_connector
+    : public boost::enable_shared_from_this<upstream_connector>,
+      private boost::noncopyable {
+public:
+  /// Called once with the connected socket (to be moved from) or the error of
+  /// the last attempt. Not called after cancel().
+  typedef boost::function<void(const boost::system::error_code &,
+                               boost::asio::ip::tcp::socket &)>
+      connect_callback;
+
+  upstream_connector(
+      boost::asio::io_context &io_context,
+      const std::vector<boost::asio::ip::tcp::endpoint> &endpoints,
+      connect_callback callback);
+
+  void start();
+
+  /// Abort all attempts.
+  void cancel();
+
+  /// Reorder the endpoints to alternate between the address families, starting
+  /// with the family of the first one.
+  static std::vector<boost::asio::ip::tcp::endpoint>
+  interleave(const std::vector<boost::asio::ip::tcp::endpoint> &endpoints);
+
+private:
+  void start_attempt();
+
+  void handle_attempt_timer(const boost::system::error_code &e);
+
+  void handle_connect(std::size_t attempt, const boost::system::error_code &e);
+
+  /// Close the sockets of all attempts in progress and stop the timer.
+  void close_attempts();
+
+  boost::asio::io_context &io_context_;
+  std::vector<boost::asio::ip::tcp::endpoint> endpoints_;
+  connect_callback callback_;
+
+  /// Sockets of the attempts, by endpoint index.
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> sockets_{};
+  std::size_t next_endpoint_{};
+  std::size_t attempts_in_progress_{};
+  boost::asio::deadline_timer attempt_timer_;
+  boost::system::error_code last_error_{};
+  bool finished_{};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_UPSTREAM_CONNECTOR_HPP
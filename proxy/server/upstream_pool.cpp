@@ -0,0 +1,211 @@
+#include "upstream_pool.hpp"
+#include "proxy/tls/client_sessions.hpp"
+#include <boost/bind/bind.hpp>
+#include <iterator>
+
+namespace proxy {
+namespace server {
+
+const boost::asio::deadline_timer::duration_type IDLE_SWEEP_INTERVAL =
+    boost::posix_time::seconds(1);
+
+upstream_pool::upstream_pool(boost::asio::io_context &io_context,
+                             const upstream_pool_options &options)
+    : io_context_(io_context), options_(options), sweep_timer_(io_context) {}
+
+void upstream_pool::release(const std::string &host,
+                            const std::string &service,
+                            boost::asio::ip::tcp::socket &socket) {
+  if (stopped_) {
+    boost::system::error_code ignored_ec;
+    socket.close(ignored_ec);
+    return;
+  }
+  insert(idle_connection{
+      .origin = origin(host, service, false),
+      .socket = boost::asio::ip::tcp::socket(std::move(socket)),
+      .ssl_socket = ssl_socket_ptr(),
+      .expires = std::chrono::steady_clock::now() + options_.idle_timeout});
+}
+
+void upstream_pool::release(const std::string &host,
+                            const std::string &service,
+                            ssl_socket_ptr ssl_socket) {
+  if (stopped_) {
+    return;
+  }
+  insert(idle_connection{
+      .origin = origin(host, service, true),
+      .socket = boost::asio::ip::tcp::socket(io_context_),
+      .ssl_socket = ssl_socket,
+      .expires = std::chrono::steady_clock::now() + options_.idle_timeout});
+}
+
+bool upstream_pool::acquire(const std::string &host,
+                            const std::string &service,
+                            boost::asio::ip::tcp::socket &socket) {
+  idle_list::iterator it = find(origin(host, service, false));
+  if (it == idle_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  socket = std::move(it->socket);
+  erase(it);
+  return true;
+}
+
+bool upstream_pool::acquire(const std::string &host,
+                            const std::string &service,
+                            ssl_socket_ptr &ssl_socket) {
+  idle_list::iterator it = find(origin(host, service, true));
+  if (it == idle_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  ssl_socket = std::move(it->ssl_socket);
+  erase(it);
+  return true;
+}
+
+void upstream_pool::stop() {
+  stopped_ = true;
+  sweep_timer_.cancel();
+  for (idle_connection &connection : idle_) {
+    close(connection);
+  }
+  idle_.clear();
+  idle_per_origin_.clear();
+  size_ = 0;
+}
+
+upstream_pool::statistics upstream_pool::get_statistics() const {
+  return statistics{.hits = hits_,
+                    .misses = misses_,
+                    .stale = stale_,
+                    .expired = expired_,
+                    .evictions = evictions_,
+                    .size = size_};
+}
+
+std::string upstream_pool::origin(const std::string &host,
+                                  const std::string &service, bool ssl) {
+  return (ssl ? "https://" : "http://") + host + ':' + service;
+}
+
+boost::asio::ip::tcp::socket &
+upstream_pool::socket(idle_connection &connection) {
+  if (connection.ssl_socket) {
+    return connection.ssl_socket->next_layer();
+  }
+  return connection.socket;
+}
+
+bool upstream_pool::is_alive(boost::asio::ip::tcp::socket &socket) {
+  boost::system::error_code ec;
+  char byte;
+  socket.non_blocking(true, ec);
+  if (ec) {
+    return false;
+  }
+  socket.receive(boost::asio::buffer(&byte, 1),
+                 boost::asio::ip::tcp::socket::message_peek, ec);
+  bool alive = ec == boost::asio::error::would_block;
+  socket.non_blocking(false, ec);
+  return alive;
+}
+
+void upstream_pool::close(idle_connection &connection) {
+  tls::keep_session_resumable(connection.ssl_socket);
+  boost::system::error_code ignored_ec;
+  socket(connection).close(ignored_ec);
+}
+
+void upstream_pool::insert(idle_connection connection) {
+  if (options_.max_idle == 0 || options_.max_idle_per_origin == 0) {
+    return;
+  }
+  if (idle_per_origin_[connection.origin] >= options_.max_idle_per_origin) {
+    // Replace the oldest connection to the origin.
+    for (idle_list::reverse_iterator it = idle_.rbegin(); it != idle_.rend();
+         ++it) {
+      if (it->origin == connection.origin) {
+        erase(std::prev(it.base()));
+        evictions_++;
+        break;
+      }
+    }
+  }
+  idle_per_origin_[connection.origin]++;
+  idle_.push_front(std::move(connection));
+  size_++;
+  if (idle_.size() > options_.max_idle) {
+    erase(std::prev(idle_.end()));
+    evictions_++;
+  }
+  schedule_sweep();
+}
+
+upstream_pool::idle_list::iterator
+upstream_pool::find(const std::string &origin) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  idle_list::iterator it = idle_.begin();
+  while (it != idle_.end()) {
+    if (it->origin != origin) {
+      ++it;
+    } else if (it->expires <= now) {
+      expired_++;
+      it = erase(it);
+    } else if (!is_alive(socket(*it))) {
+      stale_++;
+      it = erase(it);
+    } else {
+      return it;
+    }
+  }
+  return it;
+}
+
+upstream_pool::idle_list::iterator
+upstream_pool::erase(idle_list::iterator it) {
+  std::unordered_map<std::string, std::size_t>::iterator count_it =
+      idle_per_origin_.find(it->origin);
+  if (count_it != idle_per_origin_.end() && --count_it->second == 0) {
+    idle_per_origin_.erase(count_it);
+  }
+  size_--;
+  close(*it);
+  return idle_.erase(it);
+}
+
+void upstream_pool::schedule_sweep() {
+  if (sweeping_ || idle_.empty()) {
+    return;
+  }
+  sweeping_ = true;
+  sweep_timer_.expires_from_now(IDLE_SWEEP_INTERVAL);
+  sweep_timer_.async_wait(boost::bind(&upstream_pool::handle_sweep_timer, this,
+                                      boost::asio::placeholders::error));
+}
+
+void upstream_pool::handle_sweep_timer(const boost::system::error_code &e) {
+  sweeping_ = false;
+  if (e || stopped_) {
+    return;
+  }
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  idle_list::iterator it = idle_.begin();
+  while (it != idle_.end()) {
+    if (it->expires <= now) {
+      expired_++;
+      it = erase(it);
+    } else {
+      ++it;
+    }
+  }
+  schedule_sweep();
+}
+
+} // namespace server
+} // namespace proxy
@@ -0,0 +1,134 @@
+#ifndef PROXY_SERVER_UPSTREAM_POOL_HPP
+#define PROXY_SERVER_UPSTREAM_POOL_HPP
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace proxy {
+namespace server {
+
+struct upstream_pool_options {
+  /// Number of idle upstream connections kept per thread.
+  std::size_t max_idle{256};
+
+  /// Number of idle upstream connections kept per origin (host, port and TLS)
+  /// and thread.
+  std::size_t max_idle_per_origin{8};
+
+  /// Idle upstream connections are closed after this long.
+  std::chrono::seconds idle_timeout{std::chrono::seconds(30)};
+};
+
+/// Idle keep-alive upstream connections of one shard, to be reused by any
+/// connection of the shard going to the same origin. TLS connections are kept
+/// together with their (owning) SSL stream. Connections closed by the origin or
+/// with unexpected data pending are detected and dropped when taken, idle ones
+/// are closed after a timeout. Not thread-safe, only the statistics may be read
+/// from other threads.
+class upstream_pool : private boost::noncopyable {
+public:
+  typedef boost::shared_ptr<
+      boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>
+      ssl_socket_ptr;
+
+  struct statistics {
+    std::uint64_t hits{};
+    std::uint64_t misses{};
+    std::uint64_t stale{};
+    std::uint64_t expired{};
+    std::uint64_t evictions{};
+    std::size_t size{};
+  };
+
+  upstream_pool(boost::asio::io_context &io_context,
+                const upstream_pool_options &options);
+
+  /// Keep the idle plain connection to the origin, the socket is moved from.
+  void release(const std::string &host, const std::string &service,
+               boost::asio::ip::tcp::socket &socket);
+
+  /// Keep the idle TLS connection to the origin.
+  void release(const std::string &host, const std::string &service,
+               ssl_socket_ptr ssl_socket);
+
+  /// Move an idle plain connection to the origin into the socket, returns false
+  /// if there is none.
+  bool acquire(const std::string &host, const std::string &service,
+               boost::asio::ip::tcp::socket &socket);
+
+  /// Take an idle TLS connection to the origin, returns false if there is none.
+  bool acquire(const std::string &host, const std::string &service,
+               ssl_socket_ptr &ssl_socket);
+
+  /// Close all idle connections and stop keeping new ones.
+  void stop();
+
+  statistics get_statistics() const;
+
+private:
+  struct idle_connection {
+    std::string origin;
+    boost::asio::ip::tcp::socket socket;
+    ssl_socket_ptr ssl_socket;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  /// Most recently released first.
+  typedef std::list<idle_connection> idle_list;
+
+  static std::string origin(const std::string &host, const std::string &service,
+                            bool ssl);
+
+  /// The underlying socket of the connection.
+  static boost::asio::ip::tcp::socket &socket(idle_connection &connection);
+
+  /// An idle connection has nothing to read, otherwise the origin closed it or
+  /// sent something unexpected.
+  static bool is_alive(boost::asio::ip::tcp::socket &socket);
+
+  /// Close the connection, keeping its TLS session resumable.
+  static void close(idle_connection &connection);
+
+  /// Keep the connection (socket or ssl_socket set) as the most recent one.
+  void insert(idle_connection connection);
+
+  /// Find a live idle connection to the origin, idle_.end() if there is none.
+  idle_list::iterator find(const std::string &origin);
+
+  idle_list::iterator erase(idle_list::iterator it);
+
+  void schedule_sweep();
+
+  /// Close the connections idle for too long.
+  void handle_sweep_timer(const boost::system::error_code &e);
+
+  boost::asio::io_context &io_context_;
+  upstream_pool_options options_;
+
+  idle_list idle_{};
+  std::unordered_map<std::string, std::size_t> idle_per_origin_{};
+
+  boost::asio::deadline_timer sweep_timer_;
+  bool sweeping_{};
+  bool stopped_{};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> stale_{0};
+  std::atomic<std::uint64_t> expired_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+} // namespace server
+} // namespace proxy
+
+#endif // PROXY_SERVER_UPSTREAM_POOL_HPP
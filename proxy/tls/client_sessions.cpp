@@ -0,0 +1,154 @@
+#include "client_sessions.hpp"
+#include <algorithm>
+
+namespace proxy {
+namespace tls {
+
+namespace {
+/// Servers usually send a couple of TLS 1.3 tickets per connection, keep a few
+/// for concurrent connections to the same origin.
+const std::size_t MAX_SESSIONS_PER_ORIGIN = 4;
+} // namespace
+
+client_sessions::client_sessions(std::size_t capacity,
+                                 std::chrono::seconds max_lifetime)
+    : capacity_(capacity), max_lifetime_(max_lifetime) {}
+
+bool client_sessions::setup(boost::asio::ssl::context &ssl_context) {
+  SSL_CTX *ctx = ssl_context.native_handle();
+  if (!SSL_CTX_set_ex_data(ctx, ctx_ex_data_index(), this)) {
+    return false;
+  }
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                          SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, &client_sessions::new_session_callback);
+  return true;
+}
+
+void client_sessions::attach(SSL *ssl, const std::string &host,
+                             const std::string &service) {
+  std::string *origin = new std::string(host + ':' + service);
+  if (!SSL_set_ex_data(ssl, ssl_ex_data_index(), origin)) {
+    delete origin;
+    return;
+  }
+  SSL_SESSION_ptr ssl_session = take(*origin);
+  if (ssl_session) {
+    SSL_set_session(ssl, ssl_session.get());
+  }
+}
+
+client_sessions::statistics client_sessions::get_statistics() const {
+  return statistics{.hits = hits_,
+                    .misses = misses_,
+                    .stored = stored_,
+                    .evictions = evictions_,
+                    .size = size_};
+}
+
+int client_sessions::new_session_callback(SSL *ssl, SSL_SESSION *ssl_session) {
+  client_sessions *sessions = static_cast<client_sessions *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctx_ex_data_index()));
+  const std::string *origin = static_cast<const std::string *>(
+      SSL_get_ex_data(ssl, ssl_ex_data_index()));
+  if (sessions == nullptr || origin == nullptr ||
+      !SSL_SESSION_is_resumable(ssl_session)) {
+    return 0;
+  }
+  // Returning 1 keeps the reference to the session.
+  sessions->store(*origin, SSL_SESSION_ptr(ssl_session, SSL_SESSION_free));
+  return 1;
+}
+
+void client_sessions::free_origin(void * /*parent*/, void *ptr,
+                                  CRYPTO_EX_DATA * /*ad*/, int /*index*/,
+                                  long /*argl*/, void * /*argp*/) {
+  delete static_cast<std::string *>(ptr);
+}
+
+int client_sessions::ctx_ex_data_index() {
+  static int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+int client_sessions::ssl_ex_data_index() {
+  static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                          &client_sessions::free_origin);
+  return index;
+}
+
+SSL_SESSION_ptr client_sessions::take(const std::string &origin) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<std::string, lru_list::iterator>::iterator it =
+      index_.find(origin);
+  if (it == index_.end()) {
+    misses_++;
+    return SSL_SESSION_ptr(nullptr, SSL_SESSION_free);
+  }
+  origin_sessions &sessions = it->second->second;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  sessions.erase(std::remove_if(sessions.begin(), sessions.end(),
+                                [now](const session &s) {
+                                  return s.expires <= now;
+                                }),
+                 sessions.end());
+  if (sessions.empty()) {
+    entries_.erase(it->second);
+    index_.erase(it);
+    size_--;
+    misses_++;
+    return SSL_SESSION_ptr(nullptr, SSL_SESSION_free);
+  }
+  hits_++;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  session &newest = sessions.back();
+  if (SSL_SESSION_get_protocol_version(newest.ssl_session.get()) >=
+      TLS1_3_VERSION) {
+    // TLS 1.3 tickets should not be reused, the resumed connection gets new
+    // ones.
+    SSL_SESSION_ptr result = std::move(newest.ssl_session);
+    sessions.pop_back();
+    return result;
+  }
+  SSL_SESSION_up_ref(newest.ssl_session.get());
+  return SSL_SESSION_ptr(newest.ssl_session.get(), SSL_SESSION_free);
+}
+
+void client_sessions::store(const std::string &origin,
+                            SSL_SESSION_ptr ssl_session) {
+  std::chrono::seconds lifetime =
+      std::min(max_lifetime_, std::chrono::seconds(SSL_SESSION_get_timeout(
+                                  ssl_session.get())));
+  std::lock_guard<std::mutex> lock(mutex_);
+  origin_sessions &sessions = touch(origin);
+  sessions.push_back(session{std::move(ssl_session),
+                             std::chrono::steady_clock::now() + lifetime});
+  if (sessions.size() > MAX_SESSIONS_PER_ORIGIN) {
+    sessions.pop_front();
+  }
+  stored_++;
+}
+
+client_sessions::origin_sessions &
+client_sessions::touch(const std::string &origin) {
+  std::unordered_map<std::string, lru_list::iterator>::iterator it =
+      index_.find(origin);
+  if (it != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+  entries_.emplace_front(origin, origin_sessions());
+  index_[origin] = entries_.begin();
+  size_++;
+  if (entries_.size() > capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+    size_--;
+    evictions_++;
+  }
+  return entries_.front().second;
+}
+
+} // namespace tls
+} // namespace proxy
@@ -0,0 +1,112 @@
+#ifndef PROXY_TLS_CLIENT_SESSIONS_HPP
+#define PROXY_TLS_CLIENT_SESSIONS_HPP
+
+#include <atomic>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace proxy {
+namespace tls {
+
+typedef std::unique_ptr<SSL_SESSION, decltype(&SSL_SESSION_free)>
+    SSL_SESSION_ptr;
+
+/// Session resumption for upstream connections. Sessions (TLS 1.2 sessions and
+/// TLS 1.3 tickets, which may arrive after the handshake) are stored per origin
+/// (host:service) in a bounded cache, safe to use from multiple threads. Least
+/// recently used origins are evicted first, expired sessions are dropped.
+/// TLS 1.3 tickets are used once, TLS 1.2 sessions until they expire.
+class client_sessions : private boost::noncopyable {
+public:
+  struct statistics {
+    std::uint64_t hits{};
+    std::uint64_t misses{};
+    std::uint64_t stored{};
+    std::uint64_t evictions{};
+    std::size_t size{};
+  };
+
+  /// Keep sessions of at most capacity (positive) origins, none longer than
+  /// max_lifetime.
+  explicit client_sessions(
+      std::size_t capacity = 1000,
+      std::chrono::seconds max_lifetime = std::chrono::hours(1));
+
+  /// Set up the client SSL context to hand new sessions to the cache.
+  bool setup(boost::asio::ssl::context &ssl_context);
+
+  /// Offer a cached session of the origin (if any) to the connection before
+  /// its handshake, and store the sessions it gets under the origin.
+  void attach(SSL *ssl, const std::string &host, const std::string &service);
+
+  statistics get_statistics() const;
+
+private:
+  struct session {
+    SSL_SESSION_ptr ssl_session;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  /// Sessions of an origin, newest last.
+  typedef std::deque<session> origin_sessions;
+
+  /// Most recently used first.
+  typedef std::list<std::pair<std::string, origin_sessions>> lru_list;
+
+  static int new_session_callback(SSL *ssl, SSL_SESSION *ssl_session);
+
+  static void free_origin(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                          int index, long argl, void *argp);
+
+  /// Index of the pointer to client_sessions in SSL_CTX ex data.
+  static int ctx_ex_data_index();
+
+  /// Index of the origin (owned std::string) in SSL ex data.
+  static int ssl_ex_data_index();
+
+  /// A session of the origin to resume, null if there is none.
+  SSL_SESSION_ptr take(const std::string &origin);
+
+  void store(const std::string &origin, SSL_SESSION_ptr ssl_session);
+
+  /// Move the origin to the front, creating it if needed.
+  origin_sessions &touch(const std::string &origin);
+
+  std::size_t capacity_;
+  std::chrono::seconds max_lifetime_;
+
+  std::mutex mutex_{};
+  lru_list entries_{};
+  std::unordered_map<std::string, lru_list::iterator> index_{};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> stored_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+/// Mark the SSL stream (if any) as shut down before it is closed or freed, so
+/// that the session stays resumable: without close_notify OpenSSL drops the
+/// session from the cache (and marks it not resumable) when the SSL is freed.
+template <typename SslSocketPtr>
+void keep_session_resumable(const SslSocketPtr &ssl_socket) {
+  if (ssl_socket && SSL_is_init_finished(ssl_socket->native_handle())) {
+    SSL_set_shutdown(ssl_socket->native_handle(),
+                     SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  }
+}
+
+} // namespace tls
+} // namespace proxy
+
+#endif // PROXY_TLS_CLIENT_SESSIONS_HPP
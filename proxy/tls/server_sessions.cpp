@@ -0,0 +1,153 @@
+#include "server_sessions.hpp"
+#include <cstring>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+namespace proxy {
+namespace tls {
+
+server_sessions::server_sessions(std::chrono::seconds ticket_key_lifetime,
+                                 long cache_size)
+    : ticket_key_lifetime_(ticket_key_lifetime), cache_size_(cache_size) {}
+
+bool server_sessions::setup(boost::asio::ssl::context &ssl_context,
+                            const std::string &host) {
+  SSL_CTX *ctx = ssl_context.native_handle();
+
+  // The session id context has limited length, use a digest of the host.
+  unsigned char session_id_context[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char *>(host.data()), host.length(),
+         session_id_context);
+  if (!SSL_CTX_set_session_id_context(ctx, session_id_context,
+                                      sizeof(session_id_context))) {
+    return false;
+  }
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx, cache_size_);
+  SSL_CTX_set_timeout(ctx, ticket_key_lifetime_.count());
+  if (!SSL_CTX_set_ex_data(ctx, ex_data_index(), this)) {
+    return false;
+  }
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx, &server_sessions::ticket_key_callback);
+  SSL_CTX_set_info_callback(ctx, &server_sessions::info_callback);
+  return true;
+}
+
+server_sessions::statistics server_sessions::get_statistics() const {
+  return statistics{.handshakes = handshakes_, .resumed = resumed_};
+}
+
+int server_sessions::ticket_key_callback(SSL *ssl, unsigned char *key_name,
+                                         unsigned char *iv,
+                                         EVP_CIPHER_CTX *cipher_ctx,
+                                         HMAC_CTX *hmac_ctx, int encrypt) {
+  server_sessions *sessions = from(ssl);
+  if (sessions == nullptr) {
+    return -1;
+  }
+  if (encrypt) {
+    return sessions->encrypt_ticket(key_name, iv, cipher_ctx, hmac_ctx);
+  }
+  return sessions->decrypt_ticket(key_name, iv, cipher_ctx, hmac_ctx);
+}
+
+void server_sessions::info_callback(const SSL *ssl, int where,
+                                    int /*ret*/) {
+  if (where & SSL_CB_HANDSHAKE_DONE) {
+    server_sessions *sessions = from(ssl);
+    if (sessions != nullptr) {
+      sessions->handshakes_++;
+      if (SSL_session_reused(const_cast<SSL *>(ssl))) {
+        sessions->resumed_++;
+      }
+    }
+  }
+}
+
+server_sessions *server_sessions::from(const SSL *ssl) {
+  return static_cast<server_sessions *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_data_index()));
+}
+
+int server_sessions::ex_data_index() {
+  static int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+int server_sessions::encrypt_ticket(unsigned char *key_name, unsigned char *iv,
+                                    EVP_CIPHER_CTX *cipher_ctx,
+                                    HMAC_CTX *hmac_ctx) {
+  ticket_key key;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_current_key_ || std::chrono::steady_clock::now() -
+                                     current_key_.created >=
+                                 ticket_key_lifetime_) {
+      ticket_key new_key;
+      if (!generate_key(new_key)) {
+        return -1;
+      }
+      previous_key_ = current_key_;
+      has_previous_key_ = has_current_key_;
+      current_key_ = new_key;
+      has_current_key_ = true;
+    }
+    key = current_key_;
+  }
+
+  std::memcpy(key_name, key.name, sizeof(key.name));
+  if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+    return -1;
+  }
+  if (!EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key,
+                          iv) ||
+      !HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(),
+                    nullptr)) {
+    return -1;
+  }
+  return 1;
+}
+
+int server_sessions::decrypt_ticket(const unsigned char *key_name,
+                                    const unsigned char *iv,
+                                    EVP_CIPHER_CTX *cipher_ctx,
+                                    HMAC_CTX *hmac_ctx) {
+  ticket_key key;
+  bool renew;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (has_current_key_ && std::memcmp(key_name, current_key_.name,
+                                        sizeof(current_key_.name)) == 0) {
+      key = current_key_;
+      renew = false;
+    } else if (has_previous_key_ &&
+               std::memcmp(key_name, previous_key_.name,
+                           sizeof(previous_key_.name)) == 0) {
+      key = previous_key_;
+      renew = true;
+    } else {
+      // Unknown or expired key, do a full handshake.
+      return 0;
+    }
+  }
+
+  if (!HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(),
+                    nullptr) ||
+      !EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key,
+                          iv)) {
+    return -1;
+  }
+  // Ask for a ticket encrypted with the current key.
+  return renew ? 2 : 1;
+}
+
+bool server_sessions::generate_key(ticket_key &key) {
+  key.created = std::chrono::steady_clock::now();
+  return RAND_bytes(key.name, sizeof(key.name)) == 1 &&
+         RAND_bytes(key.aes_key, sizeof(key.aes_key)) == 1 &&
+         RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) == 1;
+}
+
+} // namespace tls
+} // namespace proxy
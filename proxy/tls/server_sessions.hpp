@@ -0,0 +1,81 @@
+#ifndef PROXY_TLS_SERVER_SESSIONS_HPP
+#define PROXY_TLS_SERVER_SESSIONS_HPP
+
+#include <atomic>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace proxy {
+namespace tls {
+
+/// Session resumption for bumped downstream connections. Every server SSL
+/// context of a bumped host gets a session cache, and session tickets
+/// encrypted with keys shared by all the contexts (and so by all the threads).
+/// The ticket keys are rotated periodically, tickets encrypted with the
+/// previous key are still accepted (and renewed). Counts full and resumed
+/// handshakes.
+class server_sessions : private boost::noncopyable {
+public:
+  struct statistics {
+    std::uint64_t handshakes{};
+    std::uint64_t resumed{};
+  };
+
+  explicit server_sessions(
+      std::chrono::seconds ticket_key_lifetime = std::chrono::hours(1),
+      long cache_size = 256);
+
+  /// Set up session resumption in the server SSL context of the host.
+  bool setup(boost::asio::ssl::context &ssl_context, const std::string &host);
+
+  statistics get_statistics() const;
+
+private:
+  struct ticket_key {
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+    std::chrono::steady_clock::time_point created{};
+  };
+
+  static int ticket_key_callback(SSL *ssl, unsigned char *key_name,
+                                 unsigned char *iv, EVP_CIPHER_CTX *cipher_ctx,
+                                 HMAC_CTX *hmac_ctx, int encrypt);
+
+  static void info_callback(const SSL *ssl, int where, int ret);
+
+  static server_sessions *from(const SSL *ssl);
+
+  /// Index of the pointer to server_sessions in SSL_CTX ex data.
+  static int ex_data_index();
+
+  int encrypt_ticket(unsigned char *key_name, unsigned char *iv,
+                     EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx);
+
+  int decrypt_ticket(const unsigned char *key_name, const unsigned char *iv,
+                     EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx);
+
+  bool generate_key(ticket_key &key);
+
+  std::chrono::seconds ticket_key_lifetime_;
+  long cache_size_;
+
+  /// Guards the ticket keys.
+  std::mutex mutex_{};
+  ticket_key current_key_{};
+  ticket_key previous_key_{};
+  bool has_current_key_{};
+  bool has_previous_key_{};
+
+  std::atomic<std::uint64_t> handshakes_{0};
+  std::atomic<std::uint64_t> resumed_{0};
+};
+
+} // namespace tls
+} // namespace proxy
+
+#endif // PROXY_TLS_SERVER_SESSIONS_HPP
@@ -0,0 +1,80 @@
+#include "arena.hpp"
+#include <cstring>
+#include <utility>
+
+namespace proxy {
+namespace util {
+
+arena::arena(arena &&other) noexcept
+    : blocks_(std::move(other.blocks_)), next_(other.next_),
+      left_(other.left_) {
+  other.release();
+}
+
+arena &arena::operator=(arena &&other) noexcept {
+  if (this != &other) {
+    blocks_ = std::move(other.blocks_);
+    next_ = other.next_;
+    left_ = other.left_;
+    other.release();
+  }
+  return *this;
+}
+
+std::string_view arena::store(std::string_view value) {
+  std::size_t size = value.size();
+  if (size == 0) {
+    return {};
+  }
+  char *destination = allocate(size);
+  std::memcpy(destination, value.data(), size);
+  return std::string_view(destination, size);
+}
+
+char *arena::allocate(std::size_t size) {
+  char *destination;
+  if (size <= left_) {
+    destination = next_;
+    next_ += size;
+    left_ -= size;
+  } else if (size > block_size / 4) {
+    blocks_.emplace_back(new char[size]);
+    destination = blocks_.back().get();
+  } else {
+    blocks_.emplace_back(new char[block_size]);
+    destination = blocks_.back().get();
+    next_ = destination + size;
+    left_ = block_size - size;
+  }
+  return destination;
+}
+
+void arena::clear() {
+  // Blocks of big values never become the current block.
+  char *current = next_ != nullptr ? next_ + left_ - block_size : nullptr;
+  std::unique_ptr<char[]> kept;
+  for (std::unique_ptr<char[]> &block : blocks_) {
+    if (block.get() == current) {
+      kept = std::move(block);
+      break;
+    }
+  }
+  blocks_.clear();
+  if (kept) {
+    blocks_.push_back(std::move(kept));
+    next_ = current;
+    left_ = block_size;
+  } else {
+    next_ = nullptr;
+    left_ = 0;
+  }
+}
+
+void arena::release() {
+  std::vector<std::unique_ptr<char[]>>().swap(blocks_);
+  next_ = nullptr;
+  left_ = 0;
+}
+
+} // namespace util
+} // namespace proxy
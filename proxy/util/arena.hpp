@@ -0,0 +1,51 @@
+#ifndef PROXY_UTIL_ARENA_HPP
+#define PROXY_UTIL_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace proxy {
+namespace util {
+
+/// Memory for the strings of one message, e.g. its header names and values,
+/// allocated in blocks and freed all at once. Stored strings never move, so
+/// views into them stay valid until the arena is cleared or destroyed, also
+/// when the arena itself is moved.
+class arena {
+public:
+  arena() = default;
+  arena(arena &&other) noexcept;
+  arena &operator=(arena &&other) noexcept;
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  /// Copy value into the arena and return a view of the copy.
+  std::string_view store(std::string_view value);
+
+  /// Uninitialized memory of size bytes, size must not be 0.
+  char *allocate(std::size_t size);
+
+  /// Forget the stored values, invalidating the views returned so far. The
+  /// current block is kept for the next values, the others are freed.
+  void clear();
+
+  /// Free all blocks, invalidating the views returned so far.
+  void release();
+
+private:
+  /// Fits the pre body of a typical message. Values bigger than a quarter of a
+  /// block get a block of their own so that they do not waste the rest of the
+  /// current one.
+  static constexpr std::size_t block_size = 4096;
+
+  std::vector<std::unique_ptr<char[]>> blocks_{};
+  char *next_{nullptr};
+  std::size_t left_{0};
+};
+
+} // namespace util
+} // namespace proxy
+
+#endif // PROXY_UTIL_ARENA_HPP
@@ -156,6 +156,14 @@ std::string to_lowercase(std::string value) {
   return result;
 }
 
+bool consume_prefix(boost::string_view &source, boost::string_view prefix) {
+  if (!source.starts_with(prefix)) {
+    return false;
+  }
+  source.remove_prefix(prefix.size());
+  return true;
+}
+
 } // namespace misc_strings
 
 } // namespace util
@@ -57,6 +57,10 @@ std::string urlencode(boost::string_view source);
 
 std::string to_lowercase(std::string value);
 
+/// If source starts with prefix, remove the prefix from source and return true,
+/// otherwise return false and leave source unchanged.
+bool consume_prefix(boost::string_view &source, boost::string_view prefix);
+
 } // namespace misc_strings
 
 } // namespace util
@@ -0,0 +1,144 @@
+#ifndef PROXY_UTIL_UNIQUE_FUNCTION_HPP
+#define PROXY_UTIL_UNIQUE_FUNCTION_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace proxy {
+namespace util {
+
+template <typename Signature> class unique_function;
+
+/// Move-only function wrapper keeping callables of up to buffer_size bytes
+/// (e.g. a member function bound with a shared_ptr and a few arguments) in
+/// place, so passing them around does not allocate. Bigger callables are
+/// allocated as with boost::function.
+template <typename R, typename... Args> class unique_function<R(Args...)> {
+public:
+  static constexpr std::size_t buffer_size = 8 * sizeof(void *);
+
+  unique_function() noexcept = default;
+
+  unique_function(std::nullptr_t) noexcept {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, unique_function>::value>::type>
+  unique_function(F &&f) {
+    typedef typename std::decay<F>::type function_type;
+    if constexpr (fits_in_place<function_type>::value) {
+      new (&storage_) function_type(std::forward<F>(f));
+      operations_ = &in_place_operations<function_type>::value;
+    } else {
+      *reinterpret_cast<function_type **>(&storage_) =
+          new function_type(std::forward<F>(f));
+      operations_ = &allocated_operations<function_type>::value;
+    }
+  }
+
+  unique_function(unique_function &&other) noexcept
+      : operations_(other.operations_) {
+    if (operations_) {
+      operations_->move(&other.storage_, &storage_);
+      other.operations_ = nullptr;
+    }
+  }
+
+  unique_function &operator=(unique_function &&other) noexcept {
+    if (this != &other) {
+      reset();
+      if (other.operations_) {
+        other.operations_->move(&other.storage_, &storage_);
+        operations_ = other.operations_;
+        other.operations_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  unique_function &operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  unique_function(const unique_function &) = delete;
+  unique_function &operator=(const unique_function &) = delete;
+
+  ~unique_function() { reset(); }
+
+  explicit operator bool() const noexcept { return operations_ != nullptr; }
+
+  R operator()(Args... args) const {
+    if (!operations_) {
+      throw std::bad_function_call();
+    }
+    return operations_->invoke(&storage_, std::forward<Args>(args)...);
+  }
+
+private:
+  typedef typename std::aligned_storage<buffer_size>::type storage_type;
+
+  struct operations {
+    R (*invoke)(storage_type *, Args &&...);
+    // Moves the callable to the uninitialized destination and destroys the
+    // source.
+    void (*move)(storage_type *, storage_type *);
+    void (*destroy)(storage_type *);
+  };
+
+  template <typename F>
+  struct fits_in_place
+      : std::integral_constant<
+            bool, sizeof(F) <= sizeof(storage_type) &&
+                      alignof(storage_type) % alignof(F) == 0 &&
+                      std::is_nothrow_move_constructible<F>::value> {};
+
+  template <typename F> struct in_place_operations {
+    static F *get(storage_type *storage) {
+      return std::launder(reinterpret_cast<F *>(storage));
+    }
+    static R invoke(storage_type *storage, Args &&... args) {
+      return (*get(storage))(std::forward<Args>(args)...);
+    }
+    static void move(storage_type *from, storage_type *to) {
+      new (to) F(std::move(*get(from)));
+      get(from)->~F();
+    }
+    static void destroy(storage_type *storage) { get(storage)->~F(); }
+    static constexpr operations value{&invoke, &move, &destroy};
+  };
+
+  template <typename F> struct allocated_operations {
+    static F *&get(storage_type *storage) {
+      return *reinterpret_cast<F **>(storage);
+    }
+    static R invoke(storage_type *storage, Args &&... args) {
+      return (*get(storage))(std::forward<Args>(args)...);
+    }
+    static void move(storage_type *from, storage_type *to) {
+      *reinterpret_cast<F **>(to) = get(from);
+    }
+    static void destroy(storage_type *storage) { delete get(storage); }
+    static constexpr operations value{&invoke, &move, &destroy};
+  };
+
+  void reset() noexcept {
+    if (operations_) {
+      operations_->destroy(&storage_);
+      operations_ = nullptr;
+    }
+  }
+
+  // Mutable as calling does not change which callable is held, the same as
+  // boost::function.
+  mutable storage_type storage_;
+  const operations *operations_{nullptr};
+};
+
+} // namespace util
+} // namespace proxy
+
+#endif // PROXY_UTIL_UNIQUE_FUNCTION_HPP
@@ -0,0 +1,66 @@
+#include "proxy/cert/certificate_cache.hpp"
+#include <iostream>
+#include <ostream>
+#include <string>
+
+int main(int argc, char *argv[]) {
+  // Single shard, so that the eviction order is deterministic.
+  proxy::cert::certificate_cache cache(2, 1);
+
+  proxy::cert::certificate_ptr a(new proxy::cert::certificate());
+  proxy::cert::certificate_ptr b(new proxy::cert::certificate());
+  proxy::cert::certificate_ptr c(new proxy::cert::certificate());
+
+  if (cache.find("a.example.com")) {
+    std::cerr << "Empty cache should not have a.example.com!" << std::endl;
+    return 1;
+  }
+
+  cache.insert("a.example.com", a);
+  cache.insert("b.example.com", b);
+  if (cache.find("a.example.com") != a) {
+    std::cerr << "Cache should have a.example.com!" << std::endl;
+    return 1;
+  }
+
+  // b.example.com is the least recently used now.
+  cache.insert("c.example.com", c);
+  if (cache.find("b.example.com")) {
+    std::cerr << "b.example.com should be evicted!" << std::endl;
+    return 1;
+  }
+  if (cache.find("a.example.com") != a || cache.find("c.example.com") != c) {
+    std::cerr << "Cache should have a.example.com and c.example.com!"
+              << std::endl;
+    return 1;
+  }
+
+  // Replacing does not evict.
+  cache.insert("c.example.com", b);
+  if (cache.find("c.example.com") != b || cache.find("a.example.com") != a) {
+    std::cerr << "c.example.com should be replaced!" << std::endl;
+    return 1;
+  }
+
+  proxy::cert::certificate_cache::statistics statistics =
+      cache.get_statistics();
+  if (statistics.hits != 5 || statistics.misses != 2 ||
+      statistics.evictions != 1 || statistics.size != 2) {
+    std::cerr << "Wrong statistics: hits " << statistics.hits << ", misses "
+              << statistics.misses << ", evictions " << statistics.evictions
+              << ", size " << statistics.size << "!" << std::endl;
+    return 1;
+  }
+
+  // Capacity is split between shards.
+  proxy::cert::certificate_cache sharded(64, 4);
+  for (int i = 0; i < 1000; i++) {
+    sharded.insert(std::to_string(i) + ".example.com", a);
+  }
+  if (sharded.get_statistics().size > 64) {
+    std::cerr << "Sharded cache should have at most 64 entries!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
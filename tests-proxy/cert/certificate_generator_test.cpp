@@ -0,0 +1,132 @@
+#include "proxy/cert/certificate_cache.hpp"
+#include "proxy/cert/certificate_generator.hpp"
+#include "proxy/cert/rsa_maker.hpp"
+#include <boost/asio.hpp>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const std::size_t REQUESTS = 8;
+
+// Holds the mints until all the requests are made, so that they all find the
+// mint in flight.
+struct mint_gate {
+  bool setup(boost::asio::ssl::context &, const std::string &) {
+    std::unique_lock<std::mutex> lock(mutex);
+    mints++;
+    requested_condition.wait(lock, [this]() { return requested == REQUESTS; });
+    return true;
+  }
+
+  void request_made() {
+    std::lock_guard<std::mutex> lock(mutex);
+    requested++;
+    requested_condition.notify_all();
+  }
+
+  std::mutex mutex{};
+  std::condition_variable requested_condition{};
+  std::size_t requested{};
+  std::size_t mints{};
+};
+
+// Generate the certificate of the host on an io_context of the calling thread.
+proxy::cert::certificate_ptr
+generate(proxy::cert::certificate_generator &generator, const std::string &host,
+         mint_gate *gate) {
+  boost::asio::io_context io_context;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard(io_context.get_executor());
+  proxy::cert::certificate_ptr result;
+  generator.async_generate_certificate(
+      io_context, host,
+      [&result, &work_guard](proxy::cert::certificate_ptr certificate) {
+        result = certificate;
+        work_guard.reset();
+      });
+  if (gate) {
+    gate->request_made();
+  }
+  io_context.run();
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  proxy::cert::rsa_maker rsa_maker(1);
+  proxy::cert::certificate_cache certificate_cache(16);
+  mint_gate gate;
+  proxy::cert::certificate_generator generator(
+      rsa_maker, certificate_cache,
+      [&gate](boost::asio::ssl::context &ssl_context, const std::string &host) {
+        return gate.setup(ssl_context, host);
+      });
+
+  std::string root_private_key;
+  std::string root_certificate;
+  boost::tie(root_private_key, root_certificate) =
+      generator.generate_root_certificate();
+  if (!generator.load_root_certificate(root_private_key, root_certificate)) {
+    std::cerr << "Failed loading root certificate!" << std::endl;
+    return 1;
+  }
+
+  // Concurrent requests for the same host share one mint.
+  std::vector<proxy::cert::certificate_ptr> certificates(REQUESTS);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < REQUESTS; i++) {
+    threads.emplace_back([&generator, &gate, &certificates, i]() {
+      certificates[i] = generate(generator, "example.com", &gate);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (gate.mints != 1) {
+    std::cerr << "Expected one mint, got " << gate.mints << "!" << std::endl;
+    return 1;
+  }
+  for (std::size_t i = 0; i < REQUESTS; i++) {
+    if (!certificates[i] || !certificates[i]->ssl_context) {
+      std::cerr << "Request " << i << " got no certificate!" << std::endl;
+      return 1;
+    }
+    if (certificates[i] != certificates[0] ||
+        certificates[i]->ssl_context != certificates[0]->ssl_context) {
+      std::cerr << "Request " << i << " got another certificate!"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (certificate_cache.find("example.com") != certificates[0]) {
+    std::cerr << "Minted certificate should be cached!" << std::endl;
+    return 1;
+  }
+
+  // Once minted, the certificate comes from the cache.
+  std::uint64_t hits = certificate_cache.get_statistics().hits;
+  if (generate(generator, "example.com", nullptr) != certificates[0] ||
+      gate.mints != 1) {
+    std::cerr << "Request after the mint should get the cached certificate!"
+              << std::endl;
+    return 1;
+  }
+  if (certificate_cache.get_statistics().hits != hits + 1) {
+    std::cerr << "Request after the mint should hit the cache!" << std::endl;
+    return 1;
+  }
+
+  // Another host is minted on its own.
+  proxy::cert::certificate_ptr other =
+      generate(generator, "other.example.com", nullptr);
+  if (!other || other == certificates[0] || gate.mints != 2) {
+    std::cerr << "Another host should get a certificate of its own!"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "proxy/dns/dns_cache.hpp"
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <chrono>
+#include <iostream>
+#include <ostream>
+#include <string>
+
+struct result {
+  int calls{};
+  boost::system::error_code error{};
+  std::size_t endpoints{};
+};
+
+void handle_resolve(result *r, const boost::system::error_code &e,
+                    boost::asio::ip::tcp::resolver::results_type results) {
+  r->calls++;
+  r->error = e;
+  r->endpoints = results.size();
+}
+
+bool resolve(proxy::dns::dns_cache &cache,
+             boost::asio::io_context &io_context,
+             boost::asio::ip::tcp::resolver &resolver, const std::string &host,
+             const std::string &service, result &r) {
+  cache.async_resolve(resolver, host, service,
+                      boost::bind(&handle_resolve, &r, boost::placeholders::_1,
+                                  boost::placeholders::_2));
+  io_context.restart();
+  io_context.run();
+  return r.calls == 1;
+}
+
+int main(int argc, char *argv[]) {
+  boost::asio::io_context io_context;
+  boost::asio::ip::tcp::resolver resolver(io_context);
+  proxy::dns::dns_cache cache(2, std::chrono::seconds(60),
+                              std::chrono::seconds(60));
+
+  result first;
+  result second;
+  if (!resolve(cache, io_context, resolver, "127.0.0.1", "80", first) ||
+      !resolve(cache, io_context, resolver, "127.0.0.1", "80", second) ||
+      first.error || second.error || second.endpoints != first.endpoints ||
+      first.endpoints == 0) {
+    std::cerr << "127.0.0.1:80 should resolve!" << std::endl;
+    return 1;
+  }
+
+  // Fails locally, without asking any DNS server.
+  result failed;
+  result failed_again;
+  if (!resolve(cache, io_context, resolver, "127.0.0.1", "no-such-service",
+               failed) ||
+      !resolve(cache, io_context, resolver, "127.0.0.1", "no-such-service",
+               failed_again) ||
+      !failed.error || failed_again.error != failed.error) {
+    std::cerr << "127.0.0.1:no-such-service should not resolve!" << std::endl;
+    return 1;
+  }
+
+  // Evicts 127.0.0.1:80, the least recently used.
+  result other;
+  result evicted;
+  if (!resolve(cache, io_context, resolver, "127.0.0.1", "443", other) ||
+      !resolve(cache, io_context, resolver, "127.0.0.1", "80", evicted)) {
+    std::cerr << "127.0.0.1 should resolve!" << std::endl;
+    return 1;
+  }
+
+  proxy::dns::dns_cache::statistics statistics = cache.get_statistics();
+  if (statistics.hits != 1 || statistics.negative_hits != 1 ||
+      statistics.misses != 4 || statistics.evictions != 2 ||
+      statistics.size != 2) {
+    std::cerr << "Wrong statistics: " << statistics.hits << " hits, "
+              << statistics.negative_hits << " negative hits, "
+              << statistics.misses << " misses, " << statistics.evictions
+              << " evictions!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
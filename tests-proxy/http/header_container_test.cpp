@@ -28,6 +28,29 @@ bool check_content_same(std::string prefix,
   return true;
 }
 
+bool check_serialized(
+    std::string prefix, proxy::http::header_container &headers,
+    std::initializer_list<std::string_view> start_line,
+    const std::vector<std::string> &expected) {
+  std::vector<boost::asio::const_buffer> buffers;
+  headers.serialize(start_line, buffers);
+  if (buffers.size() != expected.size()) {
+    std::cerr << prefix << "Expected " << expected.size() << " buffers, got "
+              << buffers.size() << "!" << std::endl;
+    return false;
+  }
+  for (std::size_t i = 0; i < buffers.size(); i++) {
+    std::string buffer(static_cast<const char *>(buffers[i].data()),
+                       buffers[i].size());
+    if (buffer != expected[i]) {
+      std::cerr << prefix << "Invalid buffer " << i << ": expected \""
+                << expected[i] << "\" got \"" << buffer << "\"!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   // For lowercase.
   std::setlocale(LC_ALL, "en_US.iso88591");
@@ -127,5 +150,130 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // More headers than kept inline, every third one erased.
+  std::vector<proxy::http::header> many_vector;
+  std::vector<proxy::http::header> many_without_x_0;
+  for (int i = 0; i < 3 * proxy::http::header_container::inline_headers; i++) {
+    proxy::http::header h{"X-" + std::to_string(i % 3), std::to_string(i)};
+    headers.push_back(h);
+    many_vector.push_back(h);
+    if (i % 3 != 0) {
+      many_without_x_0.push_back(h);
+    }
+  }
+  if (!check_content_same("Many: ", many_vector, headers)) {
+    return 1;
+  }
+  headers.erase_all("x-0");
+  if (!check_content_same("Many without x-0: ", many_without_x_0, headers)) {
+    return 1;
+  }
+  index = 0;
+  for (proxy::http::header_container::name_iterator iterator =
+           headers.find("x-2");
+       iterator != headers.end(); iterator++, index++) {
+    if (iterator->value != std::to_string(3 * index + 2)) {
+      std::cerr << "Invalid X-2 header at position " << index << ", got "
+                << iterator->value << "!" << std::endl;
+      return 1;
+    }
+  }
+  if (index != proxy::http::header_container::inline_headers) {
+    std::cerr << "Invalid number of X-2 headers " << index << "!" << std::endl;
+    return 1;
+  }
+
+  // Serializing: the start line pieces and the headers in one block, large
+  // values in buffers of their own.
+  headers.clear();
+  if (!check_serialized("Empty: ", headers,
+                        {"GET", " ", "/", " ", "HTTP/1.1", "\r\n"},
+                        {"GET / HTTP/1.1\r\n\r\n"})) {
+    return 1;
+  }
+  headers.push_back("Host", "example.com");
+  headers.push_back("X-A", "");
+  if (!check_serialized("Small: ", headers,
+                        {"HTTP/1.1", " ", "200", " ", "OK", "\r\n"},
+                        {"HTTP/1.1 200 OK\r\n"
+                         "Host: example.com\r\n"
+                         "X-A: \r\n"
+                         "\r\n"})) {
+    return 1;
+  }
+  std::string below_large_value(
+      proxy::http::header_container::large_value_size - 1, 'b');
+  headers.push_back("X-Below", below_large_value);
+  if (!check_serialized("Below large: ", headers, {"A / B\r\n"},
+                        {"A / B\r\n"
+                         "Host: example.com\r\n"
+                         "X-A: \r\n"
+                         "X-Below: " +
+                             below_large_value +
+                             "\r\n"
+                             "\r\n"})) {
+    return 1;
+  }
+  std::string large_value(proxy::http::header_container::large_value_size,
+                          'l');
+  headers.push_back("X-Large", large_value);
+  if (!check_serialized("Large last: ", headers, {"A / B\r\n"},
+                        {"A / B\r\n"
+                         "Host: example.com\r\n"
+                         "X-A: \r\n"
+                         "X-Below: " +
+                             below_large_value +
+                             "\r\n"
+                             "X-Large: ",
+                         large_value, "\r\n\r\n"})) {
+    return 1;
+  }
+  headers.push_back("X-After", "a");
+  if (!check_serialized("Large in the middle: ", headers, {"A / B\r\n"},
+                        {"A / B\r\n"
+                         "Host: example.com\r\n"
+                         "X-A: \r\n"
+                         "X-Below: " +
+                             below_large_value +
+                             "\r\n"
+                             "X-Large: ",
+                         large_value,
+                         "\r\n"
+                         "X-After: a\r\n"
+                         "\r\n"})) {
+    return 1;
+  }
+  // The large value is referenced where the container keeps it.
+  std::vector<boost::asio::const_buffer> buffers;
+  headers.serialize({"A / B\r\n"}, buffers);
+  if (buffers.size() != 3 ||
+      buffers[1].data() != headers.find("x-large")->value.view().data()) {
+    std::cerr << "Large value should not be copied!" << std::endl;
+    return 1;
+  }
+
+  // Cleared containers keep their memory for the next message, released ones
+  // start over.
+  headers.clear();
+  headers.push_back("Host", "example.com");
+  const char *host = headers.find("host")->value.view().data();
+  headers.clear();
+  headers.push_back("Host", "example.com");
+  if (headers.find("host")->value.view().data() != host) {
+    std::cerr << "Cleared container should reuse its memory!" << std::endl;
+    return 1;
+  }
+  headers.release();
+  if (!headers.empty() || headers.find("host") != headers.end()) {
+    std::cerr << "Released container should be empty!" << std::endl;
+    return 1;
+  }
+  for (const proxy::http::header &h : many_vector) {
+    headers.push_back(h);
+  }
+  if (!check_content_same("Released: ", many_vector, headers)) {
+    return 1;
+  }
+
   return 0;
 }
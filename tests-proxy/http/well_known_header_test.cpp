@@ -0,0 +1,167 @@
+#include "proxy/http/header.hpp"
+#include "proxy/http/well_known_header.hpp"
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace table = proxy::http::well_known_header_table;
+using proxy::http::well_known_header;
+
+// The well-known header named name by comparing with every name.
+well_known_header find_by_comparing(const std::string &name) {
+  for (std::size_t i = 0; i < table::names.size(); i++) {
+    if (table::names[i].size() != name.size()) {
+      continue;
+    }
+    bool same = true;
+    for (std::size_t j = 0; j < name.size(); j++) {
+      if (table::to_lower(name[j]) != table::names[i][j]) {
+        same = false;
+      }
+    }
+    if (same) {
+      return static_cast<well_known_header>(i);
+    }
+  }
+  return well_known_header::none;
+}
+
+bool check_id(const std::string &name, well_known_header expected) {
+  well_known_header id = proxy::http::to_well_known_header(name);
+  if (id != expected) {
+    std::cerr << "Wrong id for \"" << name << "\": expected "
+              << static_cast<int>(expected) << " got " << static_cast<int>(id)
+              << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool check_values(std::string prefix, proxy::http::header_container &headers,
+                  well_known_header id, std::vector<std::string> values) {
+  std::size_t index = 0;
+  for (proxy::http::header_container::name_iterator it = headers.find(id);
+       it != headers.end(); it++, index++) {
+    if (index >= values.size() || it->value != values[index]) {
+      std::cerr << prefix << "Invalid "
+                << proxy::http::well_known_header_name(id)
+                << " header at position " << index << ", got " << it->value
+                << "!" << std::endl;
+      return false;
+    }
+  }
+  if (index != values.size()) {
+    std::cerr << prefix << "Invalid number of "
+              << proxy::http::well_known_header_name(id) << " headers "
+              << index << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  for (std::size_t i = 0; i < proxy::http::well_known_header_count; i++) {
+    well_known_header id = static_cast<well_known_header>(i);
+    std::string name(proxy::http::well_known_header_name(id));
+
+    // Any letter case.
+    std::string upper = name;
+    std::string mixed = name;
+    for (std::size_t j = 0; j < name.size(); j++) {
+      upper[j] = std::toupper(name[j]);
+      if (j % 2 == 0) {
+        mixed[j] = std::toupper(name[j]);
+      }
+    }
+    if (!check_id(name, id) || !check_id(upper, id) || !check_id(mixed, id)) {
+      return 1;
+    }
+
+    // Names differing in a byte the slot does not depend on, with the same
+    // length and slot as a well-known name.
+    for (std::size_t j = 1; j + 1 < name.size(); j++) {
+      if (j == name.size() / 2) {
+        continue;
+      }
+      std::string near_miss = name;
+      near_miss[j] = near_miss[j] == 'x' ? 'y' : 'x';
+      if (table::slot(table::seed, near_miss) !=
+          table::slot(table::seed, name)) {
+        std::cerr << "\"" << near_miss << "\" should share the slot of \""
+                  << name << "\"!" << std::endl;
+        return 1;
+      }
+      if (!check_id(near_miss, well_known_header::none)) {
+        return 1;
+      }
+    }
+
+    // Longer and shorter names, some of which are well-known themselves.
+    std::vector<std::string> near_misses{name + "s", name + "-", "x-" + name,
+                                         name.substr(1),
+                                         name.substr(0, name.size() - 1)};
+    for (const std::string &near_miss : near_misses) {
+      if (!check_id(near_miss, find_by_comparing(near_miss))) {
+        return 1;
+      }
+    }
+  }
+  if (!check_id("", well_known_header::none) ||
+      !check_id("x-forwarded-for", well_known_header::none) ||
+      !check_id("content_length", well_known_header::none)) {
+    return 1;
+  }
+
+  // The index of the first header of each id follows erasing.
+  proxy::http::header_container headers;
+  headers.push_back("Host", "a");
+  headers.push_back("X-A", "1");
+  headers.push_back("Cookie", "b");
+  headers.push_back("Connection", "close");
+  headers.push_back("cookie", "c");
+  headers.push_back("X-B", "2");
+  headers.push_back("COOKIE", "d");
+  headers.push_back("host", "e");
+  if (!check_values("Initial: ", headers, well_known_header::host,
+                    {"a", "e"}) ||
+      !check_values("Initial: ", headers, well_known_header::cookie,
+                    {"b", "c", "d"}) ||
+      !check_values("Initial: ", headers, well_known_header::connection,
+                    {"close"})) {
+    return 1;
+  }
+
+  headers.erase_all(well_known_header::connection);
+  if (!check_values("Without connection: ", headers,
+                    well_known_header::connection, {}) ||
+      !check_values("Without connection: ", headers, well_known_header::cookie,
+                    {"b", "c", "d"}) ||
+      !check_values("Without connection: ", headers, well_known_header::host,
+                    {"a", "e"})) {
+    return 1;
+  }
+
+  headers.erase_all("host");
+  if (!check_values("Without host: ", headers, well_known_header::host, {}) ||
+      !check_values("Without host: ", headers, well_known_header::cookie,
+                    {"b", "c", "d"})) {
+    return 1;
+  }
+
+  // Erasing an id without headers changes nothing.
+  headers.erase_all(well_known_header::etag);
+  headers.erase_all(well_known_header::cookie);
+  headers.push_back("Cookie", "f");
+  headers.push_back("Host", "g");
+  if (!check_values("Added again: ", headers, well_known_header::cookie,
+                    {"f"}) ||
+      !check_values("Added again: ", headers, well_known_header::host,
+                    {"g"}) ||
+      headers.find("x-b") == headers.end() ||
+      headers.find("x-b")->value != "2") {
+    return 1;
+  }
+
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include "proxy/util/utils.hpp"
 #include <clocale>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 bool check_content_same(proxy::http::request_pre_body &input,
                         proxy::http::request_pre_body &expected) {
@@ -11,12 +13,26 @@ bool check_content_same(proxy::http::request_pre_body &input,
               << input.method << "!" << std::endl;
     return false;
   }
+  if (input.method_type != expected.method_type) {
+    std::cerr << "Wrong method type: expected "
+              << static_cast<int>(expected.method_type) << " got "
+              << static_cast<int>(input.method_type) << "!" << std::endl;
+    return false;
+  }
   if (input.http_version_string != expected.http_version_string) {
     std::cerr << "Wrong http version string: expected "
               << expected.http_version_string << " got "
               << input.http_version_string << "!" << std::endl;
     return false;
   }
+  if (input.http_version_major != expected.http_version_major ||
+      input.http_version_minor != expected.http_version_minor) {
+    std::cerr << "Wrong http version: expected " << expected.http_version_major
+              << "." << expected.http_version_minor << " got "
+              << input.http_version_major << "." << input.http_version_minor
+              << "!" << std::endl;
+    return false;
+  }
   if (input.uri != expected.uri) {
     std::cerr << "Wrong uri: expected " << expected.uri << " got " << input.uri
               << "!" << std::endl;
@@ -87,8 +103,11 @@ int main(int argc, char *argv[]) {
 
   proxy::http::request_pre_body expected{
       .method = "GET",
+      .method_type = proxy::http::request_method::get,
       .uri = "/wiki/Main_Page",
       .http_version_string = "HTTP/1.1",
+      .http_version_major = 1,
+      .http_version_minor = 1,
   };
   expected.headers.push_back({"Host", "en.wikipedia.org"});
   expected.headers.push_back({"Connection", "keep-alive"});
@@ -183,5 +202,75 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // Without folded lines the request is forwarded as it came, also with a new
+  // uri, until the headers are modified.
+  std::string verbatim_input = "GET http://example.com/a HTTP/1.1\r\n"
+                               "Host:  example.com \r\n"
+                               "Accept: */*\r\n"
+                               "\r\n";
+  parser.reset();
+  request_pre_body = {};
+  boost::tribool result;
+  std::string::iterator it;
+  boost::tie(result, it) = parser.parse(
+      request_pre_body, verbatim_input.begin(), verbatim_input.end());
+  if (result != true || it != verbatim_input.end()) {
+    std::cerr << "Failed parsing verbatim pre body!" << std::endl;
+    return 1;
+  }
+  std::vector<std::pair<std::string, std::string>> verbatim_outputs{
+      {"nothing", verbatim_input},
+      {"uri", "GET /a HTTP/1.1\r\n"
+              "Host:  example.com \r\n"
+              "Accept: */*\r\n"
+              "\r\n"},
+      {"header", "GET /a HTTP/1.1\r\n"
+                 "Host: example.com\r\n"
+                 "Accept: */*\r\n"
+                 "X-A: 1\r\n"
+                 "\r\n"}};
+  for (std::pair<std::string, std::string> &output : verbatim_outputs) {
+    if (output.first == "uri") {
+      request_pre_body.uri = "/a";
+    } else if (output.first == "header") {
+      request_pre_body.headers.push_back("X-A", "1");
+    }
+    if (proxy::util::utils::vector_of_buffers_to_string(
+            request_pre_body.to_buffers()) != output.second) {
+      std::cerr << "Output doesn't match verbatim output after changing "
+                << output.first << "!" << std::endl;
+      return 1;
+    }
+  }
+
+  // A pre body split between inputs is not referenced in either of them.
+  parser.reset();
+  request_pre_body = {};
+  std::string first_input = verbatim_input.substr(0, 20);
+  std::string second_input = verbatim_input.substr(20);
+  boost::tie(result, it) =
+      parser.parse(request_pre_body, first_input.begin(), first_input.end());
+  if (!boost::indeterminate(result) || it != first_input.end()) {
+    std::cerr << "Failed parsing first part of split pre body!" << std::endl;
+    return 1;
+  }
+  boost::tie(result, it) =
+      parser.parse(request_pre_body, second_input.begin(), second_input.end());
+  if (result != true || it != second_input.end()) {
+    std::cerr << "Failed parsing second part of split pre body!" << std::endl;
+    return 1;
+  }
+  std::string serialized_output = "GET http://example.com/a HTTP/1.1\r\n"
+                                  "Host: example.com\r\n"
+                                  "Accept: */*\r\n"
+                                  "\r\n";
+  if (!request_pre_body.raw.empty() ||
+      proxy::util::utils::vector_of_buffers_to_string(
+          request_pre_body.to_buffers()) != serialized_output) {
+    std::cerr << "Split pre body is not serialized from the fields!"
+              << std::endl;
+    return 1;
+  }
+
   return 0;
 }
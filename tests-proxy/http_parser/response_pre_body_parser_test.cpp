@@ -10,12 +10,25 @@ bool check_content_same(proxy::http::response_pre_body &input,
               << input.code << "!" << std::endl;
     return false;
   }
+  if (input.status_code != expected.status_code) {
+    std::cerr << "Wrong status code: expected " << expected.status_code
+              << " got " << input.status_code << "!" << std::endl;
+    return false;
+  }
   if (input.http_version_string != expected.http_version_string) {
     std::cerr << "Wrong http version string: expected "
               << expected.http_version_string << " got "
               << input.http_version_string << "!" << std::endl;
     return false;
   }
+  if (input.http_version_major != expected.http_version_major ||
+      input.http_version_minor != expected.http_version_minor) {
+    std::cerr << "Wrong http version: expected " << expected.http_version_major
+              << "." << expected.http_version_minor << " got "
+              << input.http_version_major << "." << input.http_version_minor
+              << "!" << std::endl;
+    return false;
+  }
   if (input.reason != expected.reason) {
     std::cerr << "Wrong uri: expected " << expected.reason << " got "
               << input.reason << "!" << std::endl;
@@ -94,7 +107,10 @@ int main(int argc, char *argv[]) {
 
   proxy::http::response_pre_body expected{
       .http_version_string = "HTTP/1.1",
+      .http_version_major = 1,
+      .http_version_minor = 1,
       .code = "200",
+      .status_code = 200,
       .reason = "OK",
   };
 
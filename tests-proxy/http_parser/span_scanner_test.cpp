@@ -0,0 +1,75 @@
+#include "proxy/http_parser/span_scanner.hpp"
+#include "proxy/util/misc_strings.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace misc_strings = proxy::util::misc_strings;
+
+bool check_same(const proxy::http_parser::span_scanner &scanner,
+                const std::string &name, const std::string &input) {
+  const proxy::http_parser::span_scanner &scalar =
+      proxy::http_parser::span_scanner::scalar();
+  const char *begin = input.data();
+  const char *end = begin + input.size();
+  if (scanner.token(begin, end) != scalar.token(begin, end) ||
+      scanner.field_content(begin, end) != scalar.field_content(begin, end) ||
+      scanner.text(begin, end) != scalar.text(begin, end)) {
+    std::cerr << name << " scanner differs from the scalar one for input of "
+              << input.size() << " bytes!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  const proxy::http_parser::span_scanner &scalar =
+      proxy::http_parser::span_scanner::scalar();
+
+  // The scalar scanners accept what the parsers accept byte by byte.
+  for (int c = 0; c < 256; ++c) {
+    char input = static_cast<char>(c);
+    bool token = misc_strings::is_char(input) &&
+                 !misc_strings::is_ctl(input) &&
+                 !misc_strings::is_tspecial(input);
+    bool field_content = !misc_strings::is_ctl(input) && input != ' ';
+    bool text = !misc_strings::is_ctl(input);
+    if (scalar.token(&input, &input + 1) != token ||
+        scalar.field_content(&input, &input + 1) != field_content ||
+        scalar.text(&input, &input + 1) != text) {
+      std::cerr << "Wrong class of byte " << c << "!" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<std::string, const proxy::http_parser::span_scanner *>>
+      scanners = {{"SSE4.2", proxy::http_parser::span_scanner::sse42()},
+                  {"AVX2", proxy::http_parser::span_scanner::avx2()}};
+  const std::string accepted =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.~!";
+  const std::string rejected = " \t\r\n:;,/\"\x7f\x80\xff";
+  std::srand(1);
+  for (auto &scanner : scanners) {
+    if (!scanner.second) {
+      continue;
+    }
+    for (std::size_t length = 0; length < 100; ++length) {
+      for (int round = 0; round < 50; ++round) {
+        std::string input;
+        for (std::size_t i = 0; i < length; ++i) {
+          if (std::rand() % 40 == 0) {
+            input.push_back(rejected[std::rand() % rejected.size()]);
+          } else {
+            input.push_back(accepted[std::rand() % accepted.size()]);
+          }
+        }
+        if (!check_same(*scanner.second, scanner.first, input)) {
+          return 1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include "proxy/cert/certificate_cache.hpp"
+#include "proxy/cert/certificate_generator.hpp"
+#include "proxy/cert/rsa_maker.hpp"
+#include "proxy/dns/dns_cache.hpp"
+#include "proxy/server/buffer_pool.hpp"
+#include "proxy/server/connection.hpp"
+#include "proxy/server/connection_manager.hpp"
+#include "proxy/server/connection_pool.hpp"
+#include "proxy/server/upstream_pool.hpp"
+#include "proxy/tls/client_sessions.hpp"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/weak_ptr.hpp>
+#include <chrono>
+#include <iostream>
+#include <ostream>
+#include <vector>
+
+struct finished_callbacks : proxy::callbacks::proxy_callbacks {
+  void on_connection_finished(
+      proxy::callbacks::connection_id connection_id) override {
+    finished.push_back(connection_id);
+    // Releasing another connection while the manager stops all of them.
+    if (release_when_first_finished) {
+      manager->release(release_when_first_finished);
+      release_when_first_finished.reset();
+    }
+  }
+
+  std::vector<proxy::callbacks::connection_id> finished{};
+  proxy::server::connection_manager *manager{nullptr};
+  proxy::server::connection_ptr release_when_first_finished{};
+};
+
+bool check_finished(std::string prefix, finished_callbacks &callbacks,
+                    std::vector<proxy::callbacks::connection_id> expected) {
+  if (callbacks.finished != expected) {
+    std::cerr << prefix << "Unexpected finished connections:";
+    for (proxy::callbacks::connection_id id : callbacks.finished) {
+      std::cerr << " " << id;
+    }
+    std::cerr << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  boost::asio::io_context io_context;
+  proxy::server::connection_manager manager;
+  boost::shared_ptr<boost::asio::ip::tcp::resolver> resolver =
+      boost::make_shared<boost::asio::ip::tcp::resolver>(io_context);
+  proxy::dns::dns_cache dns_cache(16, std::chrono::seconds(60),
+                                  std::chrono::seconds(10));
+  proxy::server::upstream_pool upstream_pool(io_context, {});
+  proxy::server::buffer_pool buffer_pool(1024 * 1024);
+  proxy::cert::certificate_cache certificate_cache(16);
+  boost::asio::ssl::context upstream_ssl_context(
+      boost::asio::ssl::context::tls_client);
+  proxy::tls::client_sessions upstream_sessions;
+  proxy::cert::rsa_maker rsa_maker(0);
+  proxy::cert::certificate_generator certificate_generator(rsa_maker,
+                                                           certificate_cache);
+  finished_callbacks callbacks;
+  callbacks.manager = &manager;
+
+  boost::asio::ip::tcp::acceptor acceptor(
+      io_context, boost::asio::ip::tcp::endpoint(
+                      boost::asio::ip::address_v4::loopback(), 0));
+  std::vector<boost::asio::ip::tcp::socket> clients;
+  std::vector<proxy::server::connection_ptr> connections;
+  std::vector<boost::weak_ptr<proxy::server::connection>> weak_connections;
+  for (proxy::callbacks::connection_id id = 0; id < 6; id++) {
+    proxy::server::connection_ptr c =
+        boost::allocate_shared<proxy::server::connection>(
+            proxy::server::connection_pool_allocator<
+                proxy::server::connection>(),
+            io_context, manager, resolver, dns_cache, upstream_pool,
+            buffer_pool, certificate_cache, upstream_ssl_context,
+            upstream_sessions, id, certificate_generator,
+            []() { return false; },
+            [](proxy::server::connection_ptr) { return false; }, callbacks,
+            false);
+    clients.emplace_back(io_context);
+    clients.back().connect(acceptor.local_endpoint());
+    acceptor.accept(c->downstream_socket());
+    // Each waits for a request.
+    manager.start(c);
+    connections.push_back(c);
+    weak_connections.push_back(c);
+  }
+
+  manager.stop(connections[1]);
+  manager.release(connections[2]);
+  if (!check_finished("Stop: ", callbacks, {1})) {
+    return 1;
+  }
+
+  // A connection destroyed without being stopped unlinks itself.
+  connections[5]->downstream_socket().close();
+  connections[5].reset();
+  io_context.poll();
+  if (!weak_connections[5].expired()) {
+    std::cerr << "Connection 5 should be destroyed!" << std::endl;
+    return 1;
+  }
+
+  callbacks.release_when_first_finished = connections[3];
+  manager.stop_all();
+  if (!check_finished("Stop all: ", callbacks, {1, 0, 4})) {
+    return 1;
+  }
+  if (!connections[2]->downstream_socket().is_open() ||
+      !connections[3]->downstream_socket().is_open()) {
+    std::cerr << "Released connections should not be stopped!" << std::endl;
+    return 1;
+  }
+  manager.stop_all();
+  if (!check_finished("Stop all again: ", callbacks, {1, 0, 4})) {
+    return 1;
+  }
+
+  connections[2]->stop();
+  connections[3]->stop();
+  connections.clear();
+  for (boost::asio::ip::tcp::socket &client : clients) {
+    client.close();
+  }
+  io_context.run();
+  for (std::size_t i = 0; i < weak_connections.size(); i++) {
+    if (!weak_connections[i].expired()) {
+      std::cerr << "Connection " << i << " should be destroyed!" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include "proxy/server/connection_pool.hpp"
+#include <boost/make_shared.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Whether watched_block was deleted, to tell blocks kept on the free list from
+// freed ones.
+void *watched_block = nullptr;
+bool watched_block_deleted = false;
+
+void *operator new(std::size_t size) {
+  void *block = std::malloc(size == 0 ? 1 : size);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void operator delete(void *block) noexcept {
+  if (block != nullptr && block == watched_block) {
+    watched_block_deleted = true;
+  }
+  std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept {
+  ::operator delete(block);
+}
+
+// Sizes no other allocation of the test uses.
+const std::size_t BLOCK_SIZE = 1001;
+const std::size_t OTHER_BLOCK_SIZE = 1003;
+// MAX_FREE_CONNECTION_BLOCKS of connection_pool.cpp.
+const std::size_t MAX_FREE_BLOCKS = 1024;
+
+struct fake_connection {
+  char state[BLOCK_SIZE];
+};
+
+// Each test runs on a thread of its own, starting with empty free lists.
+int test_reuse() {
+  void *block = proxy::server::allocate_connection_block(BLOCK_SIZE);
+  proxy::server::deallocate_connection_block(block, BLOCK_SIZE);
+  if (proxy::server::allocate_connection_block(BLOCK_SIZE) != block) {
+    std::cerr << "Freed block should be reused!" << std::endl;
+    return 1;
+  }
+
+  // Blocks of another size are not kept while the list holds blocks.
+  proxy::server::deallocate_connection_block(block, BLOCK_SIZE);
+  void *other_block =
+      proxy::server::allocate_connection_block(OTHER_BLOCK_SIZE);
+  watched_block = other_block;
+  proxy::server::deallocate_connection_block(other_block, OTHER_BLOCK_SIZE);
+  watched_block = nullptr;
+  if (!watched_block_deleted) {
+    std::cerr << "Block of another size should be deleted!" << std::endl;
+    return 1;
+  }
+  watched_block_deleted = false;
+  if (proxy::server::allocate_connection_block(BLOCK_SIZE) != block) {
+    std::cerr << "Freed block should be reused after another size!"
+              << std::endl;
+    return 1;
+  }
+
+  // Through boost::allocate_shared, as the server creates connections.
+  boost::shared_ptr<fake_connection> connection =
+      boost::allocate_shared<fake_connection>(
+          proxy::server::connection_pool_allocator<fake_connection>());
+  void *connection_block = connection.get();
+  connection.reset();
+  connection = boost::allocate_shared<fake_connection>(
+      proxy::server::connection_pool_allocator<fake_connection>());
+  if (connection.get() != connection_block) {
+    std::cerr << "Memory of a destroyed connection should be reused!"
+              << std::endl;
+    return 1;
+  }
+  proxy::server::deallocate_connection_block(block, BLOCK_SIZE);
+  return 0;
+}
+
+int test_full() {
+  std::vector<void *> blocks;
+  for (std::size_t i = 0; i <= MAX_FREE_BLOCKS; i++) {
+    blocks.push_back(proxy::server::allocate_connection_block(BLOCK_SIZE));
+  }
+  for (std::size_t i = 0; i <= MAX_FREE_BLOCKS; i++) {
+    watched_block = blocks[i];
+    proxy::server::deallocate_connection_block(blocks[i], BLOCK_SIZE);
+    watched_block = nullptr;
+    if (watched_block_deleted != (i == MAX_FREE_BLOCKS)) {
+      std::cerr << "Block " << i
+                << (watched_block_deleted ? " should be kept!"
+                                          : " should be deleted!")
+                << std::endl;
+      return 1;
+    }
+  }
+  watched_block_deleted = false;
+  // Taken back last in, first out.
+  for (std::size_t i = MAX_FREE_BLOCKS; i-- > 0;) {
+    if (proxy::server::allocate_connection_block(BLOCK_SIZE) != blocks[i]) {
+      std::cerr << "Block " << i << " should be reused!" << std::endl;
+      return 1;
+    }
+  }
+  for (std::size_t i = 0; i < MAX_FREE_BLOCKS; i++) {
+    proxy::server::deallocate_connection_block(blocks[i], BLOCK_SIZE);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  for (int (*test)() : {test_reuse, test_full}) {
+    int result = 0;
+    std::thread thread([&result, test]() { result = test(); });
+    thread.join();
+    if (result != 0) {
+      return result;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "proxy/logging/logging.hpp"
+#include "proxy/server/server.hpp"
+#include "tests-proxy/test_util/ready_callbacks_proxy.hpp"
+#include <clocale>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs two shards which hand every connection over to each other whenever they
+// can, and tells which shard thread serves what.
+struct handover_callbacks_proxy
+    : public tests_proxy::util::ready_callbacks_proxy {
+  handover_callbacks_proxy(std::ofstream &debug_pipe)
+      : tests_proxy::util::ready_callbacks_proxy(debug_pipe) {}
+
+  virtual void
+  async_on_connection(proxy::callbacks::connection_id connection_id,
+                      BOOST_ASIO_MOVE_ARG(proxy::util::unique_function<void()>)
+                          callback) {
+    debug_pipe_ << "connection\n" << std::flush;
+    tests_proxy::util::ready_callbacks_proxy::async_on_connection(
+        connection_id,
+        std::forward<proxy::util::unique_function<void()>>(callback));
+  }
+
+  virtual void async_on_connect_method(on_connect_method_params &params) {
+    debug_pipe_ << "connect " << params.host << " " << params.service << "\n"
+                << std::flush;
+    params.callback(false);
+  }
+
+  // Answers each request with the number of the thread serving it.
+  virtual void async_on_request_pre_body(on_request_pre_body_params &params) {
+    std::string thread = std::to_string(thread_number());
+    debug_pipe_ << "request_pre_body " << params.request_pre_body.uri << " "
+                << thread << "\n"
+                << std::flush;
+    std::unique_ptr<std::string> response(
+        std::make_unique<std::string>("thread " + thread));
+    params.response_pre_body.code = "200";
+    params.response_pre_body.http_version_string =
+        params.request_pre_body.http_version_string;
+    params.response_pre_body.reason = "OK";
+    params.response_pre_body.headers.push_back(
+        {"Content-Length", std::to_string(response->length())});
+    std::vector<boost::asio::const_buffer> buffers =
+        params.response_pre_body.to_buffers();
+    params.outgoing_downstream_buffers.insert(
+        params.outgoing_downstream_buffers.end(), buffers.begin(),
+        buffers.end());
+    params.outgoing_downstream_buffers.emplace_back(
+        boost::asio::buffer(*response));
+    params.outgoing_downstream_buffers_strings.push_back(std::move(response));
+    params.callback(false);
+  };
+
+  virtual void
+  on_connection_finished(proxy::callbacks::connection_id connection_id) {
+    debug_pipe_ << "connection_finished\n" << std::flush;
+    tests_proxy::util::ready_callbacks_proxy::on_connection_finished(
+        connection_id);
+  }
+
+private:
+  // Numbers the shard threads in the order they serve their first request.
+  int thread_number() {
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    return threads_.emplace(std::this_thread::get_id(), threads_.size())
+        .first->second;
+  }
+
+  std::mutex threads_mutex_;
+  std::map<std::thread::id, int> threads_;
+};
+
+int main(int argc, char *argv[]) {
+  // For lowercase.
+  std::setlocale(LC_ALL, "en_US.iso88591");
+
+  proxy::logging::init(argv[0]);
+
+  std::ofstream debug_pipe{argv[1]};
+  // Tunnels relayed through the buffers of the connection rather than spliced.
+  bool buffered = argc > 2 && argv[2] == std::string("buffered");
+
+  setbuf(stdout, NULL);
+  setbuf(stderr, NULL);
+
+  handover_callbacks_proxy callbacks(debug_pipe);
+
+  proxy::server::server_options options;
+  options.threads = 2;
+  options.force_handover_for_testing = true;
+  options.splice_tunnels = !buffered;
+
+  // Initialize the server.
+  proxy::server::server s("127.0.0.1", "0", callbacks, options);
+
+  // Run the server until stopped.
+  s.run();
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+import test_util.runner
+import os
+import socket
+import sys
+import threading
+import time
+
+# Longer than the load probe interval, so that the shards may hand over.
+PROBE_WAIT = 0.2
+
+ROUND_TRIPS = 64
+MESSAGE_SIZE = 1000
+
+
+def request(suffix):
+    return (
+        b"GET http://localhost/%s/ HTTP/1.1\r\n"
+        b"Host: localhost\r\n\r\n" % suffix.encode()
+    )
+
+
+def receive_response(client):
+    # Answered with the number of the serving thread, e.g. "thread 1".
+    response = b""
+    while not response.endswith(b"\r\n\r\n"):
+        piece = client.recv(1)
+        assert len(piece) > 0, "Connection closed after: %s" % response
+        response += piece
+    assert response.startswith(b"HTTP/1.1 200 OK\r\n"), (
+        "Unexpected response: %s" % response
+    )
+    assert b"Content-Length: 8\r\n" in response, "Unexpected response: %s" % response
+    return int(receive_exactly(client, 8)[len(b"thread ") :])
+
+
+def receive_exactly(connection, size):
+    data = bytearray()
+    while len(data) < size:
+        piece = connection.recv(size - len(data))
+        assert len(piece) > 0, "Connection closed after %d of %d bytes" % (
+            len(data),
+            size,
+        )
+        data += piece
+    return bytes(data)
+
+
+def get_thread_line(queue, prefix):
+    line = queue.get()
+    assert line.startswith(prefix), "Expected line: %s...\nGot: %s" % (prefix, line)
+    return int(line[len(prefix) :])
+
+
+def test_requests(queue, proxy_port):
+    # Each request is served by the other shard than the one before, on the
+    # same connection.
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    client.settimeout(10)
+    client.connect(("127.0.0.1", proxy_port))
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection\n")
+    previous_thread = None
+    for i in range(4):
+        client.sendall(request(str(i)))
+        thread = get_thread_line(queue, "request_pre_body /%d/ " % i)
+        assert receive_response(client) == thread, "Response from another thread"
+        assert thread != previous_thread, "Request %d was not handed over" % i
+        previous_thread = thread
+    client.close()
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection_finished\n")
+
+
+def test_tunnel(queue, proxy_port):
+    # The loops of a tunnel are parked and handed over while the bytes go
+    # back and forth.
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    origin_port = listener.getsockname()[1]
+
+    def echo():
+        connection, _ = listener.accept()
+        while True:
+            piece = connection.recv(65536)
+            if len(piece) == 0:
+                break
+            connection.sendall(piece)
+        connection.close()
+
+    origin = threading.Thread(target=echo, daemon=True)
+    origin.start()
+
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    client.settimeout(10)
+    client.connect(("127.0.0.1", proxy_port))
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection\n")
+    client.sendall(
+        b"CONNECT 127.0.0.1:%d HTTP/1.1\r\n"
+        b"Host: 127.0.0.1:%d\r\n\r\n" % (origin_port, origin_port)
+    )
+    test_util.runner.get_line_from_queue_and_assert(
+        queue, "connect 127.0.0.1 %d\n" % origin_port
+    )
+    established = b""
+    while not established.endswith(b"\r\n\r\n"):
+        piece = client.recv(1)
+        assert len(piece) > 0, "Connection closed before CONNECT was answered"
+        established += piece
+    assert established.startswith(b"HTTP/1.1 200"), (
+        "Unexpected CONNECT response: %s" % established
+    )
+    for i in range(ROUND_TRIPS):
+        message = os.urandom(MESSAGE_SIZE)
+        client.sendall(message)
+        assert receive_exactly(client, MESSAGE_SIZE) == message, (
+            "Round trip %d does not match" % i
+        )
+    client.close()
+    origin.join(10)
+    listener.close()
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection_finished\n")
+
+
+if __name__ == "__main__":
+    # Optionally the proxy and whether it buffers tunnels, e.g.
+    # handover_callbacks_proxy buffered.
+    proxy = sys.argv[1] if len(sys.argv) > 1 else "handover_callbacks_proxy"
+    queue, proxy_process = test_util.runner.run(
+        "./tests-proxy/server/" + proxy, sys.argv[2:]
+    )
+    proxy_port = int(queue.get().strip())
+    time.sleep(PROBE_WAIT)
+
+    test_requests(queue, proxy_port)
+    test_tunnel(queue, proxy_port)
+
+    proxy_process.kill()
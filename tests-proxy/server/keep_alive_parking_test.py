@@ -0,0 +1,155 @@
+import test_util.runner
+import socket
+import ssl
+import time
+
+# Longer than the delay after which idle connections free their memory.
+IDLE_GAP = 1.5
+
+BEHAVIOR = "request_pre_body_generates_response_with_body"
+RESPONSE_BODY = b"<h1>%s</h1>" % BEHAVIOR.encode()
+
+
+class PlainClient:
+    def __init__(self, client):
+        self.client = client
+
+    def send(self, *requests):
+        # All the requests in one write.
+        self.client.sendall(b"".join(requests))
+
+    def recv(self):
+        return self.client.recv(65536)
+
+
+class TlsClient:
+    """TLS over the socket of a bumped connection, with control over how the
+    records end up in TCP writes."""
+
+    def __init__(self, client, host):
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+        self.client = client
+        self.incoming = ssl.MemoryBIO()
+        self.outgoing = ssl.MemoryBIO()
+        self.tls = context.wrap_bio(self.incoming, self.outgoing, server_hostname=host)
+        while True:
+            try:
+                self.tls.do_handshake()
+                break
+            except ssl.SSLWantReadError:
+                self.flush()
+                self.fill()
+        self.flush()
+
+    def flush(self):
+        data = self.outgoing.read()
+        if len(data) > 0:
+            self.client.sendall(data)
+
+    def fill(self):
+        data = self.client.recv(65536)
+        assert len(data) > 0, "Connection closed during the TLS handshake"
+        self.incoming.write(data)
+
+    def send(self, *requests):
+        # A record for every request, all the records in one write.
+        for request in requests:
+            self.tls.write(request)
+        self.flush()
+
+    def recv(self):
+        while True:
+            try:
+                return self.tls.read(65536)
+            except ssl.SSLWantReadError:
+                data = self.client.recv(65536)
+                if len(data) == 0:
+                    return b""
+                self.incoming.write(data)
+
+
+def request(suffix):
+    return (
+        b"GET http://localhost/%s/ HTTP/1.1\r\n"
+        b"Host: localhost\r\n\r\n" % suffix.encode()
+    )
+
+
+def bumped_request(suffix):
+    return b"GET /%s/ HTTP/1.1\r\n" b"Host: example.com\r\n\r\n" % suffix.encode()
+
+
+def read_responses(client, count):
+    response = b""
+    while response.count(RESPONSE_BODY) < count:
+        piece = client.recv()
+        assert len(piece) > 0, "Connection closed after %d of %d responses: %s" % (
+            response.count(RESPONSE_BODY),
+            count,
+            response,
+        )
+        response += piece
+    assert response.count(b"HTTP/1.1 200 OK\r\n") == count, (
+        "Unexpected responses: %s" % response
+    )
+
+
+def test_parking(bump):
+    queue, proxy_process = test_util.runner.run(
+        "./tests-proxy/server/switch_callbacks_proxy",
+        [BEHAVIOR, "immediately", "bump" if bump else "tunnel"],
+    )
+    proxy_port = int(queue.get().strip())
+
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    client.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    client.settimeout(10)
+    client.connect(("127.0.0.1", proxy_port))
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection\n")
+
+    if bump:
+        client.sendall(
+            b"CONNECT example.com:443 HTTP/1.1\r\n" b"Host: example.com:443\r\n\r\n"
+        )
+        test_util.runner.get_line_from_queue_and_assert(queue, "connect example.com 443\n")
+        established = b""
+        while not established.endswith(b"\r\n\r\n"):
+            piece = client.recv(1)
+            assert len(piece) > 0, "Connection closed before CONNECT was answered"
+            established += piece
+        assert established.startswith(b"HTTP/1.1 200"), (
+            "Unexpected CONNECT response: %s" % established
+        )
+        connection = TlsClient(client, "example.com")
+        make_request = bumped_request
+    else:
+        connection = PlainClient(client)
+        make_request = request
+
+    # Two sequential requests, the connection parks in between and stays idle
+    # long enough to free its memory.
+    connection.send(make_request("first"))
+    read_responses(connection, 1)
+    time.sleep(IDLE_GAP)
+    connection.send(make_request("second"))
+    read_responses(connection, 1)
+
+    # Pipelined requests in a single write. With TLS every request is a record
+    # of its own, so the SSL stream reads the records of the next requests
+    # along with the first one.
+    connection.send(make_request("third"), make_request("fourth"), make_request("fifth"))
+    read_responses(connection, 3)
+
+    # And parks again after them.
+    connection.send(make_request("sixth"))
+    read_responses(connection, 1)
+
+    client.close()
+    proxy_process.kill()
+
+
+if __name__ == "__main__":
+    test_parking(False)
+    test_parking(True)
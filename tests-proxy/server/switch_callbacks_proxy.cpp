@@ -8,22 +8,24 @@
 struct switch_callbacks_proxy
     : public tests_proxy::util::ready_callbacks_proxy {
   switch_callbacks_proxy(std::ofstream &debug_pipe, std::string behavior,
-                         bool send_immediately)
+                         bool send_immediately, bool bump)
       : tests_proxy::util::ready_callbacks_proxy(debug_pipe),
-        behavior_(behavior), send_immediately_(send_immediately) {}
+        behavior_(behavior), send_immediately_(send_immediately), bump_(bump) {}
 
   virtual void
   async_on_connection(proxy::callbacks::connection_id connection_id,
-                      BOOST_ASIO_MOVE_ARG(boost::function<void()>) callback) {
+                      BOOST_ASIO_MOVE_ARG(proxy::util::unique_function<void()>)
+                          callback) {
     debug_pipe_ << "connection\n" << std::flush;
     tests_proxy::util::ready_callbacks_proxy::async_on_connection(
-        connection_id, std::forward<boost::function<void()>>(callback));
+        connection_id,
+        std::forward<proxy::util::unique_function<void()>>(callback));
   }
 
   virtual void async_on_connect_method(on_connect_method_params &params) {
     debug_pipe_ << "connect " << params.host << " " << params.service << "\n"
                 << std::flush;
-    params.callback(false);
+    params.callback(bump_);
   }
 
   virtual void async_on_request_pre_body(on_request_pre_body_params &params) {
@@ -364,7 +366,8 @@ struct switch_callbacks_proxy
   virtual void
   async_on_response_finished(proxy::callbacks::connection_id connection_id,
                              proxy::callbacks::request_id request_id,
-                             BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>)
+                             BOOST_ASIO_MOVE_ARG(
+                                 proxy::util::unique_function<void(bool)>)
                                  callback) {
     debug_pipe_ << "response_finished\n" << std::flush;
     std::map<unsigned long long,
@@ -376,7 +379,7 @@ struct switch_callbacks_proxy
 
     tests_proxy::util::ready_callbacks_proxy::async_on_response_finished(
         connection_id, request_id,
-        std::forward<boost::function<void(bool)>>(callback));
+        std::forward<proxy::util::unique_function<void(bool)>>(callback));
   }
 
   virtual void
@@ -390,6 +393,7 @@ struct switch_callbacks_proxy
 private:
   std::string behavior_;
   bool send_immediately_;
+  bool bump_;
   struct request_data {
     bool first_response_body{true};
     std::unique_ptr<std::string> request_buffer{};
@@ -408,11 +412,13 @@ int main(int argc, char *argv[]) {
   std::ofstream debug_pipe{argv[1]};
   std::string behavior = argv[2];
   bool send_immediately = std::string(argv[3]) == "immediately";
+  bool bump = argc > 4 && std::string(argv[4]) == "bump";
 
   setbuf(stdout, NULL);
   setbuf(stderr, NULL);
 
-  switch_callbacks_proxy callbacks(debug_pipe, behavior, send_immediately);
+  switch_callbacks_proxy callbacks(debug_pipe, behavior, send_immediately,
+                                   bump);
 
   // Initialize the server.
   proxy::server::server s("127.0.0.1", "0", callbacks);
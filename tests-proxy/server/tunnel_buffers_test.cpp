@@ -0,0 +1,57 @@
+#include "proxy/server/tunnel_buffers.hpp"
+#include <iostream>
+#include <ostream>
+
+int main(int argc, char *argv[]) {
+  const std::size_t size = proxy::server::buffer_pool::SMALLEST_BUFFER_SIZE;
+  proxy::server::buffer_pool pool(1024 * 1024);
+  proxy::server::tunnel_buffers buffers(pool, 3 * size, size);
+  if (!buffers.can_read() || buffers.can_write()) {
+    std::cerr << "Empty buffers should only be readable!" << std::endl;
+    return 1;
+  }
+  if (boost::asio::buffer_size(buffers.prepare()) != size) {
+    std::cerr << "Wrong buffer size!" << std::endl;
+    return 1;
+  }
+  buffers.commit(size / 2);
+
+  // The first buffer is written while the second one is read into.
+  std::vector<boost::asio::const_buffer> written = buffers.start_write();
+  if (written.size() != 1 || !buffers.can_read() || buffers.can_write()) {
+    std::cerr << "Should read while writing!" << std::endl;
+    return 1;
+  }
+  buffers.prepare();
+  buffers.commit(size);
+  // A full read grows the next buffer.
+  if (boost::asio::buffer_size(buffers.prepare()) != 4 * size) {
+    std::cerr << "The next buffer should be larger!" << std::endl;
+    return 1;
+  }
+  buffers.commit(2 * size);
+  if (buffers.can_read() || buffers.size() != 3 * size + size / 2) {
+    std::cerr << "Should stop reading at the high watermark!" << std::endl;
+    return 1;
+  }
+
+  buffers.finish_write();
+  if (buffers.can_read() || !buffers.can_write()) {
+    std::cerr << "Should not read above the low watermark!" << std::endl;
+    return 1;
+  }
+  if (buffers.start_write().size() != 2) {
+    std::cerr << "Should write all the buffers at once!" << std::endl;
+    return 1;
+  }
+  buffers.finish_write();
+  if (!buffers.can_read() || buffers.can_write() || buffers.size() != 0) {
+    std::cerr << "Should read again below the low watermark!" << std::endl;
+    return 1;
+  }
+  if (pool.get_statistics().size != 6 * size) {
+    std::cerr << "Written buffers should be back in the pool!" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -12,10 +12,12 @@ struct tunnel_or_bump_callbacks_proxy
 
   virtual void
   async_on_connection(proxy::callbacks::connection_id connection_id,
-                      BOOST_ASIO_MOVE_ARG(boost::function<void()>) callback) {
+                      BOOST_ASIO_MOVE_ARG(proxy::util::unique_function<void()>)
+                          callback) {
     debug_pipe_ << "connection\n" << std::flush;
     tests_proxy::util::ready_callbacks_proxy::async_on_connection(
-        connection_id, std::forward<boost::function<void()>>(callback));
+        connection_id,
+        std::forward<proxy::util::unique_function<void()>>(callback));
   }
 
   virtual void async_on_connect_method(on_connect_method_params &params) {
@@ -62,12 +64,13 @@ struct tunnel_or_bump_callbacks_proxy
   virtual void
   async_on_response_finished(proxy::callbacks::connection_id connection_id,
                              proxy::callbacks::request_id request_id,
-                             BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>)
+                             BOOST_ASIO_MOVE_ARG(
+                                 proxy::util::unique_function<void(bool)>)
                                  callback) {
     debug_pipe_ << "response_finished\n" << std::flush;
     tests_proxy::util::ready_callbacks_proxy::async_on_response_finished(
         connection_id, request_id,
-        std::forward<boost::function<void(bool)>>(callback));
+        std::forward<proxy::util::unique_function<void(bool)>>(callback));
   }
 
   virtual void
@@ -89,14 +92,19 @@ int main(int argc, char *argv[]) {
 
   std::ofstream debug_pipe{argv[1]};
   bool bump = argv[2] == std::string("bump");
+  // Tunnels relayed through the buffers of the connection rather than spliced.
+  bool buffered = argc > 3 && argv[3] == std::string("buffered");
 
   setbuf(stdout, NULL);
   setbuf(stderr, NULL);
 
   tunnel_or_bump_callbacks_proxy callbacks(debug_pipe, bump);
 
+  proxy::server::server_options options;
+  options.splice_tunnels = !buffered;
+
   // Initialize the server.
-  proxy::server::server s("127.0.0.1", "0", callbacks);
+  proxy::server::server s("127.0.0.1", "0", callbacks, options);
 
   // Run the server until stopped.
   s.run();
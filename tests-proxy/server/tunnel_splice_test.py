@@ -0,0 +1,157 @@
+import test_util.runner
+import os
+import queue as queue_module
+import socket
+import sys
+import threading
+
+# Large enough to fill the pipes of the spliced tunnel, or the buffers of a
+# buffered one, many times over.
+TRANSFER_SIZE = 4 * 1024 * 1024
+
+
+def receive_until_eof(connection):
+    data = bytearray()
+    while True:
+        piece = connection.recv(65536)
+        if len(piece) == 0:
+            return bytes(data)
+        data += piece
+
+
+def receive_exactly(connection, size):
+    data = bytearray()
+    while len(data) < size:
+        piece = connection.recv(min(65536, size - len(data)))
+        assert len(piece) > 0, "Connection closed after %d of %d bytes" % (
+            len(data),
+            size,
+        )
+        data += piece
+    return bytes(data)
+
+
+class Origin:
+    """Accepts one connection at a time and serves it with the given function
+    on a thread, the result is put on the results queue."""
+
+    def __init__(self):
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.bind(("127.0.0.1", 0))
+        self.listener.listen(4)
+        self.port = self.listener.getsockname()[1]
+        self.results = queue_module.Queue()
+
+    def serve(self, function):
+        def run():
+            connection, _ = self.listener.accept()
+            connection.settimeout(30)
+            try:
+                self.results.put(function(connection))
+            except Exception as e:
+                self.results.put(e)
+            finally:
+                connection.close()
+
+        threading.Thread(target=run, daemon=True).start()
+
+    def result(self):
+        result = self.results.get(timeout=30)
+        if isinstance(result, Exception):
+            raise result
+        return result
+
+
+def open_tunnel(queue, proxy_port, origin):
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    client.settimeout(30)
+    client.connect(("127.0.0.1", proxy_port))
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection\n")
+    client.sendall(
+        b"CONNECT 127.0.0.1:%d HTTP/1.1\r\n"
+        b"Host: 127.0.0.1:%d\r\n\r\n" % (origin.port, origin.port)
+    )
+    test_util.runner.get_line_from_queue_and_assert(
+        queue, "connect 127.0.0.1 %d\n" % origin.port
+    )
+    established = b""
+    while not established.endswith(b"\r\n\r\n"):
+        piece = client.recv(1)
+        assert len(piece) > 0, "Connection closed before CONNECT was answered"
+        established += piece
+    assert established.startswith(b"HTTP/1.1 200"), (
+        "Unexpected CONNECT response: %s" % established
+    )
+    return client
+
+
+def test_client_half_close(queue, proxy_port, origin):
+    # What the client sent before shutting down its side reaches the origin,
+    # followed by the end of the stream, then the tunnel closes.
+    origin.serve(receive_until_eof)
+    client = open_tunnel(queue, proxy_port, origin)
+    data = os.urandom(TRANSFER_SIZE)
+    client.sendall(data)
+    client.shutdown(socket.SHUT_WR)
+    assert origin.result() == data, "Origin did not get the client's bytes"
+    assert receive_until_eof(client) == b"", "Client got unexpected bytes"
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection_finished\n")
+    client.close()
+
+
+def test_origin_half_close(queue, proxy_port, origin):
+    # And the same the other way round.
+    data = os.urandom(TRANSFER_SIZE)
+
+    def send_and_shut_down(connection):
+        connection.sendall(data)
+        connection.shutdown(socket.SHUT_WR)
+        return receive_until_eof(connection)
+
+    origin.serve(send_and_shut_down)
+    client = open_tunnel(queue, proxy_port, origin)
+    assert receive_until_eof(client) == data, "Client did not get the origin's bytes"
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection_finished\n")
+    assert origin.result() == b"", "Origin got unexpected bytes"
+    client.close()
+
+
+def test_both_directions(queue, proxy_port, origin):
+    # The origin echoes what it gets while the client is still sending.
+    def echo(connection):
+        received = 0
+        while received < TRANSFER_SIZE:
+            piece = connection.recv(65536)
+            assert len(piece) > 0, "Client closed after %d bytes" % received
+            connection.sendall(piece)
+            received += len(piece)
+        return received
+
+    origin.serve(echo)
+    client = open_tunnel(queue, proxy_port, origin)
+    data = os.urandom(TRANSFER_SIZE)
+    sender = threading.Thread(target=client.sendall, args=(data,), daemon=True)
+    sender.start()
+    assert receive_exactly(client, TRANSFER_SIZE) == data, "Echo does not match"
+    sender.join()
+    assert origin.result() == TRANSFER_SIZE
+    client.close()
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection_finished\n")
+
+
+if __name__ == "__main__":
+    # Optionally the proxy and whether it buffers tunnels, e.g.
+    # tunnel_or_bump_callbacks_proxy buffered.
+    proxy = sys.argv[1] if len(sys.argv) > 1 else "tunnel_or_bump_callbacks_proxy"
+    origin = Origin()
+
+    queue, proxy_process = test_util.runner.run(
+        "./tests-proxy/server/" + proxy, ["tunnel"] + sys.argv[2:]
+    )
+    proxy_port = int(queue.get().strip())
+
+    test_client_half_close(queue, proxy_port, origin)
+    test_origin_half_close(queue, proxy_port, origin)
+    test_both_directions(queue, proxy_port, origin)
+
+    proxy_process.kill()
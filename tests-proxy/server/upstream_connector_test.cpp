@@ -0,0 +1,69 @@
+#include "proxy/server/upstream_connector.hpp"
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <iostream>
+#include <ostream>
+
+using boost::asio::ip::tcp;
+
+void handle_connect(boost::system::error_code *result, tcp::socket *connected,
+                    const boost::system::error_code &e, tcp::socket &socket) {
+  *result = e;
+  *connected = std::move(socket);
+}
+
+int main(int argc, char *argv[]) {
+  tcp::endpoint v4_1(boost::asio::ip::make_address("192.0.2.1"), 80);
+  tcp::endpoint v4_2(boost::asio::ip::make_address("192.0.2.2"), 80);
+  tcp::endpoint v6_1(boost::asio::ip::make_address("2001:db8::1"), 80);
+  tcp::endpoint v6_2(boost::asio::ip::make_address("2001:db8::2"), 80);
+  std::vector<tcp::endpoint> interleaved =
+      proxy::server::upstream_connector::interleave({v6_1, v6_2, v4_1, v4_2});
+  if (interleaved != std::vector<tcp::endpoint>{v6_1, v4_1, v6_2, v4_2}) {
+    std::cerr << "Address families should alternate!" << std::endl;
+    return 1;
+  }
+
+  boost::asio::io_context io_context;
+  tcp::acceptor acceptor(
+      io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  tcp::endpoint refused;
+  {
+    tcp::acceptor closed(
+        io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    refused = closed.local_endpoint();
+  }
+
+  // The first endpoint refuses, the second one wins.
+  boost::system::error_code result = boost::asio::error::would_block;
+  tcp::socket connected(io_context);
+  boost::shared_ptr<proxy::server::upstream_connector> connector(
+      new proxy::server::upstream_connector(
+          io_context, {refused, acceptor.local_endpoint()},
+          boost::bind(&handle_connect, &result, &connected,
+                      boost::placeholders::_1, boost::placeholders::_2)));
+  connector->start();
+  io_context.run();
+  if (result || !connected.is_open() ||
+      connected.remote_endpoint() != acceptor.local_endpoint()) {
+    std::cerr << "Should connect to the second endpoint: " << result
+              << std::endl;
+    return 1;
+  }
+
+  // All endpoints refuse.
+  result = boost::asio::error::would_block;
+  connector.reset(new proxy::server::upstream_connector(
+      io_context, {refused, refused},
+      boost::bind(&handle_connect, &result, &connected,
+                  boost::placeholders::_1, boost::placeholders::_2)));
+  connector->start();
+  io_context.restart();
+  io_context.run();
+  if (result != boost::asio::error::connection_refused) {
+    std::cerr << "Should fail with connection refused: " << result
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -11,10 +11,12 @@ struct mix_callbacks_proxy : public tests_proxy::util::ready_callbacks_proxy {
 
   virtual void
   async_on_connection(proxy::callbacks::connection_id connection_id,
-                      BOOST_ASIO_MOVE_ARG(boost::function<void()>) callback) {
+                      BOOST_ASIO_MOVE_ARG(proxy::util::unique_function<void()>)
+                          callback) {
     debug_pipe_ << "connection\n" << std::flush;
     tests_proxy::util::ready_callbacks_proxy::async_on_connection(
-        connection_id, std::forward<boost::function<void()>>(callback));
+        connection_id,
+        std::forward<proxy::util::unique_function<void()>>(callback));
   }
 
   virtual void async_on_connect_method(on_connect_method_params &params) {
@@ -82,12 +84,13 @@ struct mix_callbacks_proxy : public tests_proxy::util::ready_callbacks_proxy {
   virtual void
   async_on_response_finished(proxy::callbacks::connection_id connection_id,
                              proxy::callbacks::request_id request_id,
-                             BOOST_ASIO_MOVE_ARG(boost::function<void(bool)>)
+                             BOOST_ASIO_MOVE_ARG(
+                                 proxy::util::unique_function<void(bool)>)
                                  callback) {
     debug_pipe_ << "response_finished\n" << std::flush;
     tests_proxy::util::ready_callbacks_proxy::async_on_response_finished(
         connection_id, request_id,
-        std::forward<boost::function<void(bool)>>(callback));
+        std::forward<proxy::util::unique_function<void(bool)>>(callback));
   }
 
   virtual void
@@ -0,0 +1,64 @@
+#include "proxy/server/upstream_pool.hpp"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iostream>
+#include <ostream>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+int main(int argc, char *argv[]) {
+  boost::asio::io_context io_context;
+  tcp::acceptor acceptor(
+      io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+  proxy::server::upstream_pool_options options;
+  options.max_idle_per_origin = 1;
+  proxy::server::upstream_pool pool(io_context, options);
+
+  tcp::socket first(io_context);
+  first.connect(acceptor.local_endpoint());
+  tcp::socket first_peer = acceptor.accept();
+  pool.release("example.com", "80", first);
+
+  tcp::socket socket(io_context);
+  if (pool.acquire("example.com", "443", socket) ||
+      pool.acquire("example.org", "80", socket)) {
+    std::cerr << "Pool should only have example.com:80!" << std::endl;
+    return 1;
+  }
+  if (!pool.acquire("example.com", "80", socket) || !socket.is_open()) {
+    std::cerr << "Pool should have example.com:80!" << std::endl;
+    return 1;
+  }
+  pool.release("example.com", "80", socket);
+
+  // Replaces the first connection, only one is kept per origin.
+  tcp::socket second(io_context);
+  second.connect(acceptor.local_endpoint());
+  tcp::socket second_peer = acceptor.accept();
+  pool.release("example.com", "80", second);
+  if (pool.get_statistics().evictions != 1 || pool.get_statistics().size != 1) {
+    std::cerr << "The first connection should be evicted!" << std::endl;
+    return 1;
+  }
+
+  // The origin closes the idle connection.
+  second_peer.close();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (pool.acquire("example.com", "80", socket)) {
+    std::cerr << "Closed connection should not be reused!" << std::endl;
+    return 1;
+  }
+
+  proxy::server::upstream_pool::statistics statistics = pool.get_statistics();
+  if (statistics.hits != 1 || statistics.misses != 3 || statistics.stale != 1 ||
+      statistics.size != 0) {
+    std::cerr << "Wrong statistics: " << statistics.hits << " hits, "
+              << statistics.misses << " misses, " << statistics.stale
+              << " stale, " << statistics.size << " idle!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
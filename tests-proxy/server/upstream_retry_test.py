@@ -0,0 +1,100 @@
+import test_util.runner
+import test_util.thread_safe_counter
+import socket
+import threading
+import time
+
+if __name__ == "__main__":
+
+    connection_counter = test_util.thread_safe_counter.Counter()
+
+    # Answers the first request and keeps the connection alive, then closes
+    # every connection once a request arrives without answering it.
+    origin = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    origin.bind(("127.0.0.1", 0))
+    origin.listen(16)
+    origin_port = origin.getsockname()[1]
+
+    def read_request(connection):
+        request = b""
+        while b"\r\n\r\n" not in request:
+            piece = connection.recv(4096)
+            if len(piece) == 0:
+                return False
+            request += piece
+        return True
+
+    def serve(connection, first):
+        if first and read_request(connection):
+            response = b"<h1>first</h1>"
+            connection.sendall(
+                b"HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s"
+                % (len(response), response)
+            )
+        read_request(connection)
+        connection.close()
+
+    def accept_forever():
+        while True:
+            connection, _ = origin.accept()
+            connection_counter.increment()
+            threading.Thread(
+                target=serve,
+                args=(connection, connection_counter.value() == 1),
+                daemon=True,
+            ).start()
+
+    thread = threading.Thread(target=accept_forever)
+    thread.daemon = True  # thread dies with the program
+    thread.start()
+
+    queue, proxy_process = test_util.runner.run(
+        "./tests-proxy/server/tunnel_or_bump_callbacks_proxy", ["tunnel"]
+    )
+
+    proxy_port = int(queue.get().strip())
+
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    client.connect(("127.0.0.1", proxy_port))
+    test_util.runner.get_line_from_queue_and_assert(queue, "connection\n")
+
+    def send_request(suffix):
+        client.send(
+            b"GET http://127.0.0.1:%d/%s/ HTTP/1.1\r\n"
+            b"Host: 127.0.0.1:%d\r\n\r\n" % (origin_port, suffix, origin_port)
+        )
+        test_util.runner.get_line_from_queue_and_assert(
+            queue, "request_pre_body /%s/\n" % suffix.decode()
+        )
+        test_util.runner.get_line_from_queue_and_assert(
+            queue, "request_body_some_last /%s/\n" % suffix.decode()
+        )
+
+    send_request(b"first")
+    test_util.runner.get_line_from_queue_and_assert(
+        queue, "response_pre_body /first/ 200\n"
+    )
+    test_util.runner.get_line_from_queue_and_assert(
+        queue, "response_body_some_last /first/\n"
+    )
+    test_util.runner.get_line_from_queue_and_assert(queue, "response_finished\n")
+    response = b""
+    while not response.endswith(b"<h1>first</h1>"):
+        response += client.recv(4096)
+
+    # Goes out on the idle connection which the origin closes, is resent once
+    # on a new connection which the origin closes too.
+    send_request(b"second")
+
+    client.settimeout(10)
+    while len(client.recv(4096)) > 0:
+        pass
+    client.close()
+
+    # A retry loop would keep connecting.
+    time.sleep(0.5)
+    assert connection_counter.value() == 2, (
+        "Unexpected connection count - expected 2 was %d" % connection_counter.value()
+    )
+
+    proxy_process.kill()
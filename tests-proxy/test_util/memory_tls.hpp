@@ -0,0 +1,85 @@
+#ifndef TESTS_PROXY_UTIL_MEMORY_TLS_HPP
+#define TESTS_PROXY_UTIL_MEMORY_TLS_HPP
+
+#include <boost/asio/ssl.hpp>
+#include <memory>
+#include <openssl/ec.h>
+#include <string>
+
+namespace tests_proxy {
+namespace util {
+
+typedef std::unique_ptr<SSL, decltype(&SSL_free)> SSL_ptr;
+
+/// A TLS server context serving a self-signed certificate of the host, with
+/// protocol versions up to max_version.
+inline bool setup_server_context(boost::asio::ssl::context &ssl_context,
+                                 const std::string &host, int max_version) {
+  SSL_CTX *ctx = ssl_context.native_handle();
+  std::unique_ptr<EC_KEY, decltype(&EC_KEY_free)> ec_key(
+      EC_KEY_new_by_curve_name(NID_X9_62_prime256v1), EC_KEY_free);
+  std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(EVP_PKEY_new(),
+                                                          EVP_PKEY_free);
+  std::unique_ptr<X509, decltype(&X509_free)> x509(X509_new(), X509_free);
+  if (!ec_key || !key || !x509 || !EC_KEY_generate_key(ec_key.get()) ||
+      !EVP_PKEY_set1_EC_KEY(key.get(), ec_key.get())) {
+    return false;
+  }
+  X509_NAME *name = X509_get_subject_name(x509.get());
+  return X509_set_version(x509.get(), 2) &&
+         ASN1_INTEGER_set(X509_get_serialNumber(x509.get()), 1) &&
+         X509_gmtime_adj(X509_getm_notBefore(x509.get()), 0) &&
+         X509_gmtime_adj(X509_getm_notAfter(x509.get()), 3600) &&
+         X509_set_pubkey(x509.get(), key.get()) &&
+         X509_NAME_add_entry_by_txt(
+             name, "CN", MBSTRING_ASC,
+             reinterpret_cast<const unsigned char *>(host.c_str()), -1, -1,
+             0) &&
+         X509_set_issuer_name(x509.get(), name) &&
+         X509_sign(x509.get(), key.get(), EVP_sha256()) &&
+         SSL_CTX_use_certificate(ctx, x509.get()) &&
+         SSL_CTX_use_PrivateKey(ctx, key.get()) &&
+         SSL_CTX_set_max_proto_version(ctx, max_version);
+}
+
+/// Run the handshake of the client and server connections over a memory BIO
+/// pair, then let the client take the TLS 1.3 tickets the server sent after
+/// the handshake.
+inline bool memory_handshake(SSL *client, SSL *server) {
+  BIO *client_bio;
+  BIO *server_bio;
+  if (!BIO_new_bio_pair(&client_bio, 0, &server_bio, 0)) {
+    return false;
+  }
+  SSL_set_bio(client, client_bio, client_bio);
+  SSL_set_bio(server, server_bio, server_bio);
+  SSL_set_connect_state(client);
+  SSL_set_accept_state(server);
+  bool client_done = false;
+  bool server_done = false;
+  for (int round = 0; round < 16 && !(client_done && server_done); round++) {
+    for (SSL *ssl : {client, server}) {
+      bool &done = ssl == client ? client_done : server_done;
+      if (done) {
+        continue;
+      }
+      int result = SSL_do_handshake(ssl);
+      if (result == 1) {
+        done = true;
+      } else if (SSL_get_error(ssl, result) != SSL_ERROR_WANT_READ) {
+        return false;
+      }
+    }
+  }
+  if (!client_done || !server_done) {
+    return false;
+  }
+  char byte;
+  int result = SSL_read(client, &byte, 1);
+  return result <= 0 && SSL_get_error(client, result) == SSL_ERROR_WANT_READ;
+}
+
+} // namespace util
+} // namespace tests_proxy
+
+#endif // TESTS_PROXY_UTIL_MEMORY_TLS_HPP
@@ -0,0 +1,165 @@
+#include "proxy/tls/client_sessions.hpp"
+#include "tests-proxy/test_util/memory_tls.hpp"
+#include <chrono>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Longer than the session lifetime of the expiry test.
+const std::chrono::milliseconds EXPIRY_WAIT(1100);
+
+// A handshake of a connection to the origin, resuming a cached session of the
+// origin if there is one.
+bool handshake(boost::asio::ssl::context &server_context,
+               boost::asio::ssl::context &client_context,
+               proxy::tls::client_sessions &sessions, const std::string &host,
+               bool &resumed) {
+  tests_proxy::util::SSL_ptr server(SSL_new(server_context.native_handle()),
+                                    SSL_free);
+  tests_proxy::util::SSL_ptr client(SSL_new(client_context.native_handle()),
+                                    SSL_free);
+  sessions.attach(client.get(), host, "443");
+  if (!tests_proxy::util::memory_handshake(client.get(), server.get())) {
+    return false;
+  }
+  resumed = SSL_session_reused(client.get());
+  // Without a shutdown, freeing the connections makes the session not
+  // resumable.
+  SSL_set_shutdown(client.get(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  SSL_set_shutdown(server.get(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  return true;
+}
+
+// The session the cache offers to a new connection to the origin, null if
+// none.
+proxy::tls::SSL_SESSION_ptr offered(boost::asio::ssl::context &client_context,
+                                    proxy::tls::client_sessions &sessions,
+                                    const std::string &host) {
+  tests_proxy::util::SSL_ptr client(SSL_new(client_context.native_handle()),
+                                    SSL_free);
+  sessions.attach(client.get(), host, "443");
+  return proxy::tls::SSL_SESSION_ptr(SSL_get1_session(client.get()),
+                                     SSL_SESSION_free);
+}
+
+int main(int argc, char *argv[]) {
+  boost::asio::ssl::context tls_1_2_server(boost::asio::ssl::context::tls);
+  if (!tests_proxy::util::setup_server_context(tls_1_2_server, "example.com",
+                                               TLS1_2_VERSION)) {
+    std::cerr << "Failed setting up the server context!" << std::endl;
+    return 1;
+  }
+
+  proxy::tls::client_sessions sessions;
+  boost::asio::ssl::context client_context(boost::asio::ssl::context::tls);
+  if (!sessions.setup(client_context)) {
+    std::cerr << "Failed setting up the client context!" << std::endl;
+    return 1;
+  }
+
+  // Servers send a couple of TLS 1.3 tickets per connection, at most 4 are
+  // kept per origin. New servers cannot resume the tickets, so that every
+  // connection adds them all.
+  bool resumed;
+  for (int i = 0; i < 4; i++) {
+    boost::asio::ssl::context server_context(boost::asio::ssl::context::tls);
+    if (!tests_proxy::util::setup_server_context(
+            server_context, "example.com", TLS1_3_VERSION) ||
+        !handshake(server_context, client_context, sessions, "a.example.com",
+                   resumed) ||
+        resumed) {
+      std::cerr << "TLS 1.3 handshake " << i << " failed!" << std::endl;
+      return 1;
+    }
+  }
+  // TLS 1.3 tickets are used once.
+  proxy::tls::SSL_SESSION_ptr tickets[4] = {
+      offered(client_context, sessions, "a.example.com"),
+      offered(client_context, sessions, "a.example.com"),
+      offered(client_context, sessions, "a.example.com"),
+      offered(client_context, sessions, "a.example.com")};
+  for (int i = 0; i < 4; i++) {
+    if (!tickets[i] || (i > 0 && tickets[i] == tickets[i - 1])) {
+      std::cerr << "TLS 1.3 ticket " << i << " should be offered once!"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (offered(client_context, sessions, "a.example.com")) {
+    std::cerr << "At most 4 TLS 1.3 tickets should be kept!" << std::endl;
+    return 1;
+  }
+
+  // TLS 1.2 sessions are shared by the connections.
+  if (!handshake(tls_1_2_server, client_context, sessions, "b.example.com",
+                 resumed) ||
+      resumed) {
+    std::cerr << "First TLS 1.2 handshake should not resume!" << std::endl;
+    return 1;
+  }
+  proxy::tls::SSL_SESSION_ptr shared =
+      offered(client_context, sessions, "b.example.com");
+  if (!shared ||
+      offered(client_context, sessions, "b.example.com") != shared) {
+    std::cerr << "TLS 1.2 session should be shared!" << std::endl;
+    return 1;
+  }
+  if (!handshake(tls_1_2_server, client_context, sessions, "b.example.com",
+                 resumed) ||
+      !resumed) {
+    std::cerr << "TLS 1.2 session should resume!" << std::endl;
+    return 1;
+  }
+
+  // Least recently used origins are evicted.
+  proxy::tls::client_sessions lru_sessions(2);
+  boost::asio::ssl::context lru_client_context(boost::asio::ssl::context::tls);
+  if (!lru_sessions.setup(lru_client_context) ||
+      !handshake(tls_1_2_server, lru_client_context, lru_sessions,
+                 "a.example.com", resumed) ||
+      !handshake(tls_1_2_server, lru_client_context, lru_sessions,
+                 "b.example.com", resumed) ||
+      !offered(lru_client_context, lru_sessions, "a.example.com") ||
+      !handshake(tls_1_2_server, lru_client_context, lru_sessions,
+                 "c.example.com", resumed)) {
+    std::cerr << "Failed filling the LRU sessions!" << std::endl;
+    return 1;
+  }
+  if (offered(lru_client_context, lru_sessions, "b.example.com") ||
+      !offered(lru_client_context, lru_sessions, "a.example.com") ||
+      !offered(lru_client_context, lru_sessions, "c.example.com")) {
+    std::cerr << "b.example.com should be evicted!" << std::endl;
+    return 1;
+  }
+  proxy::tls::client_sessions::statistics statistics =
+      lru_sessions.get_statistics();
+  if (statistics.hits != 3 || statistics.misses != 4 ||
+      statistics.stored != 3 || statistics.evictions != 1 ||
+      statistics.size != 2) {
+    std::cerr << "Wrong statistics: hits " << statistics.hits << ", misses "
+              << statistics.misses << ", stored " << statistics.stored
+              << ", evictions " << statistics.evictions << ", size "
+              << statistics.size << "!" << std::endl;
+    return 1;
+  }
+
+  // Expired sessions are dropped, with their origin.
+  proxy::tls::client_sessions short_sessions(16, std::chrono::seconds(1));
+  boost::asio::ssl::context short_client_context(
+      boost::asio::ssl::context::tls);
+  if (!short_sessions.setup(short_client_context) ||
+      !handshake(tls_1_2_server, short_client_context, short_sessions,
+                 "a.example.com", resumed)) {
+    std::cerr << "Failed storing the short session!" << std::endl;
+    return 1;
+  }
+  std::this_thread::sleep_for(EXPIRY_WAIT);
+  if (offered(short_client_context, short_sessions, "a.example.com") ||
+      short_sessions.get_statistics().size != 0) {
+    std::cerr << "Expired session should be dropped!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
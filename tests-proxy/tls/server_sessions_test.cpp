@@ -0,0 +1,133 @@
+#include "proxy/tls/server_sessions.hpp"
+#include "tests-proxy/test_util/memory_tls.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+
+typedef std::unique_ptr<SSL_SESSION, decltype(&SSL_SESSION_free)>
+    SSL_SESSION_ptr;
+
+// Longer than the lifetime of the ticket keys of the test.
+const std::chrono::milliseconds KEY_ROTATION_WAIT(1100);
+
+// A TLS 1.2 handshake with the server, resuming the session if given. Returns
+// the session of the client, null if the handshake failed.
+SSL_SESSION_ptr handshake(boost::asio::ssl::context &server_context,
+                          boost::asio::ssl::context &client_context,
+                          SSL_SESSION *session, bool &resumed) {
+  tests_proxy::util::SSL_ptr server(SSL_new(server_context.native_handle()),
+                                    SSL_free);
+  tests_proxy::util::SSL_ptr client(SSL_new(client_context.native_handle()),
+                                    SSL_free);
+  if (session != nullptr) {
+    SSL_set_session(client.get(), session);
+  }
+  if (!tests_proxy::util::memory_handshake(client.get(), server.get())) {
+    return SSL_SESSION_ptr(nullptr, SSL_SESSION_free);
+  }
+  resumed = SSL_session_reused(client.get());
+  // Without a shutdown, freeing the connections makes the session not
+  // resumable.
+  SSL_set_shutdown(client.get(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  SSL_set_shutdown(server.get(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  return SSL_SESSION_ptr(SSL_get1_session(client.get()), SSL_SESSION_free);
+}
+
+// The name of the key the ticket of the session is encrypted with, the ticket
+// starts with it.
+std::string key_name(SSL_SESSION *session) {
+  const unsigned char *ticket;
+  std::size_t length;
+  SSL_SESSION_get0_ticket(session, &ticket, &length);
+  return std::string(reinterpret_cast<const char *>(ticket),
+                     std::min<std::size_t>(length, 16));
+}
+
+int main(int argc, char *argv[]) {
+  proxy::tls::server_sessions sessions(std::chrono::seconds(1));
+  boost::asio::ssl::context server_context(boost::asio::ssl::context::tls);
+  boost::asio::ssl::context client_context(boost::asio::ssl::context::tls);
+  // Tickets are renewed in TLS 1.2 resumptions, not TLS 1.3 ones.
+  if (!tests_proxy::util::setup_server_context(server_context, "example.com",
+                                               TLS1_2_VERSION) ||
+      !sessions.setup(server_context, "example.com")) {
+    std::cerr << "Failed setting up the server context!" << std::endl;
+    return 1;
+  }
+  // Sessions outlive the ticket keys, so that rotated keys can be seen.
+  SSL_CTX_set_timeout(server_context.native_handle(), 3600);
+
+  bool resumed = true;
+  SSL_SESSION_ptr first =
+      handshake(server_context, client_context, nullptr, resumed);
+  if (!first || resumed || key_name(first.get()).length() != 16) {
+    std::cerr << "First handshake should get a ticket!" << std::endl;
+    return 1;
+  }
+
+  // Tickets are encrypted with the current key, and resume.
+  SSL_SESSION_ptr second =
+      handshake(server_context, client_context, nullptr, resumed);
+  if (!second || key_name(second.get()) != key_name(first.get())) {
+    std::cerr << "Tickets should be encrypted with the current key!"
+              << std::endl;
+    return 1;
+  }
+  if (!handshake(server_context, client_context, first.get(), resumed) ||
+      !resumed) {
+    std::cerr << "Ticket of the current key should resume!" << std::endl;
+    return 1;
+  }
+
+  // The key is rotated once it expires.
+  std::this_thread::sleep_for(KEY_ROTATION_WAIT);
+  SSL_SESSION_ptr rotated =
+      handshake(server_context, client_context, nullptr, resumed);
+  if (!rotated || resumed ||
+      key_name(rotated.get()) == key_name(first.get())) {
+    std::cerr << "Ticket key should be rotated!" << std::endl;
+    return 1;
+  }
+
+  // Tickets of the previous key still resume, and are renewed with the
+  // current key.
+  SSL_SESSION_ptr renewed =
+      handshake(server_context, client_context, first.get(), resumed);
+  if (!renewed || !resumed) {
+    std::cerr << "Ticket of the previous key should resume!" << std::endl;
+    return 1;
+  }
+  if (key_name(renewed.get()) != key_name(rotated.get())) {
+    std::cerr << "Ticket of the previous key should be renewed!" << std::endl;
+    return 1;
+  }
+
+  // Tickets of older keys are unknown, and get a full handshake.
+  std::this_thread::sleep_for(KEY_ROTATION_WAIT);
+  if (!handshake(server_context, client_context, nullptr, resumed)) {
+    std::cerr << "Handshake after the second rotation failed!" << std::endl;
+    return 1;
+  }
+  if (!handshake(server_context, client_context, first.get(), resumed) ||
+      resumed) {
+    std::cerr << "Ticket of an unknown key should not resume!" << std::endl;
+    return 1;
+  }
+
+  // Of the 7 handshakes, the two with the first ticket resumed while its key
+  // was known.
+  proxy::tls::server_sessions::statistics statistics =
+      sessions.get_statistics();
+  if (statistics.handshakes != 7 || statistics.resumed != 2) {
+    std::cerr << "Wrong statistics: handshakes " << statistics.handshakes
+              << ", resumed " << statistics.resumed << "!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
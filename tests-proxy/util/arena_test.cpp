@@ -0,0 +1,143 @@
+#include "proxy/util/arena.hpp"
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The block size documented in arena.hpp.
+constexpr std::size_t block_size = 4096;
+
+bool check_values(std::string prefix,
+                  const std::vector<std::string_view> &views,
+                  const std::vector<std::string> &values) {
+  for (std::size_t i = 0; i < views.size(); i++) {
+    if (views[i] != values[i]) {
+      std::cerr << prefix << "Stored value " << i << " changed!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  proxy::util::arena arena;
+  std::vector<std::string> values;
+  std::vector<std::string_view> views;
+
+  // Four quarters fill a block, the next value starts another.
+  for (char c = 'a'; c < 'e'; c++) {
+    values.push_back(std::string(block_size / 4, c));
+    views.push_back(arena.store(values.back()));
+    if (views.size() > 1 &&
+        views[views.size() - 2].data() + block_size / 4 !=
+            views.back().data()) {
+      std::cerr << "Values should follow each other in a block!" << std::endl;
+      return 1;
+    }
+  }
+  values.push_back("e");
+  views.push_back(arena.store(values.back()));
+  if (views[3].data() + block_size / 4 == views[4].data()) {
+    std::cerr << "Full block should not be written past!" << std::endl;
+    return 1;
+  }
+
+  // A value bigger than a quarter of a block which does not fit the current
+  // block gets a block of its own, the current block goes on after it.
+  values.push_back(std::string(block_size / 2, 'f'));
+  views.push_back(arena.store(values.back()));
+  values.push_back(std::string(block_size / 2, 'g'));
+  views.push_back(arena.store(values.back()));
+  values.push_back("h");
+  views.push_back(arena.store(values.back()));
+  if (views[4].data() + 1 != views[5].data()) {
+    std::cerr << "Big value should use the current block if it fits!"
+              << std::endl;
+    return 1;
+  }
+  if (views[5].data() + block_size / 2 != views[7].data()) {
+    std::cerr << "Big value should not take the rest of the current block!"
+              << std::endl;
+    return 1;
+  }
+  if (!check_values("Stored: ", views, values)) {
+    return 1;
+  }
+
+  if (!arena.store("").empty()) {
+    std::cerr << "Empty value should be stored as empty view!" << std::endl;
+    return 1;
+  }
+
+  // Views stay valid when the arena moves.
+  proxy::util::arena moved(std::move(arena));
+  if (!check_values("Moved: ", views, values)) {
+    return 1;
+  }
+  proxy::util::arena assigned;
+  assigned.store("x");
+  assigned = std::move(moved);
+  if (!check_values("Assigned: ", views, values)) {
+    return 1;
+  }
+  values.push_back("i");
+  views.push_back(assigned.store(values.back()));
+  if (views[7].data() + 1 != views[8].data()) {
+    std::cerr << "Moved arena should go on in its current block!" << std::endl;
+    return 1;
+  }
+
+  // Moved from and cleared arenas can be used again.
+  std::string_view j = moved.store("j");
+  std::string_view k = moved.store("k");
+  if (j != "j" || k != "k" || j.data() + 1 != k.data()) {
+    std::cerr << "Moved from arena should store values!" << std::endl;
+    return 1;
+  }
+  // The current block is the one "e" starts.
+  const char *current_block = views[4].data();
+  assigned.clear();
+  values.clear();
+  views.clear();
+  for (char c = 'l'; c < 'p'; c++) {
+    values.push_back(std::string(block_size / 4, c));
+    views.push_back(assigned.store(values.back()));
+  }
+  if (views[0].data() != current_block) {
+    std::cerr << "Cleared arena should keep its current block!" << std::endl;
+    return 1;
+  }
+  if (views[0].data() + block_size / 4 != views[1].data() ||
+      views[2].data() + block_size / 4 != views[3].data()) {
+    std::cerr << "Cleared arena should fill blocks again!" << std::endl;
+    return 1;
+  }
+  if (!check_values("Cleared: ", views, values)) {
+    return 1;
+  }
+
+  // Blocks of big values are not kept.
+  proxy::util::arena big;
+  big.store(std::string(block_size / 2, 'p'));
+  big.clear();
+  std::string_view q = big.store("q");
+  std::string_view r = big.store("r");
+  if (q != "q" || r != "r" || q.data() + 1 != r.data()) {
+    std::cerr << "Arena cleared of a big value should store values!"
+              << std::endl;
+    return 1;
+  }
+
+  // Released arenas start over.
+  assigned.release();
+  std::string_view s = assigned.store("s");
+  std::string_view t = assigned.store("t");
+  if (s != "s" || t != "t" || s.data() + 1 != t.data()) {
+    std::cerr << "Released arena should store values!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+#include "proxy/util/unique_function.hpp"
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <memory>
+#include <ostream>
+
+struct counter {
+  void add(int n) { value += n; }
+  int value{};
+};
+
+int main(int argc, char *argv[]) {
+  boost::shared_ptr<counter> c(new counter());
+
+  proxy::util::unique_function<void(int)> bound =
+      boost::bind(&counter::add, c, boost::placeholders::_1);
+  proxy::util::unique_function<void(int)> moved(std::move(bound));
+  if (bound) {
+    std::cerr << "Moved from function should be empty!" << std::endl;
+    return 1;
+  }
+  moved(2);
+  if (c->value != 2) {
+    std::cerr << "Bound function should have been called!" << std::endl;
+    return 1;
+  }
+
+  // Move-only and bigger than the buffer, so allocated.
+  std::unique_ptr<int> owned(new int(5));
+  char padding[2 * proxy::util::unique_function<int()>::buffer_size] = {};
+  proxy::util::unique_function<int()> big =
+      [owned = std::move(owned), padding]() { return *owned + padding[0]; };
+  proxy::util::unique_function<int()> assigned;
+  assigned = std::move(big);
+  if (assigned() != 5) {
+    std::cerr << "Allocated function should have been called!" << std::endl;
+    return 1;
+  }
+
+  moved = nullptr;
+  if (moved || c.use_count() != 1) {
+    std::cerr << "Reset function should release what it holds!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}